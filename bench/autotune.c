@@ -0,0 +1,309 @@
+#include <errno.h>
+#include <malloc.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "hw7.h"
+
+// Timings are the best of this many runs, each long enough for the clock to resolve
+#define TIMING_RUNS 5
+#define MIN_RUN_NS 2000000ULL
+// A parallel path or streaming stores have to beat the plain path by this much to be turned on: noise shouldn't
+// turn them on
+#define REQUIRED_GAIN 0.9
+
+typedef matrix_sf* (*TunedOp)(const matrix_sf *left, const matrix_sf *right);
+
+// Helper function to read a monotonic clock in nanoseconds
+static unsigned long long NowNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+}
+
+// Helper function to allocate a rows x cols matrix of values in [-100, 100], the same for the same seed
+static matrix_sf* RandomMatrix(unsigned int rows, unsigned int cols, unsigned int seed) {
+    matrix_sf *mat = malloc(sizeof(matrix_sf) + (size_t)rows * cols * sizeof(int));
+    mat->name = '?';
+    mat->num_rows = rows;
+    mat->num_cols = cols;
+    for (size_t i = 0; i < (size_t)rows * cols; i++) {
+        seed = seed * 1103515245u + 12345u;
+        mat->values[i] = (int)(seed >> 16) % 201 - 100;
+    }
+    return mat;
+}
+
+// Helper function to run add_mats_sf as a TunedOp
+static matrix_sf* RunAdd(const matrix_sf *left, const matrix_sf *right) {
+    return add_mats_sf(left, right);
+}
+
+// Helper function to run mult_mats_sf as a TunedOp
+static matrix_sf* RunMult(const matrix_sf *left, const matrix_sf *right) {
+    return mult_mats_sf(left, right);
+}
+
+// Helper function to run transpose_mat_sf on the left operand as a TunedOp
+static matrix_sf* RunTranspose(const matrix_sf *left, const matrix_sf *right) {
+    (void)right;
+    return transpose_mat_sf(left);
+}
+
+// Helper function to time nanoseconds per call of op under tuning: the best of TIMING_RUNS runs of as many calls as
+// fill MIN_RUN_NS
+static double TimeOp(const tuning_sf *tuning, TunedOp op, const matrix_sf *left, const matrix_sf *right) {
+    set_tuning_sf(tuning);
+    unsigned long long calls = 1;
+    for (;;) {
+        unsigned long long start = NowNanoseconds();
+        for (unsigned long long i = 0; i < calls; i++) {
+            free(op(left, right));
+        }
+        if (NowNanoseconds() - start >= MIN_RUN_NS / 4 || calls >= (1ULL << 30)) {
+            break;
+        }
+        calls *= 2;
+    }
+    calls = calls * 4;
+    double best = 0;
+    for (int run = 0; run < TIMING_RUNS; run++) {
+        unsigned long long start = NowNanoseconds();
+        for (unsigned long long i = 0; i < calls; i++) {
+            free(op(left, right));
+        }
+        double per_call = (double)(NowNanoseconds() - start) / (double)calls;
+        if (run == 0 || per_call < best) {
+            best = per_call;
+        }
+    }
+    return best;
+}
+
+// Helper function to time nanoseconds per call of op on n x n operands under tuning
+static double TimeSquare(const tuning_sf *tuning, TunedOp op, unsigned int n) {
+    matrix_sf *left = RandomMatrix(n, n, 1), *right = RandomMatrix(n, n, 2);
+    double ns = TimeOp(tuning, op, left, right);
+    free(left);
+    free(right);
+    return ns;
+}
+
+// Helper function to find the largest of the unrolled kernels' sizes up to which they beat the general loops,
+// stopping at the first that doesn't
+static unsigned int TuneSmallMaxDim(tuning_sf *tuning, unsigned int *max_dim, TunedOp op, const char *label) {
+    static const unsigned int dims[] = {4, 8, 16};
+    unsigned int best = 0;
+    for (size_t i = 0; i < sizeof(dims) / sizeof(dims[0]); i++) {
+        *max_dim = dims[i];
+        double unrolled = TimeSquare(tuning, op, dims[i]);
+        *max_dim = dims[i] - 1;
+        double general = TimeSquare(tuning, op, dims[i]);
+        printf("  %-28s %2ux%-2u   unrolled %10.1f ns  general %10.1f ns\n", label, dims[i], dims[i], unrolled,
+               general);
+        if (unrolled >= general) {
+            break;
+        }
+        best = dims[i];
+    }
+    *max_dim = best;
+    return best;
+}
+
+// Helper function to find the fastest of the candidate block sizes for op on n x n operands
+static unsigned int TuneBlock(tuning_sf *tuning, unsigned int *block, const unsigned int *candidates,
+                               size_t candidate_count, TunedOp op, unsigned int n, const char *label) {
+    matrix_sf *left = RandomMatrix(n, n, 1), *right = RandomMatrix(n, n, 2);
+    unsigned int best = 0;
+    double best_ns = 0;
+    for (size_t i = 0; i < candidate_count; i++) {
+        *block = candidates[i];
+        double ns = TimeOp(tuning, op, left, right);
+        printf("  %-28s %4ux%-4u block %4u  %12.1f ns\n", label, n, n, candidates[i], ns);
+        if (i == 0 || ns < best_ns) {
+            best = candidates[i];
+            best_ns = ns;
+        }
+    }
+    free(left);
+    free(right);
+    *block = best;
+    return best;
+}
+
+// Helper function to find the work per thread for op: the work of the smallest size, doubling from first_n to last_n,
+// that two threads run REQUIRED_GAIN faster than one, or 0 if none is
+static unsigned long long TuneParallel(tuning_sf *tuning, unsigned long long *min_work, TunedOp op,
+                                        unsigned int first_n, unsigned int last_n, int cubic, const char *label) {
+    for (unsigned int n = first_n; n <= last_n; n *= 2) {
+        unsigned long long work = (unsigned long long)n * n * (cubic ? n : 1);
+        *min_work = 0;
+        double serial = TimeSquare(tuning, op, n);
+        *min_work = work / 2;
+        double parallel = TimeSquare(tuning, op, n);
+        printf("  %-28s %4ux%-4u serial %12.1f ns  parallel %12.1f ns\n", label, n, n, serial, parallel);
+        if (parallel < serial * REQUIRED_GAIN) {
+            *min_work = work / 2;
+            return *min_work;
+        }
+    }
+    *min_work = 0;
+    return 0;
+}
+
+// Helper function to find the result bytes of the smallest size, doubling from first_n to last_n, whose sum and
+// transpose both run REQUIRED_GAIN faster with streaming stores, or the default (the detected cache size) if none do
+static unsigned long long TuneStream(tuning_sf *tuning, unsigned int first_n, unsigned int last_n) {
+    tuning_sf defaults;
+    default_tuning_sf(&defaults);
+    // Results this big would otherwise come from fresh mmap()ed pages on every call, as they don't in a process that
+    // has warmed up, and the page faults would swamp the stores being measured
+    mallopt(M_MMAP_THRESHOLD, 1 << 30);
+    mallopt(M_TRIM_THRESHOLD, 1 << 30);
+    for (unsigned int n = first_n; n <= last_n; n *= 2) {
+        unsigned long long bytes = (unsigned long long)n * n * sizeof(int);
+        tuning->stream_min_bytes = 0;
+        double cached_add = TimeSquare(tuning, RunAdd, n), cached_transpose = TimeSquare(tuning, RunTranspose, n);
+        tuning->stream_min_bytes = 1;
+        double streamed_add = TimeSquare(tuning, RunAdd, n);
+        double streamed_transpose = TimeSquare(tuning, RunTranspose, n);
+        printf("  %-28s %4ux%-4u cached %12.1f ns  streamed %12.1f ns\n", "add_mats_sf", n, n, cached_add,
+               streamed_add);
+        printf("  %-28s %4ux%-4u cached %12.1f ns  streamed %12.1f ns\n", "transpose_mat_sf", n, n, cached_transpose,
+               streamed_transpose);
+        if (streamed_add < cached_add * REQUIRED_GAIN && streamed_transpose < cached_transpose * REQUIRED_GAIN) {
+            tuning->stream_min_bytes = bytes;
+            return bytes;
+        }
+    }
+    tuning->stream_min_bytes = defaults.stream_min_bytes;
+    return defaults.stream_min_bytes;
+}
+
+// Helper function to time nanoseconds to evaluate (A*B)+(C*D) over n x n operands under tuning
+static double TimeForkedExpression(const tuning_sf *tuning, unsigned int n) {
+    bst_sf *root = NULL;
+    for (unsigned int i = 0; i < 4; i++) {
+        matrix_sf *mat = RandomMatrix(n, n, i + 1);
+        mat->name = (char)('A' + i);
+        root = insert_bst_sf(mat, root);
+    }
+    set_tuning_sf(tuning);
+    char expr[] = "A*B+C*D";
+    double best = 0;
+    for (int run = 0; run < TIMING_RUNS; run++) {
+        unsigned long long start = NowNanoseconds();
+        free(evaluate_expr_sf('Z', expr, root));
+        double ns = (double)(NowNanoseconds() - start);
+        if (run == 0 || ns < best) {
+            best = ns;
+        }
+    }
+    free_bst_sf(root);
+    return best;
+}
+
+// Helper function to find the multiply-adds of the smallest of (A*B)+(C*D)'s products, doubling from first_n to
+// last_n, worth evaluating on a thread of its own, or 0 if none is
+static unsigned long long TuneFork(tuning_sf *tuning, unsigned int first_n, unsigned int last_n) {
+    for (unsigned int n = first_n; n <= last_n; n *= 2) {
+        unsigned long long madds = (unsigned long long)n * n * n;
+        tuning->fork_min_madds = 0;
+        double serial = TimeForkedExpression(tuning, n);
+        tuning->fork_min_madds = madds;
+        double forked = TimeForkedExpression(tuning, n);
+        printf("  %-28s %4ux%-4u serial %12.1f ns  forked   %12.1f ns\n", "A*B+C*D", n, n, serial, forked);
+        if (forked < serial * REQUIRED_GAIN) {
+            return madds;
+        }
+    }
+    tuning->fork_min_madds = 0;
+    return 0;
+}
+
+// Helper function to create every missing directory on the way to path, like mkdir -p of its dirname
+static int MakeParentDirs(const char *path) {
+    char dir[4096];
+    if (snprintf(dir, sizeof(dir), "%s", path) >= (int)sizeof(dir)) {
+        return 0;
+    }
+    for (char *slash = strchr(dir + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+            return 0;
+        }
+        *slash = '/';
+    }
+    return 1;
+}
+
+// Usage: autotune [--quick] [--output=PATH]
+// Times the kernels under candidate block sizes and dispatch thresholds on this machine and writes the fastest as the
+// tuning profile the library loads (by default tuning_path_sf(): $HW7_TUNE or ~/.config/hw7/tune). Blocks are tuned
+// with the parallel paths and streaming stores off, and the thresholds with the chosen blocks. --quick uses smaller
+// matrices.
+int main(int argc, char *argv[]) {
+    const char *output = NULL;
+    int quick = 0, bad_usage = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            quick = 1;
+        } else if (strncmp(argv[i], "--output=", 9) == 0) {
+            output = argv[i] + 9;
+        } else {
+            bad_usage = 1;
+        }
+    }
+    if (bad_usage) {
+        fprintf(stderr, "usage: %s [--quick] [--output=PATH]\n", argv[0]);
+        return 1;
+    }
+    if (output == NULL) {
+        output = tuning_path_sf();
+    }
+
+    tuning_sf tuning;
+    default_tuning_sf(&tuning);
+    tuning.parallel_mult_min_madds = tuning.parallel_add_min_values = tuning.parallel_transpose_min_values = 0;
+    tuning.fork_min_madds = tuning.stream_min_bytes = 0;
+
+    printf("unrolled kernels\n");
+    TuneSmallMaxDim(&tuning, &tuning.small_mult_max_dim, RunMult, "mult_mats_sf");
+    TuneSmallMaxDim(&tuning, &tuning.small_transpose_max_dim, RunTranspose, "transpose_mat_sf");
+
+    printf("block sizes\n");
+    static const unsigned int transpose_blocks[] = {0, 8, 16, 32, 64, 128};
+    static const unsigned int mult_blocks[] = {0, 64, 128, 256, 512};
+    TuneBlock(&tuning, &tuning.transpose_block, transpose_blocks, sizeof(transpose_blocks) / sizeof(unsigned int),
+               RunTranspose, quick ? 1024 : 2048, "transpose_mat_sf");
+    TuneBlock(&tuning, &tuning.mult_block_cols, mult_blocks, sizeof(mult_blocks) / sizeof(unsigned int), RunMult,
+               quick ? 384 : 768, "mult_mats_sf");
+
+    printf("streaming stores\n");
+    TuneStream(&tuning, 512, quick ? 2048 : 4096);
+
+    printf("parallel thresholds\n");
+    unsigned int last_values_n = quick ? 1024 : 2048, last_mult_n = quick ? 256 : 512;
+    TuneParallel(&tuning, &tuning.parallel_add_min_values, RunAdd, 128, last_values_n, 0, "add_mats_sf");
+    TuneParallel(&tuning, &tuning.parallel_transpose_min_values, RunTranspose, 128, last_values_n, 0,
+                  "transpose_mat_sf");
+    TuneParallel(&tuning, &tuning.parallel_mult_min_madds, RunMult, 32, last_mult_n, 1, "mult_mats_sf");
+    tuning.fork_min_madds = TuneFork(&tuning, 32, last_mult_n);
+
+    printf("\nmult_block_cols               %u\n", tuning.mult_block_cols);
+    printf("transpose_block               %u\n", tuning.transpose_block);
+    printf("small_mult_max_dim            %u\n", tuning.small_mult_max_dim);
+    printf("small_transpose_max_dim       %u\n", tuning.small_transpose_max_dim);
+    printf("parallel_mult_min_madds       %llu\n", tuning.parallel_mult_min_madds);
+    printf("parallel_add_min_values       %llu\n", tuning.parallel_add_min_values);
+    printf("parallel_transpose_min_values %llu\n", tuning.parallel_transpose_min_values);
+    printf("fork_min_madds                %llu\n", tuning.fork_min_madds);
+    printf("stream_min_bytes              %llu\n", tuning.stream_min_bytes);
+
+    if (!MakeParentDirs(output) || !save_tuning_sf(output, &tuning)) {
+        fprintf(stderr, "autotune: can't write %s\n", output);
+        return 1;
+    }
+    printf("\nwrote %s\n", output);
+    return 0;
+}
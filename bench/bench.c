@@ -0,0 +1,667 @@
+#include <malloc.h>
+#include <math.h>
+#include <time.h>
+
+#include "hw7.h"
+
+#define MAX_SAMPLES 15
+#define MAX_RESULTS 128
+#define BENCH_SCRIPT "bench_script.tmp"
+
+// One timed configuration of one kernel
+typedef struct {
+    const char *kernel;
+    char size[32];
+    unsigned long long iterations;
+    unsigned int samples;
+    double mean_ns;
+    double stddev_ns;
+    double min_ns;
+    double throughput;
+    const char *throughput_unit;
+} BenchResult;
+
+// Everything a benchmark body needs; set up before timing starts
+typedef struct {
+    unsigned int n;
+    matrix_sf *left;
+    matrix_sf *right;
+    char *text;
+    bst_sf *root;
+    size_t count;  // batched kernels: the same count matrices as batches and one by one
+    matrix_batch_sf *left_batch;
+    matrix_batch_sf *right_batch;
+    matrix_sf **lefts;
+    matrix_sf **rights;
+    session_sf *session;
+} BenchInput;
+
+typedef void (*BenchBody)(BenchInput *input);
+
+static BenchResult Results[MAX_RESULTS];
+static unsigned int ResultCount = 0;
+static double MinSampleNs = 20e6;
+static unsigned int SampleCount = 9;
+static const char *KernelFilter = NULL;
+
+// Helper function to read a monotonic clock in nanoseconds
+static unsigned long long NowNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+}
+
+// Helper function to allocate a rows x cols matrix of values in [-100, 100], the same for the same seed
+static matrix_sf* RandomMatrix(unsigned int rows, unsigned int cols, unsigned int seed) {
+    matrix_sf *mat = malloc(sizeof(matrix_sf) + (size_t)rows * cols * sizeof(int));
+    mat->name = '?';
+    mat->num_rows = rows;
+    mat->num_cols = cols;
+    for (size_t i = 0; i < (size_t)rows * cols; i++) {
+        seed = seed * 1103515245u + 12345u;
+        mat->values[i] = (int)(seed >> 16) % 201 - 100;
+    }
+    return mat;
+}
+
+// Helper function to write mat as a malloc'ed "rows cols [...]" literal
+static char* MatrixLiteral(const matrix_sf *mat) {
+    char *text = malloc((size_t)mat->num_rows * mat->num_cols * 6 + (size_t)mat->num_rows * 2 + 32);
+    char *cursor = text + sprintf(text, "%u %u [", mat->num_rows, mat->num_cols);
+    for (unsigned int row = 0; row < mat->num_rows; row++) {
+        for (unsigned int col = 0; col < mat->num_cols; col++) {
+            cursor += sprintf(cursor, "%d ", mat->values[row * mat->num_cols + col]);
+        }
+        cursor += sprintf(cursor, "; ");
+    }
+    sprintf(cursor, "]");
+    return text;
+}
+
+// Helper function to run body in batches until each sample takes at least MinSampleNs, then record the statistics
+static void RunBench(const char *kernel, const char *size, BenchBody body, BenchInput *input, double work_per_op,
+                     const char *throughput_unit) {
+    if (KernelFilter != NULL && strstr(kernel, KernelFilter) == NULL) {
+        return;
+    }
+    if (ResultCount == MAX_RESULTS) {
+        return;
+    }
+
+    // Calibrate: grow the batch until one batch is long enough to time reliably
+    unsigned long long iterations = 1;
+    for (;;) {
+        unsigned long long start = NowNanoseconds();
+        for (unsigned long long i = 0; i < iterations; i++) {
+            body(input);
+        }
+        double elapsed = (double)(NowNanoseconds() - start);
+        if (elapsed >= MinSampleNs || iterations >= (1ULL << 30)) {
+            break;
+        }
+        // Once the batch is measurable, jump straight to the projected size
+        if (elapsed > MinSampleNs / 100) {
+            iterations = (unsigned long long)((double)iterations * MinSampleNs / elapsed * 1.1) + 1;
+        } else {
+            iterations *= 10;
+        }
+    }
+
+    double per_op[MAX_SAMPLES];
+    for (unsigned int sample = 0; sample < SampleCount; sample++) {
+        unsigned long long start = NowNanoseconds();
+        for (unsigned long long i = 0; i < iterations; i++) {
+            body(input);
+        }
+        per_op[sample] = (double)(NowNanoseconds() - start) / (double)iterations;
+    }
+
+    BenchResult *result = &Results[ResultCount++];
+    result->kernel = kernel;
+    snprintf(result->size, sizeof(result->size), "%s", size);
+    result->iterations = iterations;
+    result->samples = SampleCount;
+    result->mean_ns = 0;
+    result->min_ns = per_op[0];
+    for (unsigned int sample = 0; sample < SampleCount; sample++) {
+        result->mean_ns += per_op[sample] / SampleCount;
+        if (per_op[sample] < result->min_ns) {
+            result->min_ns = per_op[sample];
+        }
+    }
+    double variance = 0;
+    for (unsigned int sample = 0; sample < SampleCount; sample++) {
+        variance += (per_op[sample] - result->mean_ns) * (per_op[sample] - result->mean_ns) / SampleCount;
+    }
+    result->stddev_ns = sqrt(variance);
+    result->throughput = work_per_op / (result->mean_ns * 1e-9);
+    result->throughput_unit = throughput_unit;
+
+    printf("%-18s %-12s %14.1f ns/op  +-%5.1f%%  %12.3g %s\n", kernel, size, result->mean_ns,
+           100.0 * result->stddev_ns / result->mean_ns, result->throughput, throughput_unit);
+    fflush(stdout);
+}
+
+// Helper function to time add_mats_sf on the input's operands
+static void BodyAdd(BenchInput *input) {
+    free(add_mats_sf(input->left, input->right));
+}
+
+// Helper function to time mult_mats_sf on the input's operands
+static void BodyMult(BenchInput *input) {
+    free(mult_mats_sf(input->left, input->right));
+}
+
+// Helper function to time transpose_mat_sf on the input's left operand
+static void BodyTranspose(BenchInput *input) {
+    free(transpose_mat_sf(input->left));
+}
+
+// Helper function to time add_into_sf into the input's left operand
+static void BodyAddInto(BenchInput *input) {
+    add_into_sf(input->left, input->right);
+}
+
+// Helper function to time transpose_in_place_sf on the input's left operand
+static void BodyTransposeInPlace(BenchInput *input) {
+    transpose_in_place_sf(input->left);
+}
+
+// Helper function to time create_matrix_sf on the input's literal
+static void BodyCreate(BenchInput *input) {
+    free(create_matrix_sf('A', input->text));
+}
+
+// Helper function to time infix2postfix_sf on the input's expression
+static void BodyInfix2Postfix(BenchInput *input) {
+    free(infix2postfix_sf(input->text));
+}
+
+// Helper function to time evaluate_expr_sf on the input's expression over its BST
+static void BodyEvaluate(BenchInput *input) {
+    free(evaluate_expr_sf('Z', input->text, input->root));
+}
+
+// Helper function to time evaluate_session_sf on the input's expression over its session
+static void BodyEvaluateSession(BenchInput *input) {
+    free(evaluate_session_sf(input->session, 'Z', input->text));
+}
+
+// Helper function to time execute_script_sf on BENCH_SCRIPT
+static void BodyExecute(BenchInput *input) {
+    (void)input;
+    free(execute_script_sf(BENCH_SCRIPT));
+}
+
+// Helper function to time mult_batch_sf on the input's batches
+static void BodyMultBatch(BenchInput *input) {
+    free(mult_batch_sf(input->left_batch, input->right_batch));
+}
+
+// Helper function to time transpose_batch_sf on the input's left batch
+static void BodyTransposeBatch(BenchInput *input) {
+    free(transpose_batch_sf(input->left_batch));
+}
+
+// Helper function to time the batch's products one mult_mats_sf call at a time
+static void BodyMultEach(BenchInput *input) {
+    for (size_t i = 0; i < input->count; i++) {
+        free(mult_mats_sf(input->lefts[i], input->rights[i]));
+    }
+}
+
+// Helper function to time the batch's transposes one transpose_mat_sf call at a time
+static void BodyTransposeEach(BenchInput *input) {
+    for (size_t i = 0; i < input->count; i++) {
+        free(transpose_mat_sf(input->lefts[i]));
+    }
+}
+
+// The general loops the library falls back to, kept here as the baseline for its small-shape kernels;
+// results go to a volatile sink so the compiler can't drop the work along with the free()
+static volatile int GenericSink;
+
+// Helper function to time the general i-k-j multiply on the input's n x n operands
+static void BodyMultGeneric(BenchInput *input) {
+    unsigned int n = input->n;
+    matrix_sf *product = calloc(1, sizeof(matrix_sf) + (size_t)n * n * sizeof(int));
+    for (unsigned int row = 0; row < n; row++) {
+        for (unsigned int k = 0; k < n; k++) {
+            for (unsigned int col = 0; col < n; col++) {
+                product->values[row * n + col] += input->left->values[row * n + k] * input->right->values[k * n + col];
+            }
+        }
+    }
+    GenericSink = product->values[n * n - 1];
+    free(product);
+}
+
+// Helper function to time the general transpose loop on the input's n x n left operand
+static void BodyTransposeGeneric(BenchInput *input) {
+    unsigned int n = input->n;
+    matrix_sf *transposed = malloc(sizeof(matrix_sf) + (size_t)n * n * sizeof(int));
+    for (unsigned int row = 0; row < n; row++) {
+        for (unsigned int col = 0; col < n; col++) {
+            transposed->values[col * n + row] = input->left->values[row * n + col];
+        }
+    }
+    GenericSink = transposed->values[n * n - 1];
+    free(transposed);
+}
+
+// Helper function to time the public kernels over square matrices
+static void BenchKernels(void) {
+    static const unsigned int add_sizes[] = {4, 16, 64, 256, 1024};
+    static const unsigned int mult_sizes[] = {4, 16, 64, 128, 256};
+    char size[32];
+    BenchInput input = {0};
+
+    for (size_t i = 0; i < sizeof(add_sizes) / sizeof(add_sizes[0]); i++) {
+        unsigned int n = add_sizes[i];
+        input.left = RandomMatrix(n, n, 1);
+        input.right = RandomMatrix(n, n, 2);
+        sprintf(size, "%ux%u", n, n);
+        RunBench("add_mats_sf", size, BodyAdd, &input, 3.0 * n * n * sizeof(int), "B/s");
+        RunBench("transpose_mat_sf", size, BodyTranspose, &input, 2.0 * n * n * sizeof(int), "B/s");
+        RunBench("add_into_sf", size, BodyAddInto, &input, 3.0 * n * n * sizeof(int), "B/s");
+        RunBench("transpose_in_place_sf", size, BodyTransposeInPlace, &input, 2.0 * n * n * sizeof(int), "B/s");
+        free(input.left);
+        free(input.right);
+    }
+
+    for (size_t i = 0; i < sizeof(mult_sizes) / sizeof(mult_sizes[0]); i++) {
+        unsigned int n = mult_sizes[i];
+        input.left = RandomMatrix(n, n, 3);
+        input.right = RandomMatrix(n, n, 4);
+        sprintf(size, "%ux%u", n, n);
+        RunBench("mult_mats_sf", size, BodyMult, &input, (double)n * n * n, "madd/s");
+        free(input.left);
+        free(input.right);
+    }
+}
+
+// Helper function to time the unrolled small-shape kernels against the general loops
+static void BenchSmallKernels(void) {
+    static const unsigned int sizes[] = {2, 3, 4, 8, 16};
+    char size[32];
+    BenchInput input = {0};
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        unsigned int n = sizes[i];
+        input.n = n;
+        input.left = RandomMatrix(n, n, 5);
+        input.right = RandomMatrix(n, n, 6);
+        sprintf(size, "%ux%u", n, n);
+        RunBench("mult_small", size, BodyMult, &input, (double)n * n * n, "madd/s");
+        RunBench("mult_generic", size, BodyMultGeneric, &input, (double)n * n * n, "madd/s");
+        RunBench("transpose_small", size, BodyTranspose, &input, 2.0 * n * n * sizeof(int), "B/s");
+        RunBench("transpose_generic", size, BodyTransposeGeneric, &input, 2.0 * n * n * sizeof(int), "B/s");
+        free(input.left);
+        free(input.right);
+    }
+}
+
+// Helper function to time a batch of small products in SoA layout against the same products one mult_mats_sf call
+// at a time
+static void BenchBatches(void) {
+    static const unsigned int sizes[] = {3, 4, 8};
+    static const size_t count = 4000;
+    char size[32];
+    BenchInput input = {0};
+    input.count = count;
+    input.lefts = malloc(count * sizeof(matrix_sf *));
+    input.rights = malloc(count * sizeof(matrix_sf *));
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        unsigned int n = sizes[i];
+        input.left_batch = create_batch_sf(n, n, count);
+        input.right_batch = create_batch_sf(n, n, count);
+        for (size_t index = 0; index < count; index++) {
+            input.lefts[index] = RandomMatrix(n, n, 14 + (unsigned int)index);
+            input.rights[index] = RandomMatrix(n, n, 15 + (unsigned int)index);
+            set_batch_matrix_sf(input.left_batch, index, input.lefts[index]);
+            set_batch_matrix_sf(input.right_batch, index, input.rights[index]);
+        }
+        sprintf(size, "%zux%ux%u", count, n, n);
+        RunBench("mult_batch", size, BodyMultBatch, &input, (double)count * n * n * n, "madd/s");
+        RunBench("mult_each", size, BodyMultEach, &input, (double)count * n * n * n, "madd/s");
+        RunBench("transpose_batch", size, BodyTransposeBatch, &input, 2.0 * count * n * n * sizeof(int), "B/s");
+        RunBench("transpose_each", size, BodyTransposeEach, &input, 2.0 * count * n * n * sizeof(int), "B/s");
+        for (size_t index = 0; index < count; index++) {
+            free(input.lefts[index]);
+            free(input.rights[index]);
+        }
+        free(input.left_batch);
+        free(input.right_batch);
+    }
+    free(input.lefts);
+    free(input.rights);
+}
+
+// Helper function to time the evaluator's structure-aware paths against the same products of general matrices:
+// A * A' against A * B with B holding A' (so the general kernel runs), and an upper-triangular U * A against B * A
+static void BenchStructured(void) {
+    static const unsigned int sizes[] = {64, 128, 256};
+    char size[32];
+    BenchInput input = {0};
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        unsigned int n = sizes[i];
+        matrix_sf *A = RandomMatrix(n, n, 7);
+        matrix_sf *B = transpose_mat_sf(A);
+        matrix_sf *U = RandomMatrix(n, n, 8);
+        for (unsigned int row = 1; row < n; row++) {
+            memset(U->values + (size_t)row * n, 0, row * sizeof(int));
+        }
+        A->name = 'A';
+        B->name = 'B';
+        U->name = 'U';
+        input.root = insert_bst_sf(U, insert_bst_sf(B, insert_bst_sf(A, NULL)));
+        sprintf(size, "%ux%u", n, n);
+
+        input.text = "A * A'";
+        RunBench("eval_syrk", size, BodyEvaluate, &input, (double)n * n * n, "madd/s");
+        input.text = "A * B";
+        RunBench("eval_mult_general", size, BodyEvaluate, &input, (double)n * n * n, "madd/s");
+        input.text = "U * A";
+        RunBench("eval_mult_triangular", size, BodyEvaluate, &input, (double)n * n * n, "madd/s");
+        input.text = "B * A";
+        RunBench("eval_mult_general", size, BodyEvaluate, &input, (double)n * n * n, "madd/s");
+        free_bst_sf(input.root);
+        input.root = NULL;
+        input.text = NULL;
+    }
+}
+
+// Helper function to time A^16 by repeated squaring against the same power written out as 15 multiplies
+static void BenchPower(void) {
+    static const unsigned int sizes[] = {16, 64, 128};
+    char size[32];
+    BenchInput input = {0};
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        unsigned int n = sizes[i];
+        matrix_sf *A = RandomMatrix(n, n, 9);
+        A->name = 'A';
+        input.root = insert_bst_sf(A, NULL);
+        sprintf(size, "%ux%u", n, n);
+        input.text = "A^16";
+        RunBench("eval_power", size, BodyEvaluate, &input, 4.0 * n * n * n, "madd/s");
+        input.text = "A*A*A*A*A*A*A*A*A*A*A*A*A*A*A*A";
+        RunBench("eval_mult_chain", size, BodyEvaluate, &input, 15.0 * n * n * n, "madd/s");
+        free_bst_sf(input.root);
+        input.root = NULL;
+        input.text = NULL;
+    }
+}
+
+// Helper function to time fused reductions against building the sum or product they reduce
+static void BenchReductions(void) {
+    static const unsigned int sizes[] = {64, 256, 1024};
+    char size[32];
+    BenchInput input = {0};
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        unsigned int n = sizes[i];
+        matrix_sf *A = RandomMatrix(n, n, 10);
+        matrix_sf *B = RandomMatrix(n, n, 11);
+        A->name = 'A';
+        B->name = 'B';
+        input.root = insert_bst_sf(B, insert_bst_sf(A, NULL));
+        sprintf(size, "%ux%u", n, n);
+        input.text = "sum(A + B)";
+        RunBench("eval_sum_fused", size, BodyEvaluate, &input, 2.0 * n * n * sizeof(int), "B/s");
+        input.text = "A + B";
+        RunBench("eval_add", size, BodyEvaluate, &input, 2.0 * n * n * sizeof(int), "B/s");
+        if (n <= 256) {
+            input.text = "trace(A * B)";
+            RunBench("eval_trace_fused", size, BodyEvaluate, &input, (double)n * n, "madd/s");
+            input.text = "A * B";
+            RunBench("eval_mult", size, BodyEvaluate, &input, (double)n * n * n, "madd/s");
+        }
+        free_bst_sf(input.root);
+        input.root = NULL;
+        input.text = NULL;
+    }
+}
+
+// Helper function to time an expression whose operand subtrees are independent; run with HW7_THREADS=1 for the
+// one-thread baseline
+static void BenchSubtrees(void) {
+    static const unsigned int sizes[] = {64, 128, 256};
+    static const char names[] = "GEXRQL";
+    char size[32];
+    BenchInput input = {0};
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        unsigned int n = sizes[i];
+        for (unsigned int name = 0; name < sizeof(names) - 1; name++) {
+            matrix_sf *mat = RandomMatrix(n, n, 16 + name);
+            mat->name = names[name];
+            input.root = insert_bst_sf(mat, input.root);
+        }
+        sprintf(size, "%ux%u", n, n);
+        input.text = "(G+E*X)*(R+Q*L)*(L+X*R)";
+        RunBench("eval_subtrees", size, BodyEvaluate, &input, 5.0 * n * n * n, "madd/s");
+        free_bst_sf(input.root);
+        input.root = NULL;
+        input.text = NULL;
+    }
+}
+
+// Helper function to time the same small expression against a BST and against a session, whose readers count
+// themselves in and out of an epoch on every call
+static void BenchSessions(void) {
+    static const unsigned int sizes[] = {4, 16, 64};
+    static const char names[] = "ABC";
+    char size[32];
+    BenchInput input = {0};
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        unsigned int n = sizes[i];
+        input.session = create_session_sf();
+        for (unsigned int name = 0; name < sizeof(names) - 1; name++) {
+            matrix_sf *mat = RandomMatrix(n, n, 24 + name);
+            mat->name = names[name];
+            input.root = insert_bst_sf(mat, input.root);
+            set_session_matrix_sf(input.session, names[name], RandomMatrix(n, n, 24 + name));
+        }
+        sprintf(size, "%ux%u", n, n);
+        input.text = "A * B + C";
+        RunBench("eval_bst", size, BodyEvaluate, &input, (double)n * n * (n + 1), "madd/s");
+        RunBench("eval_session", size, BodyEvaluateSession, &input, (double)n * n * (n + 1), "madd/s");
+        free_bst_sf(input.root);
+        free_session_sf(input.session);
+        input.root = NULL;
+        input.session = NULL;
+        input.text = NULL;
+    }
+}
+
+// Helper function to time adding the top halves of two matrices in place, against copying out one half, which is
+// what slicing would otherwise cost per operand
+static void BenchSlices(void) {
+    static const unsigned int sizes[] = {64, 256, 1024};
+    char size[32], text[64];
+    BenchInput input = {0};
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        unsigned int n = sizes[i];
+        matrix_sf *A = RandomMatrix(n, n, 12);
+        matrix_sf *B = RandomMatrix(n, n, 13);
+        A->name = 'A';
+        B->name = 'B';
+        input.root = insert_bst_sf(B, insert_bst_sf(A, NULL));
+        input.text = text;
+        sprintf(size, "%ux%u", n / 2, n);
+        sprintf(text, "A[:%u, :] + B[:%u, :]", n / 2, n / 2);
+        RunBench("eval_slice_add", size, BodyEvaluate, &input, 2.0 * n / 2 * n * sizeof(int), "B/s");
+        sprintf(text, "A[:%u, :]", n / 2);
+        RunBench("eval_slice_copy", size, BodyEvaluate, &input, 1.0 * n / 2 * n * sizeof(int), "B/s");
+        free_bst_sf(input.root);
+        input.root = NULL;
+        input.text = NULL;
+    }
+}
+
+// Helper function to time parsing matrix literals and converting expressions to postfix
+static void BenchParsing(void) {
+    static const unsigned int literal_sizes[] = {4, 64, 256, 1024};
+    static const unsigned int expression_lengths[] = {8, 64, 512};
+    char size[32];
+    BenchInput input = {0};
+
+    for (size_t i = 0; i < sizeof(literal_sizes) / sizeof(literal_sizes[0]); i++) {
+        unsigned int n = literal_sizes[i];
+        matrix_sf *mat = RandomMatrix(n, n, 5);
+        input.text = MatrixLiteral(mat);
+        sprintf(size, "%ux%u", n, n);
+        RunBench("create_matrix_sf", size, BodyCreate, &input, (double)strlen(input.text), "B/s");
+        free(input.text);
+        free(mat);
+    }
+
+    for (size_t i = 0; i < sizeof(expression_lengths) / sizeof(expression_lengths[0]); i++) {
+        unsigned int length = expression_lengths[i];
+        input.text = malloc(length + 8);
+        // (A+B)'*C+... repeated until the expression is length characters long
+        static const char pattern[] = "(A+B)'*C+";
+        for (unsigned int pos = 0; pos < length; pos++) {
+            input.text[pos] = pattern[pos % (sizeof(pattern) - 1)];
+        }
+        input.text[length] = 'D';
+        input.text[length + 1] = '\0';
+        sprintf(size, "%u chars", length);
+        RunBench("infix2postfix_sf", size, BodyInfix2Postfix, &input, (double)length, "B/s");
+        free(input.text);
+    }
+}
+
+// Helper function to time evaluating an expression over a BST and executing a whole script
+static void BenchScripts(void) {
+    static const unsigned int sizes[] = {4, 16, 64};
+    char size[32];
+    BenchInput input = {0};
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        unsigned int n = sizes[i];
+        sprintf(size, "%ux%u", n, n);
+
+        // evaluate_expr_sf: 4 matrix operations over a BST of 26 n x n matrices
+        input.root = NULL;
+        for (char name = 'A'; name <= 'Z'; name++) {
+            matrix_sf *mat = RandomMatrix(n, n, (unsigned int)name);
+            mat->name = name;
+            input.root = insert_bst_sf(mat, input.root);
+        }
+        input.text = "(M + Q') * (X + K)";
+        RunBench("evaluate_expr_sf", size, BodyEvaluate, &input, 4.0, "op/s");
+        free_bst_sf(input.root);
+
+        // execute_script_sf: 8 literals and 16 expressions
+        FILE *script = fopen(BENCH_SCRIPT, "w");
+        for (char name = 'A'; name <= 'H'; name++) {
+            matrix_sf *mat = RandomMatrix(n, n, (unsigned int)name);
+            char *literal = MatrixLiteral(mat);
+            fprintf(script, "%c = %s\n", name, literal);
+            free(literal);
+            free(mat);
+        }
+        for (char name = 'I'; name <= 'X'; name++) {
+            fprintf(script, "%c = (%c + %c) * %c'\n", name, name - 8, name - 7, name - 1);
+        }
+        fclose(script);
+        RunBench("execute_script_sf", size, BodyExecute, &input, 24.0, "stmt/s");
+        remove(BENCH_SCRIPT);
+    }
+}
+
+// Helper function to time results past the cache written with ordinary stores against streaming stores, whichever
+// the tuning profile would pick; the effective bandwidth counts both operands read and the result written once
+static void BenchStreaming(void) {
+    static const unsigned int sizes[] = {1024, 2048, 4096};
+    char size[32];
+    BenchInput input = {0};
+    tuning_sf original, tuning;
+    get_tuning_sf(&original);
+    tuning = original;
+    // Results this big would otherwise come from fresh mmap()ed pages on every call, and the page faults would swamp
+    // the stores being measured
+    mallopt(M_MMAP_THRESHOLD, 1 << 30);
+    mallopt(M_TRIM_THRESHOLD, 1 << 30);
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        unsigned int n = sizes[i];
+        input.left = RandomMatrix(n, n, 28);
+        input.right = RandomMatrix(n, n, 29);
+        sprintf(size, "%ux%u", n, n);
+        tuning.stream_min_bytes = 0;
+        set_tuning_sf(&tuning);
+        RunBench("add_cached", size, BodyAdd, &input, 3.0 * n * n * sizeof(int), "B/s");
+        RunBench("transpose_cached", size, BodyTranspose, &input, 2.0 * n * n * sizeof(int), "B/s");
+        tuning.stream_min_bytes = 1;
+        set_tuning_sf(&tuning);
+        RunBench("add_streamed", size, BodyAdd, &input, 3.0 * n * n * sizeof(int), "B/s");
+        RunBench("transpose_streamed", size, BodyTranspose, &input, 2.0 * n * n * sizeof(int), "B/s");
+        free(input.left);
+        free(input.right);
+    }
+    set_tuning_sf(&original);
+}
+
+// Helper function to write every recorded result to filename as JSON
+static void WriteJson(const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        fprintf(stderr, "bench: can't write %s\n", filename);
+        return;
+    }
+    fprintf(file, "{\n  \"id\": \"hw7 bench\",\n  \"min_sample_ns\": %.0f,\n  \"results\": [\n", MinSampleNs);
+    for (unsigned int i = 0; i < ResultCount; i++) {
+        BenchResult *result = &Results[i];
+        fprintf(file, "    {\"kernel\": \"%s\", \"size\": \"%s\", \"iterations\": %llu, \"samples\": %u, "
+                "\"ns_per_op\": %.2f, \"stddev_ns\": %.2f, \"min_ns\": %.2f, \"throughput\": %.6g, "
+                "\"throughput_unit\": \"%s\"}%s\n",
+                result->kernel, result->size, result->iterations, result->samples, result->mean_ns,
+                result->stddev_ns, result->min_ns, result->throughput, result->throughput_unit,
+                i + 1 < ResultCount ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+}
+
+// Usage: bench [--json=FILE] [--quick] [--filter=KERNEL]
+int main(int argc, char *argv[]) {
+    const char *json_file = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--json=", 7) == 0) {
+            json_file = argv[i] + 7;
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            MinSampleNs = 2e6;
+            SampleCount = 3;
+        } else if (strncmp(argv[i], "--filter=", 9) == 0) {
+            KernelFilter = argv[i] + 9;
+        } else {
+            fprintf(stderr, "usage: %s [--json=FILE] [--quick] [--filter=KERNEL]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    BenchKernels();
+    BenchSmallKernels();
+    BenchBatches();
+    BenchStructured();
+    BenchPower();
+    BenchReductions();
+    BenchSlices();
+    BenchSubtrees();
+    BenchSessions();
+    BenchParsing();
+    BenchScripts();
+    BenchStreaming();
+
+    if (json_file != NULL) {
+        WriteJson(json_file);
+    }
+    return 0;
+}
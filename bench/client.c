@@ -0,0 +1,60 @@
+#include "hw7.h"
+
+// Helper function to read all of file into a malloc'ed, NUL-terminated string
+static char* ReadAll(FILE *file) {
+    size_t used = 0, capacity = 4096;
+    char *text = malloc(capacity);
+    size_t got;
+    while (text != NULL && (got = fread(text + used, 1, capacity - used - 1, file)) > 0) {
+        used += got;
+        if (capacity - used == 1) {
+            capacity *= 2;
+            char *grown = realloc(text, capacity);
+            if (grown == NULL) {
+                free(text);
+            }
+            text = grown;
+        }
+    }
+    if (text != NULL) {
+        text[used] = '\0';
+    }
+    return text;
+}
+
+// Usage: client SOCKET [SCRIPT...]
+// Sends each SCRIPT (standard input if there are none) to the daemon on SOCKET as one request of a single session,
+// so later scripts can use the matrices earlier ones defined, and prints the answer lines as they arrive.
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s SOCKET [SCRIPT...]\n", argv[0]);
+        return 1;
+    }
+    int session = connect_server_sf(argv[1]);
+    if (session < 0) {
+        fprintf(stderr, "client: can't connect to %s\n", argv[1]);
+        return 1;
+    }
+
+    int status = 0;
+    for (int i = 2; i < argc || (i == 2 && argc == 2); i++) {
+        FILE *file = i < argc ? fopen(argv[i], "r") : stdin;
+        if (file == NULL) {
+            fprintf(stderr, "client: can't open %s\n", argv[i]);
+            status = 1;
+            continue;
+        }
+        char *script = ReadAll(file);
+        if (file != stdin) {
+            fclose(file);
+        }
+        matrix_sf *result = script != NULL ? run_remote_script_sf(session, script, stdout) : NULL;
+        if (result == NULL) {
+            status = 1;
+        }
+        free(result);
+        free(script);
+    }
+    close(session);
+    return status;
+}
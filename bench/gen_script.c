@@ -0,0 +1,240 @@
+#include "hw7.h"
+
+#define MAX_DIMS 4
+#define MAX_NAMES 26
+
+// Everything that shapes the generated script
+typedef struct {
+    unsigned long long seed;
+    unsigned long statements;
+    unsigned int dims[MAX_DIMS];
+    unsigned int dim_count;
+    double density;
+    int max_value;
+    unsigned int depth;
+    unsigned int add_weight;
+    unsigned int mult_weight;
+    unsigned int transpose_weight;
+    double literal_ratio;
+} GenConfig;
+
+// A script name and the shape it always has. Names keep one shape for the whole script,
+// so redefinitions can never make a later expression ill-formed.
+typedef struct {
+    char name;
+    unsigned int num_rows;
+    unsigned int num_cols;
+    int defined;
+} GenName;
+
+static GenConfig Config = {
+    .seed = 1,
+    .statements = 1000,
+    .dims = {16, 32},
+    .dim_count = 2,
+    .density = 1.0,
+    .max_value = 100,
+    .depth = 3,
+    .add_weight = 2,
+    .mult_weight = 2,
+    .transpose_weight = 1,
+    .literal_ratio = 0.2,
+};
+static GenName Names[MAX_NAMES];
+static unsigned int LiteralNames = 0;
+static unsigned long long RngState;
+
+// Helper function to draw the next 64 random bits; splitmix64 is small, fast and the same on every platform, so a
+// seed always gives the same script
+static unsigned long long NextRandom(void) {
+    unsigned long long z = (RngState += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Helper function to draw a random integer in [0, bound)
+static unsigned int RandomBelow(unsigned int bound) {
+    return (unsigned int)(NextRandom() % bound);
+}
+
+// Helper function to draw a random double in [0, 1)
+static double RandomUnit(void) {
+    return (double)(NextRandom() >> 11) / 9007199254740992.0;
+}
+
+// Helper function to pick one of the configured dimensions
+static unsigned int RandomDim(void) {
+    return Config.dims[RandomBelow(Config.dim_count)];
+}
+
+// Helper function to write a literal of target's shape, with Config.density of its values nonzero
+static void EmitLiteral(FILE *out, const GenName *target) {
+    fprintf(out, "%c = %u %u [", target->name, target->num_rows, target->num_cols);
+    for (unsigned int row = 0; row < target->num_rows; row++) {
+        for (unsigned int col = 0; col < target->num_cols; col++) {
+            int value = 0;
+            if (RandomUnit() < Config.density) {
+                value = (int)RandomBelow(2 * (unsigned int)Config.max_value + 1) - Config.max_value;
+            }
+            fprintf(out, "%d ", value);
+        }
+        fprintf(out, "; ");
+    }
+    fprintf(out, "]\n");
+}
+
+// Helper function to pick a defined name of shape rows x cols, or cols x rows to be transposed
+static void EmitLeaf(FILE *out, unsigned int rows, unsigned int cols) {
+    unsigned int matches[MAX_NAMES];
+    unsigned int match_count = 0;
+    for (unsigned int i = 0; i < MAX_NAMES; i++) {
+        if (!Names[i].defined) {
+            continue;
+        }
+        if ((Names[i].num_rows == rows && Names[i].num_cols == cols) ||
+            (Names[i].num_rows == cols && Names[i].num_cols == rows)) {
+            matches[match_count++] = i;
+        }
+    }
+    // The literals cover every shape, so there is always a match
+    const GenName *leaf = &Names[matches[RandomBelow(match_count)]];
+    fprintf(out, "%c%s", leaf->name, leaf->num_rows == rows && leaf->num_cols == cols ? "" : "'");
+}
+
+// Helper function to emit an expression of shape rows x cols whose operator tree is depth levels deep
+static void EmitExpression(FILE *out, unsigned int rows, unsigned int cols, unsigned int depth) {
+    if (depth == 0) {
+        EmitLeaf(out, rows, cols);
+        return;
+    }
+
+    unsigned int pick = RandomBelow(Config.add_weight + Config.mult_weight + Config.transpose_weight);
+    if (pick < Config.add_weight) {
+        fprintf(out, "(");
+        EmitExpression(out, rows, cols, depth - 1);
+        fprintf(out, " + ");
+        EmitExpression(out, rows, cols, depth - 1);
+        fprintf(out, ")");
+    } else if (pick < Config.add_weight + Config.mult_weight) {
+        unsigned int inner = RandomDim();
+        fprintf(out, "(");
+        EmitExpression(out, rows, inner, depth - 1);
+        fprintf(out, " * ");
+        EmitExpression(out, inner, cols, depth - 1);
+        fprintf(out, ")");
+    } else {
+        fprintf(out, "(");
+        EmitExpression(out, cols, rows, depth - 1);
+        fprintf(out, ")'");
+    }
+}
+
+// Helper function to write the whole script to out
+static void Generate(FILE *out) {
+    // One literal per shape first, so every shape has a leaf to draw from
+    for (unsigned int r = 0; r < Config.dim_count; r++) {
+        for (unsigned int c = 0; c < Config.dim_count; c++) {
+            GenName *target = &Names[LiteralNames++];
+            target->num_rows = Config.dims[r];
+            target->num_cols = Config.dims[c];
+            target->defined = 1;
+            EmitLiteral(out, target);
+        }
+    }
+
+    // The remaining names hold expression results; give each a fixed random shape
+    for (unsigned int i = LiteralNames; i < MAX_NAMES; i++) {
+        Names[i].num_rows = RandomDim();
+        Names[i].num_cols = RandomDim();
+    }
+
+    for (unsigned long statement = LiteralNames; statement < Config.statements; statement++) {
+        if (RandomUnit() < Config.literal_ratio) {
+            EmitLiteral(out, &Names[RandomBelow(LiteralNames)]);
+            continue;
+        }
+        GenName *target = &Names[LiteralNames + RandomBelow(MAX_NAMES - LiteralNames)];
+        fprintf(out, "%c = ", target->name);
+        EmitExpression(out, target->num_rows, target->num_cols, Config.depth);
+        fprintf(out, "\n");
+        target->defined = 1;
+    }
+}
+
+// Helper function to parse a --sizes list into Config.dims, returning 0 if it is malformed
+static int ParseDims(const char *text) {
+    Config.dim_count = 0;
+    while (*text != '\0') {
+        char *end;
+        unsigned long dim = strtoul(text, &end, 10);
+        if (end == text || dim == 0 || Config.dim_count == MAX_DIMS) {
+            return 0;
+        }
+        Config.dims[Config.dim_count++] = (unsigned int)dim;
+        text = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            return 0;
+        }
+    }
+    return Config.dim_count > 0;
+}
+
+// Helper function to parse a --mix triple into the operator weights, returning 0 if it is malformed
+static int ParseMix(const char *text) {
+    return sscanf(text, "%u,%u,%u", &Config.add_weight, &Config.mult_weight, &Config.transpose_weight) == 3 &&
+           Config.add_weight + Config.mult_weight + Config.transpose_weight > 0;
+}
+
+// Usage: gen_script [--seed=N] [--statements=N] [--sizes=D,D,...] [--density=F] [--max-value=N]
+//                   [--depth=N] [--mix=ADD,MULT,TRANSPOSE] [--literal-ratio=F] [--output=FILE]
+int main(int argc, char *argv[]) {
+    const char *output = NULL;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        int ok = 1;
+        if (strncmp(arg, "--seed=", 7) == 0) {
+            Config.seed = strtoull(arg + 7, NULL, 10);
+        } else if (strncmp(arg, "--statements=", 13) == 0) {
+            Config.statements = strtoul(arg + 13, NULL, 10);
+        } else if (strncmp(arg, "--sizes=", 8) == 0) {
+            ok = ParseDims(arg + 8);
+        } else if (strncmp(arg, "--density=", 10) == 0) {
+            Config.density = atof(arg + 10);
+        } else if (strncmp(arg, "--max-value=", 12) == 0) {
+            Config.max_value = atoi(arg + 12);
+        } else if (strncmp(arg, "--depth=", 8) == 0) {
+            Config.depth = (unsigned int)atoi(arg + 8);
+        } else if (strncmp(arg, "--mix=", 6) == 0) {
+            ok = ParseMix(arg + 6);
+        } else if (strncmp(arg, "--literal-ratio=", 16) == 0) {
+            Config.literal_ratio = atof(arg + 16);
+        } else if (strncmp(arg, "--output=", 9) == 0) {
+            output = arg + 9;
+        } else {
+            ok = 0;
+        }
+        if (!ok || Config.max_value < 0) {
+            fprintf(stderr, "usage: %s [--seed=N] [--statements=N] [--sizes=D,D,...] [--density=F] [--max-value=N]\n"
+                    "       [--depth=N] [--mix=ADD,MULT,TRANSPOSE] [--literal-ratio=F] [--output=FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    FILE *out = output != NULL ? fopen(output, "w") : stdout;
+    if (out == NULL) {
+        fprintf(stderr, "gen_script: can't write %s\n", output);
+        return 1;
+    }
+
+    RngState = Config.seed;
+    for (unsigned int i = 0; i < MAX_NAMES; i++) {
+        Names[i].name = (char)('A' + i);
+    }
+    Generate(out);
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}
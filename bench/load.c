@@ -0,0 +1,122 @@
+#include <sys/resource.h>
+#include <time.h>
+
+#include "hw7.h"
+
+// Helper function to read a monotonic clock in nanoseconds
+static unsigned long long NowNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+}
+
+// Helper function to count the non-blank lines of the script, for the throughput of cached runs
+static unsigned long long CountStatements(const char *script) {
+    FILE *file = fopen(script, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    unsigned long long statements = 0;
+    int blank = 1, c;
+    while ((c = fgetc(file)) != EOF) {
+        if (c == '\n') {
+            statements += !blank;
+            blank = 1;
+        } else if (c != ' ') {
+            blank = 0;
+        }
+    }
+    statements += !blank;
+    fclose(file);
+    return statements;
+}
+
+// Usage: load SCRIPT [--repeat=N] [--cache=BYTES [--cache-dir=DIR]]
+// Runs SCRIPT through execute_script_stats_sf and reports throughput, peak RSS and where the time went.
+// With --cache the runs go through execute_script_cached_sf instead and the cache counters are reported.
+int main(int argc, char *argv[]) {
+    char *script = NULL;
+    unsigned long repeat = 1;
+    size_t cache_bytes = 0;
+    const char *cache_dir = NULL;
+    int bad_usage = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--repeat=", 9) == 0) {
+            repeat = strtoul(argv[i] + 9, NULL, 10);
+        } else if (strncmp(argv[i], "--cache=", 8) == 0) {
+            cache_bytes = strtoull(argv[i] + 8, NULL, 10);
+        } else if (strncmp(argv[i], "--cache-dir=", 12) == 0) {
+            cache_dir = argv[i] + 12;
+        } else if (script == NULL && argv[i][0] != '-') {
+            script = argv[i];
+        } else {
+            bad_usage = 1;
+        }
+    }
+    if (bad_usage || script == NULL || repeat == 0) {
+        fprintf(stderr, "usage: %s SCRIPT [--repeat=N] [--cache=BYTES [--cache-dir=DIR]]\n", argv[0]);
+        return 1;
+    }
+
+    cache_sf *cache = NULL;
+    if (cache_bytes > 0 || cache_dir != NULL) {
+        cache = create_cache_sf(cache_bytes, cache_dir);
+        if (cache == NULL) {
+            fprintf(stderr, "load: can't create the cache\n");
+            return 1;
+        }
+    }
+
+    unsigned long long script_statements = cache != NULL ? CountStatements(script) : 0;
+    script_stats_sf total = {0};
+    for (unsigned long run = 0; run < repeat; run++) {
+        script_stats_sf stats = {0};
+        matrix_sf *result;
+        if (cache != NULL) {
+            // The cached path has no phase split, only the total
+            unsigned long long start = NowNanoseconds();
+            result = execute_script_cached_sf(script, cache);
+            stats.elapsed_ns = NowNanoseconds() - start;
+            stats.statements = script_statements;
+        } else {
+            result = execute_script_stats_sf(script, &stats);
+        }
+        if (result == NULL) {
+            fprintf(stderr, "load: %s produced no matrix\n", script);
+            return 1;
+        }
+        free(result);
+        total.statements += stats.statements;
+        total.parse_ns += stats.parse_ns;
+        total.evaluate_ns += stats.evaluate_ns;
+        total.free_ns += stats.free_ns;
+        total.elapsed_ns += stats.elapsed_ns;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double elapsed = (double)total.elapsed_ns;
+
+    printf("script       %s (x%lu)\n", script, repeat);
+    printf("statements   %llu\n", total.statements);
+    printf("elapsed      %.3f ms\n", elapsed / 1e6);
+    printf("throughput   %.0f statements/s\n", (double)total.statements / (elapsed * 1e-9));
+    printf("parse        %10.3f ms  %5.1f%%\n", (double)total.parse_ns / 1e6, 100.0 * (double)total.parse_ns / elapsed);
+    printf("evaluate     %10.3f ms  %5.1f%%\n", (double)total.evaluate_ns / 1e6,
+           100.0 * (double)total.evaluate_ns / elapsed);
+    printf("free         %10.3f ms  %5.1f%%\n", (double)total.free_ns / 1e6, 100.0 * (double)total.free_ns / elapsed);
+    printf("peak RSS     %ld KiB\n", usage.ru_maxrss);
+
+    if (cache != NULL) {
+        cache_stats_sf cache_stats;
+        get_cache_stats_sf(cache, &cache_stats);
+        unsigned long long lookups = cache_stats.hits + cache_stats.misses;
+        printf("cache        %llu hits (%llu from disk), %llu misses, %.1f%% hit rate\n", cache_stats.hits,
+               cache_stats.disk_hits, cache_stats.misses,
+               lookups > 0 ? 100.0 * (double)cache_stats.hits / (double)lookups : 0.0);
+        printf("cache size   %llu entries, %llu bytes, %llu evictions\n", cache_stats.entries, cache_stats.bytes,
+               cache_stats.evictions);
+        free_cache_sf(cache);
+    }
+    return 0;
+}
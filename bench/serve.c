@@ -0,0 +1,44 @@
+#include <pthread.h>
+#include <signal.h>
+
+#include "hw7.h"
+
+// Usage: serve SOCKET [--workers=N]
+// Runs the script daemon on the Unix domain socket SOCKET until SIGINT or SIGTERM. Without --workers there is one
+// worker per core.
+int main(int argc, char *argv[]) {
+    const char *socket_path = NULL;
+    unsigned int workers = 0;
+    int bad_usage = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--workers=", 10) == 0) {
+            workers = (unsigned int)strtoul(argv[i] + 10, NULL, 10);
+        } else if (socket_path == NULL && argv[i][0] != '-') {
+            socket_path = argv[i];
+        } else {
+            bad_usage = 1;
+        }
+    }
+    if (bad_usage || socket_path == NULL) {
+        fprintf(stderr, "usage: %s SOCKET [--workers=N]\n", argv[0]);
+        return 1;
+    }
+
+    // Block the stop signals before any thread starts, so they all inherit the mask and only sigwait sees them
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+
+    server_sf *server = start_server_sf(socket_path, workers);
+    if (server == NULL) {
+        fprintf(stderr, "serve: can't listen on %s\n", socket_path);
+        return 1;
+    }
+    fprintf(stderr, "serve: listening on %s\n", socket_path);
+    int signal_number;
+    sigwait(&stop_signals, &signal_number);
+    stop_server_sf(server);
+    return 0;
+}
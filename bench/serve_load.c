@@ -0,0 +1,177 @@
+#include <pthread.h>
+#include <time.h>
+
+#include "hw7.h"
+
+#define MAX_CLIENTS 256
+
+// One client thread: its own session (or one per request with --fresh) and the latency of each of its requests
+typedef struct {
+    const char *socket_path;
+    const char *script;
+    unsigned long requests;
+    int fresh;
+    unsigned long long *latencies_ns;
+    unsigned long failures;
+} LoadClient;
+
+// Helper function to read a monotonic clock in nanoseconds
+static unsigned long long NowNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+}
+
+// Helper function to read all of the file at path into a malloc'ed, NUL-terminated string
+static char* ReadScript(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    rewind(file);
+    char *text = length >= 0 ? malloc((size_t)length + 1) : NULL;
+    if (text != NULL) {
+        size_t got = fread(text, 1, (size_t)length, file);
+        text[got] = '\0';
+    }
+    fclose(file);
+    return text;
+}
+
+// Helper function to count the non-blank lines of the script: the daemon answers each with one line
+static unsigned long long CountStatements(const char *script) {
+    unsigned long long statements = 0;
+    int blank = 1;
+    for (const char *c = script; *c != '\0'; c++) {
+        if (*c == '\n') {
+            statements += !blank;
+            blank = 1;
+        } else if (*c != ' ') {
+            blank = 0;
+        }
+    }
+    return statements + !blank;
+}
+
+// Helper function to send one client's requests, timing each
+static void* RunClient(void *arg) {
+    LoadClient *client = arg;
+    int session = client->fresh ? -1 : connect_server_sf(client->socket_path);
+    for (unsigned long request = 0; request < client->requests; request++) {
+        unsigned long long start = NowNanoseconds();
+        if (client->fresh) {
+            session = connect_server_sf(client->socket_path);
+        }
+        matrix_sf *result = run_remote_script_sf(session, client->script, NULL);
+        if (client->fresh) {
+            close(session);
+            session = -1;
+        }
+        client->latencies_ns[request] = NowNanoseconds() - start;
+        client->failures += result == NULL;
+        free(result);
+    }
+    if (session >= 0) {
+        close(session);
+    }
+    return NULL;
+}
+
+// Helper function to order latencies for qsort
+static int CompareLatencies(const void *a, const void *b) {
+    unsigned long long left = *(const unsigned long long *)a, right = *(const unsigned long long *)b;
+    return (left > right) - (left < right);
+}
+
+// Usage: serve_load SCRIPT [--socket=PATH] [--clients=N] [--requests=N] [--workers=N] [--fresh]
+// Each of N clients opens a session and sends SCRIPT to the daemon as a request, --requests times in a row, then the
+// latency percentiles and the throughput over all requests are reported. With --fresh every request opens its own
+// session. Without --socket a daemon with --workers workers is started in this process on a temporary socket.
+int main(int argc, char *argv[]) {
+    const char *script_path = NULL, *socket_path = NULL;
+    unsigned long clients = 4, requests = 100;
+    unsigned int workers = 0;
+    int fresh = 0, bad_usage = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--socket=", 9) == 0) {
+            socket_path = argv[i] + 9;
+        } else if (strncmp(argv[i], "--clients=", 10) == 0) {
+            clients = strtoul(argv[i] + 10, NULL, 10);
+        } else if (strncmp(argv[i], "--requests=", 11) == 0) {
+            requests = strtoul(argv[i] + 11, NULL, 10);
+        } else if (strncmp(argv[i], "--workers=", 10) == 0) {
+            workers = (unsigned int)strtoul(argv[i] + 10, NULL, 10);
+        } else if (strcmp(argv[i], "--fresh") == 0) {
+            fresh = 1;
+        } else if (script_path == NULL && argv[i][0] != '-') {
+            script_path = argv[i];
+        } else {
+            bad_usage = 1;
+        }
+    }
+    if (bad_usage || script_path == NULL || clients == 0 || clients > MAX_CLIENTS || requests == 0) {
+        fprintf(stderr, "usage: %s SCRIPT [--socket=PATH] [--clients=N] [--requests=N] [--workers=N] [--fresh]\n",
+                argv[0]);
+        return 1;
+    }
+    char *script = ReadScript(script_path);
+    if (script == NULL) {
+        fprintf(stderr, "serve_load: can't read %s\n", script_path);
+        return 1;
+    }
+
+    server_sf *server = NULL;
+    int in_process = socket_path == NULL;
+    char own_socket[64];
+    if (in_process) {
+        snprintf(own_socket, sizeof(own_socket), "/tmp/hw7_serve_load.%ld.sock", (long)getpid());
+        socket_path = own_socket;
+        server = start_server_sf(socket_path, workers);
+        if (server == NULL) {
+            fprintf(stderr, "serve_load: can't start a daemon on %s\n", socket_path);
+            return 1;
+        }
+    }
+
+    unsigned long long total_requests = (unsigned long long)clients * requests;
+    unsigned long long *latencies_ns = malloc(total_requests * sizeof(unsigned long long));
+    LoadClient *load_clients = calloc(clients, sizeof(LoadClient));
+    pthread_t *threads = malloc(clients * sizeof(pthread_t));
+    if (latencies_ns == NULL || load_clients == NULL || threads == NULL) {
+        fprintf(stderr, "serve_load: out of memory\n");
+        return 1;
+    }
+    unsigned long long start = NowNanoseconds();
+    for (unsigned long i = 0; i < clients; i++) {
+        load_clients[i] = (LoadClient){socket_path, script, requests, fresh, latencies_ns + i * requests, 0};
+        pthread_create(&threads[i], NULL, RunClient, &load_clients[i]);
+    }
+    unsigned long failures = 0;
+    for (unsigned long i = 0; i < clients; i++) {
+        pthread_join(threads[i], NULL);
+        failures += load_clients[i].failures;
+    }
+    double elapsed = (double)(NowNanoseconds() - start);
+    stop_server_sf(server);
+
+    qsort(latencies_ns, total_requests, sizeof(unsigned long long), CompareLatencies);
+    unsigned long long statements = CountStatements(script) * total_requests;
+    printf("script       %s (%lu clients x %lu requests%s)\n", script_path, clients, requests,
+           fresh ? ", a session each" : "");
+    printf("daemon       %s\n", in_process ? "in process" : socket_path);
+    printf("requests     %llu (%lu failed)\n", total_requests, failures);
+    printf("elapsed      %.3f ms\n", elapsed / 1e6);
+    printf("throughput   %.0f requests/s, %.0f statements/s\n", (double)total_requests / (elapsed * 1e-9),
+           (double)statements / (elapsed * 1e-9));
+    printf("latency      p50 %.3f ms  p99 %.3f ms  max %.3f ms\n",
+           (double)latencies_ns[(total_requests - 1) * 50 / 100] / 1e6,
+           (double)latencies_ns[(total_requests - 1) * 99 / 100] / 1e6, (double)latencies_ns[total_requests - 1] / 1e6);
+
+    free(latencies_ns);
+    free(load_clients);
+    free(threads);
+    free(script);
+    return failures > 0;
+}
@@ -3,9 +3,12 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
 #include <unistd.h>
 
 #define MAX_LINE_LEN 128
+#define WRITER_BUFFER_SIZE (64 * 1024)
+#define MATRIX_FILE_MAGIC "MSF1"
 
 #ifndef __MATRIX_SF
 #define __MATRIX_SF
@@ -23,6 +26,125 @@ typedef struct bst_sf {
     struct bst_sf *right_child;
 } bst_sf;
 
+// Per-stage timings reported by execute_script_pipelined_sf. All times are in nanoseconds.
+typedef struct {
+    unsigned long long statements;
+    unsigned int parse_threads;
+    unsigned long long read_stall_ns;   // reader waiting for a free slot in the statement queue
+    unsigned long long parse_stall_ns;  // parse threads waiting for statements to parse (summed over threads)
+    unsigned long long eval_stall_ns;   // evaluator waiting for the next statement to be parsed
+    unsigned long long elapsed_ns;
+} pipeline_stats_sf;
+
+// Where the time of a script run went, reported by execute_script_stats_sf. All times are in nanoseconds.
+typedef struct {
+    unsigned long long statements;
+    unsigned long long parse_ns;     // reading and splitting lines, building matrix literals
+    unsigned long long evaluate_ns;  // evaluating expressions and inserting results into the BST
+    unsigned long long free_ns;      // releasing every matrix and BST node at the end
+    unsigned long long elapsed_ns;
+} script_stats_sf;
+
+// Whole-script totals from explain_script_sf
+typedef struct {
+    unsigned long long statements;
+    unsigned long long errors;                // statements that don't type-check (or, when analysing, disagree with the estimate)
+    unsigned long long multiply_adds;
+    unsigned long long bytes_moved;           // bytes the kernels read and write, literal text included
+    unsigned long long peak_temporary_bytes;  // the most any one statement has allocated at once
+} script_estimate_sf;
+
+// Operations counted by a profiling build (compiled with -DHW7_PROFILE). See profile.c.
+typedef enum {
+    PROFILE_ADD_SF,
+    PROFILE_MULT_SF,
+    PROFILE_TRANSPOSE_SF,
+    PROFILE_CREATE_SF,
+    PROFILE_EVALUATE_SF,
+    PROFILE_INSERT_BST_SF,
+    PROFILE_FIND_BST_SF,
+    PROFILE_FREE_BST_SF,
+    PROFILE_OP_COUNT_SF
+} profile_op_sf;
+
+// Totals for one operation since the last reset_profile_sf
+typedef struct {
+    unsigned long long calls;
+    unsigned long long cycles;           // time stamp counter ticks, including any operations called from inside
+    unsigned long long bytes_allocated;  // matrices and BST nodes the operation itself allocated
+    unsigned long long multiply_adds;
+} profile_counter_sf;
+
+// Kernel block sizes and dispatch thresholds, from the tuning profile autotune writes (see tune.c). 0 turns a
+// block size off, and turns a parallel path or streaming stores off entirely.
+typedef struct {
+    unsigned int mult_block_cols;                     // result columns per strip of the general multiply
+    unsigned int transpose_block;                     // side of the tiles the general transpose works through
+    unsigned int small_mult_max_dim;                  // unrolled multiply kernels are used up to this dimension
+    unsigned int small_transpose_max_dim;             // unrolled transpose kernels are used up to this dimension
+    unsigned long long parallel_mult_min_madds;       // smaller products run on the calling thread
+    unsigned long long parallel_add_min_values;       // smaller sums run on the calling thread
+    unsigned long long parallel_transpose_min_values; // smaller transposes run on the calling thread
+    unsigned long long fork_min_madds;                // smaller subtrees aren't evaluated on a thread of their own
+    unsigned long long stream_min_bytes;              // larger results bypass the cache (non-temporal stores)
+} tuning_sf;
+
+// Slab/size-class allocator for matrices and BST nodes. See pool.c.
+typedef struct pool_sf pool_sf;
+
+// Content-addressed cache of statement and script results. See cache.c.
+typedef struct cache_sf cache_sf;
+
+// Daemon running scripts sent over a Unix domain socket. See server.c.
+typedef struct server_sf server_sf;
+
+// Named matrices shared by threads that evaluate expressions against them concurrently. See session.c.
+typedef struct session_sf session_sf;
+
+// Counters of a cache_sf since it was created
+typedef struct {
+    unsigned long long hits;        // lookups answered from memory or disk
+    unsigned long long misses;
+    unsigned long long disk_hits;   // the part of hits that had to be read back from the disk tier
+    unsigned long long insertions;
+    unsigned long long evictions;   // entries pushed out of memory to stay within the byte budget
+    unsigned long long entries;     // entries in memory now
+    unsigned long long bytes;       // bytes of matrices in memory now
+} cache_stats_sf;
+
+// Output formats understood by matrix_writer_sf. See io.c.
+typedef enum {
+    MATRIX_TEXT_SF,   // "rows cols v v ... v\n", the same text print_matrix_sf has always produced
+    MATRIX_BINARY_SF  // matrix_file_header_sf followed by the values as native-endian 32-bit ints, row-major
+} matrix_format_sf;
+
+// Header of a binary matrix file. The values start right after it, 16 bytes into the file.
+typedef struct {
+    char magic[4];
+    uint32_t num_rows;
+    uint32_t num_cols;
+    uint32_t reserved;
+} matrix_file_header_sf;
+
+// Buffered writer that streams matrices to a file descriptor one row at a time
+typedef struct {
+    int fd;
+    matrix_format_sf format;
+    size_t used;
+    unsigned long long values_left;
+    int failed;
+    char buffer[WRITER_BUFFER_SIZE];
+} matrix_writer_sf;
+
+// count matrices of the same shape in structure-of-arrays layout: entry (row, col) of every matrix is stored
+// contiguously, so that entry of matrix index is values[(row * num_cols + col) * count + index]. See batch.c.
+typedef struct {
+    unsigned int num_rows;
+    unsigned int num_cols;
+    size_t count;
+    int values[];
+} matrix_batch_sf;
+
 /**
  * @brief Given a pointer to the bst_sf struct root, which could be NULL, insert the provided matrix mat into the BST without making a copy of mat. The function must ensure that the sorted property of the BST is maintained. The function creates a new BST if the root is NULL.
  * @return a pointer to the root of the updated (or new) BST. 
@@ -38,11 +160,11 @@ matrix_sf* find_bst_sf(char name, bst_sf *root);
  */
 void free_bst_sf(bst_sf *root); 
 /**
- * @brief Perform the matrix addition mat1+mat2 and return the sum.
+ * @brief Perform the matrix addition mat1+mat2 and return the sum. Returns NULL if the shapes differ.
  */
 matrix_sf* add_mats_sf(const matrix_sf *mat1, const matrix_sf *mat2); 
 /**
- * @brief Perform the matrix multiplication mat1*mat2 and return the product. 
+ * @brief Perform the matrix multiplication mat1*mat2 and return the product. Returns NULL if mat1's columns don't match mat2's rows.
  */
 matrix_sf* mult_mats_sf(const matrix_sf *mat1, const matrix_sf *mat2); 
 /**
@@ -59,15 +181,334 @@ matrix_sf* create_matrix_sf(char name, const char *expr);
 matrix_sf* execute_script_sf(char *filename); 
 /**
  * @brief Evaluate expr and store the resulting matrix in a new matrix called name. 
- * @return a pointer to the new matrix
+ * A^k takes O(log k) multiplies by repeated squaring; A^0 is the identity.
+ * trace(X), sum(X) and norm(X) (the sum of X's squared entries) give 1x1 matrices. Applied straight to a sum, or to a
+ * product for trace and sum, they are computed from the operands without building the sum or product.
+ * A[r0:r1, c0:c1] is the block of rows r0..r1-1 and columns c0..c1-1 of A; a missing bound means the edge of A and a
+ * single index one row or column. Add, multiply and transpose read a slice in place, so slicing itself copies nothing.
+ * Sibling subtrees that both take about a million multiply-adds or more, such as the factors of (A + B * C) * (D * E),
+ * are evaluated on separate threads (HW7_THREADS of them at most).
+ * @return a pointer to the new matrix, or NULL if expr uses an undefined name or operands whose shapes don't fit
+ * (including a power or trace of a non-square matrix, or a slice outside its matrix)
  */
 matrix_sf* evaluate_expr_sf(char name, char *expr, bst_sf *root); 
 /**
  * @brief Given an infix expression infix, convert it to its equivalent postfix expression.
- * @return the newly allocated string containing the postfix expression. 
+ * A power "A^k" (k up to 9 digits) binds like transpose; in the postfix form '^' is followed by the digits of k, so
+ * "(A + B)^3 * C" becomes "AB+^3C*". The reductions trace(X), sum(X) and norm(X) become 't', 's' and 'n' after X.
+ * A slice stays attached to its name without spaces: "A[1:3, :]' + B" becomes "A[1:3,:]'B+".
+ * @return the newly allocated string containing the postfix expression, or NULL if a '^' has no valid exponent,
+ * a lowercase name isn't a reduction followed by '(', or a '[' doesn't follow a name or holds anything but
+ * digits, ':' and ','.
  */
 char* infix2postfix_sf(char *infix); 
 
+/**
+ * @brief Create an empty pool. Blocks up to 4KB are carved from 64KB slabs and recycled through per-size-class free lists.
+ * @return a pointer to the new pool or NULL
+ */
+pool_sf* create_pool_sf(void);
+/**
+ * @brief Allocate size bytes from pool. A NULL pool falls back to malloc.
+ */
+void* alloc_pool_sf(pool_sf *pool, size_t size);
+/**
+ * @brief Return a block of size bytes obtained from alloc_pool_sf to pool. A NULL pool falls back to free.
+ */
+void release_pool_sf(pool_sf *pool, void *ptr, size_t size);
+/**
+ * @brief Release every block allocated from pool at once. The slabs are kept for reuse.
+ */
+void reset_pool_sf(pool_sf *pool);
+/**
+ * @brief Release every block allocated from pool and the pool itself.
+ */
+void free_pool_sf(pool_sf *pool);
+/**
+ * @brief Same as create_matrix_sf, but the matrix is allocated from pool.
+ */
+matrix_sf* create_matrix_pool_sf(char name, const char *expr, pool_sf *pool);
+/**
+ * @brief Same as evaluate_expr_sf, but temporaries and the result are allocated from pool.
+ */
+matrix_sf* evaluate_expr_pool_sf(char name, char *expr, bst_sf *root, pool_sf *pool);
+/**
+ * @brief Same as insert_bst_sf, but the new node is allocated from pool. Such a tree is freed with reset_pool_sf, not free_bst_sf.
+ */
+bst_sf* insert_bst_pool_sf(matrix_sf *mat, bst_sf *root, pool_sf *pool);
+/**
+ * @brief Same as execute_script_sf, but every matrix and BST node of the script lives in pool. The pool is reset before returning, so it can be reused for the next script.
+ * @return a malloc'ed copy of the final, named matrix created on the last line of the script
+ */
+matrix_sf* execute_script_pool_sf(char *filename, pool_sf *pool);
+
+/**
+ * @brief Add src into dest in place (dest += src), without allocating.
+ * @return 1 on success, 0 if the shapes differ
+ */
+int add_into_sf(matrix_sf *dest, const matrix_sf *src);
+/**
+ * @brief Transpose mat in its own storage: a rows x cols matrix becomes cols x rows. Non-square matrices need a
+ * temporary bitmap of one bit per value.
+ * @return 1 on success, 0 if mat is NULL or the bitmap couldn't be allocated (mat is then unchanged)
+ */
+int transpose_in_place_sf(matrix_sf *mat);
+/**
+ * @brief Write mat1 * mat2 into result, which must already be mat1->num_rows x mat2->num_cols and must not be
+ * either operand. If accumulate is nonzero the product is added to result's values (result += mat1 * mat2).
+ * @return 1 on success, 0 if the shapes don't fit or result is one of the operands
+ */
+int mult_into_sf(matrix_sf *result, const matrix_sf *mat1, const matrix_sf *mat2, int accumulate);
+
+/**
+ * @brief Allocate a batch of count num_rows x num_cols matrices, all zero. Free it with free().
+ * @return a pointer to the new batch, or NULL if it can't be allocated
+ */
+matrix_batch_sf* create_batch_sf(unsigned int num_rows, unsigned int num_cols, size_t count);
+/**
+ * @brief Copy mat into position index of batch.
+ * @return 1 on success, 0 if index is out of range or mat's shape isn't the batch's
+ */
+int set_batch_matrix_sf(matrix_batch_sf *batch, size_t index, const matrix_sf *mat);
+/**
+ * @brief Copy the matrix at position index of batch into a new matrix called name.
+ * @return a pointer to the new matrix, or NULL if index is out of range
+ */
+matrix_sf* get_batch_matrix_sf(char name, const matrix_batch_sf *batch, size_t index);
+/**
+ * @brief Add, multiply or transpose every matrix of a batch (pairing matrices by index) into a new batch. Each SIMD lane
+ * works on a different matrix, so small shapes cost no per-matrix allocation or loop overhead; large batches are split
+ * across cores.
+ * @return a pointer to the new batch, or NULL if the counts or shapes don't fit
+ */
+matrix_batch_sf* add_batch_sf(const matrix_batch_sf *batch1, const matrix_batch_sf *batch2);
+matrix_batch_sf* mult_batch_sf(const matrix_batch_sf *batch1, const matrix_batch_sf *batch2);
+matrix_batch_sf* transpose_batch_sf(const matrix_batch_sf *batch);
+
+/**
+ * @brief Prepare writer to stream matrices to fd in the given format. Nothing is written until the buffer fills or flush_writer_sf is called.
+ */
+void init_writer_sf(matrix_writer_sf *writer, int fd, matrix_format_sf format);
+/**
+ * @brief Write the header of a num_rows x num_cols matrix. Exactly num_rows*num_cols values must follow through write_matrix_row_sf.
+ * @return 1 on success, 0 if a write to the file descriptor failed
+ */
+int write_matrix_header_sf(matrix_writer_sf *writer, unsigned int num_rows, unsigned int num_cols);
+/**
+ * @brief Append one row of num_cols values to the matrix started by write_matrix_header_sf.
+ * @return 1 on success, 0 if a write to the file descriptor failed
+ */
+int write_matrix_row_sf(matrix_writer_sf *writer, const int *row, unsigned int num_cols);
+/**
+ * @brief Write mat (header and all rows). There is no limit on the size of mat.
+ * @return 1 on success, 0 if a write to the file descriptor failed
+ */
+int write_matrix_sf(matrix_writer_sf *writer, const matrix_sf *mat);
+/**
+ * @brief Write out everything buffered in writer.
+ * @return 1 on success, 0 if a write to the file descriptor failed
+ */
+int flush_writer_sf(matrix_writer_sf *writer);
+/**
+ * @brief Write mat to the file filename (created or truncated) in the given format.
+ * @return 1 on success, 0 on failure
+ */
+int save_matrix_sf(const char *filename, const matrix_sf *mat, matrix_format_sf format);
+
+/**
+ * @brief Read a binary matrix file written with save_matrix_sf(..., MATRIX_BINARY_SF).
+ * @return a pointer to the new matrix or NULL
+ */
+matrix_sf* load_matrix_sf(const char *filename);
+/**
+ * @brief Multiply the binary matrix files left_filename and right_filename out of core and write the product to result_filename in the same format.
+ * The operands are mmapped and walked tile by tile; a prefetch thread packs the next tiles while the current ones are multiplied.
+ * Tile buffers are sized so they stay within memory_budget bytes (at least 64KB is used).
+ * @return 1 on success, 0 if a file could not be read or written, or the shapes don't match
+ */
+int mult_files_sf(const char *left_filename, const char *right_filename, const char *result_filename, size_t memory_budget);
+
+/**
+ * @brief Same as execute_script_sf, but pipelined: a reader thread reads, splits and validates statements ahead, parse_threads
+ * threads build the matrix literals in parallel, and the calling thread evaluates statements in script order.
+ * The stages are connected by a bounded lock-free queue. parse_threads == 0 picks one per spare core (see HW7_THREADS).
+ * A statement that doesn't validate fails the run once the reader reaches it.
+ * If stats is not NULL it receives the per-stage stall times.
+ * @return a pointer to the final, named matrix created on the last line of the script
+ */
+matrix_sf* execute_script_pipelined_sf(char *filename, unsigned int parse_threads, pipeline_stats_sf *stats);
+
+/**
+ * @brief Same as execute_script_sf, but also reports how the time was split between parsing, evaluating and freeing.
+ * @param filename the script to run
+ * @param stats receives the statement count and per-phase times
+ * @return a pointer to the final, named matrix created on the last line of the script
+ */
+matrix_sf* execute_script_stats_sf(char *filename, script_stats_sf *stats);
+
+/**
+ * @brief Check a whole script before running it: every name must be defined before it is used and every addition and
+ * multiplication must have matching shapes, and every matrix literal must be one create_matrix_sf accepts.
+ * execute_script_sf and its variants run this first, on the text they go on to run, and return NULL for scripts that fail.
+ * @param error if not NULL, receives a message such as "line 3 (C): can't add 2x3 and 3x2"
+ * @return 1 if the script is well-formed, 0 otherwise or if the file couldn't be read
+ */
+int validate_script_sf(char *filename, char *error, size_t error_size);
+
+/**
+ * @brief Explain a script without running it: parse each statement, convert expressions with infix2postfix_sf, infer every
+ * shape and print one line per statement to out with its result shape, the kernels it would run and estimates of its
+ * multiply-adds, bytes moved and peak temporary bytes. Statements with undefined names or mismatched shapes are reported.
+ * If analyse is nonzero the script is also run and each line gains the measured time, the measured multiply-adds
+ * (profiling builds only) and whether the actual shape matched.
+ * @param totals if not NULL, receives the whole-script totals
+ * @return 1 if every statement checked out, 0 otherwise or if the file couldn't be read
+ */
+int explain_script_sf(char *filename, FILE *out, int analyse, script_estimate_sf *totals);
+
+/**
+ * @brief Start recording begin/end events for every script statement and matrix operation, on every thread.
+ * Setting the HW7_TRACE environment variable to a file name starts tracing at program start and writes the file at exit.
+ * @return 1 on success
+ */
+int start_trace_sf(void);
+/**
+ * @brief Stop recording trace events. Events already recorded stay buffered until write_trace_sf.
+ */
+void stop_trace_sf(void);
+/**
+ * @brief Write every buffered trace event to filename as Chrome trace JSON (chrome://tracing, Perfetto) and empty the buffers.
+ * @return 1 on success, 0 if the file couldn't be written
+ */
+int write_trace_sf(const char *filename);
+/**
+ * @brief Create a result cache for execute_script_cached_sf. Up to memory_budget bytes of matrices are kept in memory,
+ * least recently used first out. If disk_directory is not NULL (it is created if needed), entries leaving memory are
+ * written there in the binary matrix format and looked up again on a memory miss, also by later processes.
+ * @return a pointer to the new cache or NULL
+ */
+cache_sf* create_cache_sf(size_t memory_budget, const char *disk_directory);
+/**
+ * @brief Free cache. Everything still in memory is written to the disk tier first, if there is one.
+ */
+void free_cache_sf(cache_sf *cache);
+/**
+ * @brief Copy the hit, miss and size counters of cache into stats.
+ */
+void get_cache_stats_sf(cache_sf *cache, cache_stats_sf *stats);
+/**
+ * @brief Same as execute_script_sf, but results are looked up in cache first: a byte-identical script is answered
+ * whole, and otherwise each statement whose normalised right-hand side and operand contents were seen before is
+ * copied from the cache instead of being parsed or evaluated. The cache may be shared between threads.
+ * @return a pointer to the final, named matrix created on the last line of the script
+ */
+matrix_sf* execute_script_cached_sf(char *filename, cache_sf *cache);
+
+/**
+ * @brief Create an empty session: a symbol table that any number of threads may evaluate expressions against at once
+ * while others change it. Every other function in this header is reentrant, so threads are only serialised on the
+ * session itself, and only its writers are.
+ * @return a pointer to the new session or NULL
+ */
+session_sf* create_session_sf(void);
+/**
+ * @brief Make name refer to mat, which the session takes ownership of (and renames to name), replacing and freeing the
+ * matrix name referred to before; a NULL mat removes name. Writers are serialised, and each returns once no evaluation
+ * can still be using the matrix it replaced. On failure the caller keeps mat.
+ * @return 1 on success, 0 on failure
+ */
+int set_session_matrix_sf(session_sf *session, char name, matrix_sf *mat);
+/**
+ * @brief Same as evaluate_expr_sf, against the names of session as they were when the call started. Lookups take no
+ * lock, so any number of threads can evaluate at once, alongside writers.
+ * @return a pointer to the new, malloc'ed matrix or NULL if a name is undefined or the shapes don't fit
+ */
+matrix_sf* evaluate_session_sf(session_sf *session, char name, char *expr);
+/**
+ * @brief Free session and every matrix in it. No other thread may be using it.
+ */
+void free_session_sf(session_sf *session);
+
+/**
+ * @brief Start a daemon listening on the Unix domain socket socket_path (a stale socket left there is replaced) with
+ * worker_count worker threads, or one per core if it is 0. Every connection is a session with its own symbol table that
+ * lasts as long as the connection. A request is the lines of a script followed by a line holding only ".". The daemon
+ * answers each statement in order with one line, the matrix it defined in the text format of print_matrix_sf or
+ * "! name: reason" if the statement failed, and then a "." line; each line is sent as soon as its statement has run.
+ * Within a request the first definition of a name wins, as in a script, but a request may redefine a name an earlier
+ * request defined. Sessions with a request pending are served by the next free worker, so any number of sessions can
+ * share the workers.
+ * @return a pointer to the running server or NULL if the socket could not be set up
+ */
+server_sf* start_server_sf(const char *socket_path, unsigned int worker_count);
+/**
+ * @brief Stop server once its workers finish the requests they are running, close every session and remove the socket.
+ */
+void stop_server_sf(server_sf *server);
+/**
+ * @brief Open a session with the daemon listening on socket_path. Close the returned descriptor to end the session.
+ * @return a connected socket, or -1 on failure
+ */
+int connect_server_sf(const char *socket_path);
+/**
+ * @brief Send script (statements separated by newlines, none of them ".") as one request of the session on fd and wait
+ * for the answer. Each answer line is copied to results as it arrives, unless results is NULL. The session keeps every
+ * matrix the script defines for its later requests.
+ * @return the matrix of the last statement that succeeded, named after it, or NULL if none did or the session broke
+ */
+matrix_sf* run_remote_script_sf(int fd, const char *script, FILE *results);
+
+/**
+ * @brief Return 1 if this build was compiled with -DHW7_PROFILE and collects profiling counters, 0 otherwise.
+ */
+int profile_enabled_sf(void);
+/**
+ * @brief Copy the counters of op into counter. They are all zero unless profile_enabled_sf() returns 1.
+ */
+void get_profile_sf(profile_op_sf op, profile_counter_sf *counter);
+/**
+ * @brief Set every profiling counter back to zero.
+ */
+void reset_profile_sf(void);
+/**
+ * @brief Print a table of every operation's counters to out. A profiling build does this on stderr at exit when
+ * the HW7_PROFILE environment variable is set.
+ */
+void dump_profile_sf(FILE *out);
+/**
+ * @brief Return the name of op as printed by dump_profile_sf, for example "mult_mats_sf".
+ */
+const char* profile_op_name_sf(profile_op_sf op);
+
+/**
+ * @brief Fill tuning with the built-in defaults, used for anything a tuning profile doesn't set.
+ */
+void default_tuning_sf(tuning_sf *tuning);
+/**
+ * @brief Read a tuning profile ("name value" lines, '#' starts a comment) over the built-in defaults.
+ * @return 1 on success, 0 if filename can't be read (tuning then holds the defaults)
+ */
+int load_tuning_sf(const char *filename, tuning_sf *tuning);
+/**
+ * @brief Write tuning to filename as a profile load_tuning_sf reads back.
+ * @return 1 on success, 0 on failure
+ */
+int save_tuning_sf(const char *filename, const tuning_sf *tuning);
+/**
+ * @brief Return where the tuning profile lives: $HW7_TUNE if it is set, otherwise ~/.config/hw7/tune.
+ */
+const char* tuning_path_sf(void);
+/**
+ * @brief Copy the tuning the kernels use into tuning. The first use of the kernels loads it from tuning_path_sf(),
+ * falling back on the built-in defaults when there is no profile there.
+ */
+void get_tuning_sf(tuning_sf *tuning);
+/**
+ * @brief Make the kernels use tuning from now on. Safe while other threads run kernels: each of their lookups sees
+ * either the old tuning or this one, never a mix. If there is no memory for the copy the tuning is left as it was.
+ */
+void set_tuning_sf(const tuning_sf *tuning);
+
 // This is a utility function you may use if you want. See hw7.c.
 matrix_sf *copy_matrix(unsigned int num_rows, unsigned int num_cols, int values[]);
 // Utility function used in testing. Don't mess with it.
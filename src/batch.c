@@ -0,0 +1,234 @@
+#include "hw7.h"
+#include "hw7_internal.h"
+
+// Batches with fewer values of work than this run on the calling thread
+#define PARALLEL_BATCH_MIN_VALUES (256 * 1024)
+#define MAX_BATCH_TASKS 64
+// Matrices handled together: one entry of each stays within a few cache lines, and a block of the largest small
+// shapes (8x8) still fits in L1 for every operand
+#define BATCH_BLOCK 64
+
+// One lane per matrix of the batch. Lanes are unsigned so that products wrap the way the scalar kernels' do.
+#define BATCH_LANE_COUNT 4
+typedef unsigned int BatchLanes __attribute__((vector_size(BATCH_LANE_COUNT * sizeof(unsigned int))));
+
+// One batched operation split by matrix index; each task covers a whole number of blocks
+typedef struct {
+    char op;
+    const matrix_batch_sf *left;
+    const matrix_batch_sf *right;
+    matrix_batch_sf *result;
+    unsigned int task_count;
+} BatchJob;
+
+// Helper function to allocate a batch of count num_rows x num_cols matrices, or NULL if its size overflows
+static matrix_batch_sf* AllocBatch(unsigned int num_rows, unsigned int num_cols, size_t count) {
+    size_t entries = (size_t)num_rows * num_cols;
+    if (count != 0 && entries > (SIZE_MAX - sizeof(matrix_batch_sf)) / sizeof(int) / count) {
+        return NULL;
+    }
+    matrix_batch_sf *batch = malloc(sizeof(matrix_batch_sf) + entries * count * sizeof(int));
+    if (batch == NULL) {
+        return NULL;
+    }
+    batch->num_rows = num_rows;
+    batch->num_cols = num_cols;
+    batch->count = count;
+    return batch;
+}
+
+// Helper function to load BATCH_LANE_COUNT values from wherever they happen to be aligned
+static BatchLanes LoadLanes(const int *values) {
+    BatchLanes lanes;
+    memcpy(&lanes, values, sizeof(lanes));
+    return lanes;
+}
+
+// Helper function to store BATCH_LANE_COUNT values wherever they happen to be aligned
+static void StoreLanes(int *values, BatchLanes lanes) {
+    memcpy(values, &lanes, sizeof(lanes));
+}
+
+// Helper function to add matrices [begin, end) of the batch, one entry at a time
+static void AddBlock(const BatchJob *job, size_t begin, size_t end) {
+    size_t count = job->result->count;
+    size_t entries = (size_t)job->result->num_rows * job->result->num_cols;
+    for (size_t entry = 0; entry < entries; entry++) {
+        const int *left = job->left->values + entry * count;
+        const int *right = job->right->values + entry * count;
+        int *out = job->result->values + entry * count;
+        size_t i = begin;
+        for (; i + BATCH_LANE_COUNT <= end; i += BATCH_LANE_COUNT) {
+            StoreLanes(out + i, LoadLanes(left + i) + LoadLanes(right + i));
+        }
+        for (; i < end; i++) {
+            out[i] = (int)((unsigned int)left[i] + (unsigned int)right[i]);
+        }
+    }
+}
+
+// Helper function to multiply matrices [begin, end) of the batch: each lane runs the dot product of its own matrix
+static void MultBlock(const BatchJob *job, size_t begin, size_t end) {
+    size_t count = job->result->count;
+    unsigned int rows = job->result->num_rows;
+    unsigned int cols = job->result->num_cols;
+    unsigned int inner = job->left->num_cols;
+    for (unsigned int row = 0; row < rows; row++) {
+        for (unsigned int col = 0; col < cols; col++) {
+            int *out = job->result->values + ((size_t)row * cols + col) * count;
+            const int *left = job->left->values + (size_t)row * inner * count;
+            const int *right = job->right->values + (size_t)col * count;
+            size_t i = begin;
+            for (; i + BATCH_LANE_COUNT <= end; i += BATCH_LANE_COUNT) {
+                BatchLanes sum = {0};
+                for (unsigned int k = 0; k < inner; k++) {
+                    sum += LoadLanes(left + (size_t)k * count + i) * LoadLanes(right + (size_t)k * cols * count + i);
+                }
+                StoreLanes(out + i, sum);
+            }
+            for (; i < end; i++) {
+                unsigned int sum = 0;
+                for (unsigned int k = 0; k < inner; k++) {
+                    sum += (unsigned int)left[(size_t)k * count + i] * (unsigned int)right[(size_t)k * cols * count + i];
+                }
+                out[i] = (int)sum;
+            }
+        }
+    }
+}
+
+// Helper function to transpose matrices [begin, end) of the batch: every entry moves as one contiguous run
+static void TransposeBlock(const BatchJob *job, size_t begin, size_t end) {
+    size_t count = job->result->count;
+    unsigned int rows = job->left->num_rows;
+    unsigned int cols = job->left->num_cols;
+    for (unsigned int row = 0; row < rows; row++) {
+        for (unsigned int col = 0; col < cols; col++) {
+            memcpy(job->result->values + ((size_t)col * rows + row) * count + begin,
+                   job->left->values + ((size_t)row * cols + col) * count + begin, (end - begin) * sizeof(int));
+        }
+    }
+}
+
+// Helper function to run the task_index-th share of a batched operation, block by block
+static void RunBatchTask(void *arg, unsigned int task_index) {
+    BatchJob *job = arg;
+    size_t blocks = (job->result->count + BATCH_BLOCK - 1) / BATCH_BLOCK;
+    size_t first_block = blocks * task_index / job->task_count;
+    size_t last_block = blocks * (task_index + 1) / job->task_count;
+    for (size_t block = first_block; block < last_block; block++) {
+        size_t begin = block * BATCH_BLOCK;
+        size_t end = begin + BATCH_BLOCK < job->result->count ? begin + BATCH_BLOCK : job->result->count;
+        if (job->op == '+') {
+            AddBlock(job, begin, end);
+        } else if (job->op == '*') {
+            MultBlock(job, begin, end);
+        } else {
+            TransposeBlock(job, begin, end);
+        }
+    }
+}
+
+// Helper function to run a batched operation, split across cores when it is big enough to pay for the threads
+static void RunBatchJob(BatchJob *job, unsigned long long work) {
+    unsigned long long tasks = work / PARALLEL_BATCH_MIN_VALUES;
+    unsigned long long blocks = (job->result->count + BATCH_BLOCK - 1) / BATCH_BLOCK;
+    unsigned int cores = ParallelWidth();
+    if (tasks > cores) {
+        tasks = cores;
+    }
+    if (tasks > blocks) {
+        tasks = blocks;
+    }
+    if (tasks > MAX_BATCH_TASKS) {
+        tasks = MAX_BATCH_TASKS;
+    }
+    job->task_count = tasks < 1 ? 1 : (unsigned int)tasks;
+    RunParallel(job->task_count, RunBatchTask, job);
+}
+
+matrix_batch_sf* create_batch_sf(unsigned int num_rows, unsigned int num_cols, size_t count) {
+    matrix_batch_sf *batch = AllocBatch(num_rows, num_cols, count);
+    if (batch != NULL) {
+        memset(batch->values, 0, (size_t)num_rows * num_cols * count * sizeof(int));
+    }
+    return batch;
+}
+
+int set_batch_matrix_sf(matrix_batch_sf *batch, size_t index, const matrix_sf *mat) {
+    if (batch == NULL || mat == NULL || index >= batch->count || mat->num_rows != batch->num_rows ||
+        mat->num_cols != batch->num_cols) {
+        return 0;
+    }
+    size_t entries = (size_t)mat->num_rows * mat->num_cols;
+    for (size_t entry = 0; entry < entries; entry++) {
+        batch->values[entry * batch->count + index] = mat->values[entry];
+    }
+    return 1;
+}
+
+matrix_sf* get_batch_matrix_sf(char name, const matrix_batch_sf *batch, size_t index) {
+    if (batch == NULL || index >= batch->count) {
+        return NULL;
+    }
+    size_t entries = (size_t)batch->num_rows * batch->num_cols;
+    matrix_sf *mat = malloc(sizeof(matrix_sf) + entries * sizeof(int));
+    if (mat == NULL) {
+        return NULL;
+    }
+    mat->name = name;
+    mat->num_rows = batch->num_rows;
+    mat->num_cols = batch->num_cols;
+    for (size_t entry = 0; entry < entries; entry++) {
+        mat->values[entry] = batch->values[entry * batch->count + index];
+    }
+    return mat;
+}
+
+matrix_batch_sf* add_batch_sf(const matrix_batch_sf *batch1, const matrix_batch_sf *batch2) {
+    if (batch1 == NULL || batch2 == NULL || batch1->count != batch2->count || batch1->num_rows != batch2->num_rows ||
+        batch1->num_cols != batch2->num_cols) {
+        return NULL;
+    }
+    PROFILE_BEGIN(PROFILE_ADD_SF);
+    matrix_batch_sf *result = AllocBatch(batch1->num_rows, batch1->num_cols, batch1->count);
+    if (result == NULL) {
+        return NULL;
+    }
+    BatchJob job = {'+', batch1, batch2, result, 0};
+    RunBatchJob(&job, (unsigned long long)result->num_rows * result->num_cols * result->count);
+    PROFILE_END(PROFILE_ADD_SF, (unsigned long long)result->num_rows * result->num_cols * result->count * sizeof(int), 0);
+    return result;
+}
+
+matrix_batch_sf* mult_batch_sf(const matrix_batch_sf *batch1, const matrix_batch_sf *batch2) {
+    if (batch1 == NULL || batch2 == NULL || batch1->count != batch2->count || batch1->num_cols != batch2->num_rows) {
+        return NULL;
+    }
+    PROFILE_BEGIN(PROFILE_MULT_SF);
+    matrix_batch_sf *result = AllocBatch(batch1->num_rows, batch2->num_cols, batch1->count);
+    if (result == NULL) {
+        return NULL;
+    }
+    BatchJob job = {'*', batch1, batch2, result, 0};
+    RunBatchJob(&job, (unsigned long long)result->num_rows * result->num_cols * batch1->num_cols * result->count);
+    PROFILE_END(PROFILE_MULT_SF, (unsigned long long)result->num_rows * result->num_cols * result->count * sizeof(int),
+                (unsigned long long)result->num_rows * result->num_cols * batch1->num_cols * result->count);
+    return result;
+}
+
+matrix_batch_sf* transpose_batch_sf(const matrix_batch_sf *batch) {
+    if (batch == NULL) {
+        return NULL;
+    }
+    PROFILE_BEGIN(PROFILE_TRANSPOSE_SF);
+    matrix_batch_sf *result = AllocBatch(batch->num_cols, batch->num_rows, batch->count);
+    if (result == NULL) {
+        return NULL;
+    }
+    BatchJob job = {'\'', batch, NULL, result, 0};
+    RunBatchJob(&job, (unsigned long long)result->num_rows * result->num_cols * result->count);
+    PROFILE_END(PROFILE_TRANSPOSE_SF,
+                (unsigned long long)result->num_rows * result->num_cols * result->count * sizeof(int), 0);
+    return result;
+}
@@ -0,0 +1,485 @@
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "hw7.h"
+#include "hw7_internal.h"
+
+// Starting number of hash buckets; the table doubles whenever it holds more entries than buckets
+#define CACHE_INITIAL_BUCKETS 64
+// Room for "<directory>/<32 hex digits>.msf.<pid>.<spill number>"
+#define CACHE_PATH_EXTRA 96
+
+// The XXH64 primes
+#define HASH_PRIME_1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME_2 0xC2B2AE3D27D4EB4FULL
+#define HASH_PRIME_3 0x165667B19E3779F9ULL
+#define HASH_PRIME_4 0x85EBCA77C2B2AE63ULL
+#define HASH_PRIME_5 0x27D4EB2F165667C5ULL
+
+// Seeds that keep the three kinds of key apart
+#define KEY_SEED_LITERAL 0x4C4954ULL
+#define KEY_SEED_EXPRESSION 0x455850ULL
+#define KEY_SEED_SCRIPT 0x534352ULL
+
+// One cached matrix. Entries sit on a hash chain and on the LRU list at the same time.
+typedef struct CacheEntry {
+    CacheKey key;
+    matrix_sf *mat;
+    size_t bytes;
+    struct CacheEntry *bucket_next;
+    struct CacheEntry *newer;
+    struct CacheEntry *older;
+} CacheEntry;
+
+struct cache_sf {
+    pthread_mutex_t lock;
+    size_t memory_budget;
+    size_t bytes_used;
+    char *disk_directory;  // NULL when there is no disk tier
+    CacheEntry **buckets;
+    size_t bucket_count;
+    CacheEntry *newest;
+    CacheEntry *oldest;
+    cache_stats_sf stats;
+};
+
+// Helper function to rotate a 64-bit value left
+static uint64_t RotateLeft(uint64_t value, unsigned int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Helper function to read 8 unaligned bytes
+static uint64_t Read64(const unsigned char *bytes) {
+    uint64_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+// Helper function to read 4 unaligned bytes
+static uint32_t Read32(const unsigned char *bytes) {
+    uint32_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+// Helper function to fold 8 bytes of input into an accumulator
+static uint64_t HashRound(uint64_t accumulator, uint64_t input) {
+    accumulator += input * HASH_PRIME_2;
+    accumulator = RotateLeft(accumulator, 31);
+    return accumulator * HASH_PRIME_1;
+}
+
+// Helper function to merge one of the four lane accumulators into the hash
+static uint64_t HashMergeRound(uint64_t hash, uint64_t accumulator) {
+    hash ^= HashRound(0, accumulator);
+    return hash * HASH_PRIME_1 + HASH_PRIME_4;
+}
+
+// Helper function to compute XXH64 of length bytes with the given seed
+static uint64_t Hash64(const void *input, size_t length, uint64_t seed) {
+    const unsigned char *bytes = input;
+    const unsigned char *end = bytes + length;
+    uint64_t hash;
+
+    if (length >= 32) {
+        uint64_t lanes[4] = {seed + HASH_PRIME_1 + HASH_PRIME_2, seed + HASH_PRIME_2, seed, seed - HASH_PRIME_1};
+        do {
+            for (int lane = 0; lane < 4; lane++) {
+                lanes[lane] = HashRound(lanes[lane], Read64(bytes + lane * 8));
+            }
+            bytes += 32;
+        } while (end - bytes >= 32);
+        hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+        for (int lane = 0; lane < 4; lane++) {
+            hash = HashMergeRound(hash, lanes[lane]);
+        }
+    } else {
+        hash = seed + HASH_PRIME_5;
+    }
+    hash += length;
+
+    while (end - bytes >= 8) {
+        hash ^= HashRound(0, Read64(bytes));
+        hash = RotateLeft(hash, 27) * HASH_PRIME_1 + HASH_PRIME_4;
+        bytes += 8;
+    }
+    if (end - bytes >= 4) {
+        hash ^= (uint64_t)Read32(bytes) * HASH_PRIME_1;
+        hash = RotateLeft(hash, 23) * HASH_PRIME_2 + HASH_PRIME_3;
+        bytes += 4;
+    }
+    while (bytes < end) {
+        hash ^= *bytes * HASH_PRIME_5;
+        hash = RotateLeft(hash, 11) * HASH_PRIME_1;
+        bytes++;
+    }
+
+    hash ^= hash >> 33;
+    hash *= HASH_PRIME_2;
+    hash ^= hash >> 29;
+    hash *= HASH_PRIME_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// Helper function to build a 128-bit key from two independently seeded hashes
+static CacheKey KeyOf(const void *bytes, size_t length, uint64_t seed) {
+    CacheKey key;
+    key.low = Hash64(bytes, length, seed);
+    key.high = Hash64(bytes, length, seed ^ HASH_PRIME_3);
+    return key;
+}
+
+int StatementKey(const char *rhs, int is_literal, const CacheKey *content_ids, CacheKey *key) {
+    size_t length = strlen(rhs);
+    if (is_literal) {
+        // The literal text is its own content; only trailing blanks are dropped
+        while (length > 0 && isspace((unsigned char)rhs[length - 1])) {
+            length--;
+        }
+        *key = KeyOf(rhs, length, KEY_SEED_LITERAL);
+        return 1;
+    }
+
+    // Postfix form drops spaces and redundant parentheses; then every operand name is replaced by the
+    // content id of the matrix it names
+    char *postfix = infix2postfix_sf((char *)rhs);
+    if (postfix == NULL) {
+        return 0;
+    }
+    length = strlen(postfix);
+    unsigned char *normalised = malloc(length * sizeof(CacheKey) + 1);
+    if (normalised == NULL) {
+        free(postfix);
+        return 0;
+    }
+    size_t used = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char token = (unsigned char)postfix[i];
+        if (isspace(token)) {
+            continue;
+        }
+        if (token >= 'A' && token <= 'Z') {
+            memcpy(normalised + used, &content_ids[token], sizeof(CacheKey));
+            used += sizeof(CacheKey);
+        } else {
+            normalised[used++] = token;
+        }
+    }
+    *key = KeyOf(normalised, used, KEY_SEED_EXPRESSION);
+    free(normalised);
+    free(postfix);
+    return 1;
+}
+
+int ScriptKey(const char *text, size_t length, CacheKey *key, char *last_name) {
+    // The result is named after the first character of the last non-blank line, as SplitStatement would see it
+    *last_name = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (i == 0 || text[i - 1] == '\n') {
+            size_t first = i;
+            while (first < length && text[first] == ' ') {
+                first++;
+            }
+            if (first < length && text[first] != '\n') {
+                *last_name = text[first];
+            }
+        }
+    }
+
+    *key = KeyOf(text, length, KEY_SEED_SCRIPT);
+    return *last_name != 0;
+}
+
+// Helper function to compute the bytes a matrix occupies
+static size_t CachedBytes(unsigned int num_rows, unsigned int num_cols) {
+    return sizeof(matrix_sf) + (size_t)num_rows * num_cols * sizeof(int);
+}
+
+// Helper function to compare two keys
+static int SameKey(CacheKey first, CacheKey second) {
+    return first.low == second.low && first.high == second.high;
+}
+
+// Helper function to find the bucket of a key
+static CacheEntry** BucketOf(cache_sf *cache, CacheKey key) {
+    return &cache->buckets[key.low & (cache->bucket_count - 1)];
+}
+
+// Helper function to unlink an entry from the LRU list
+static void UnlinkEntry(cache_sf *cache, CacheEntry *entry) {
+    if (entry->newer != NULL) {
+        entry->newer->older = entry->older;
+    } else {
+        cache->newest = entry->older;
+    }
+    if (entry->older != NULL) {
+        entry->older->newer = entry->newer;
+    } else {
+        cache->oldest = entry->newer;
+    }
+}
+
+// Helper function to put an entry at the most recently used end of the LRU list
+static void LinkNewest(cache_sf *cache, CacheEntry *entry) {
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if (cache->newest != NULL) {
+        cache->newest->newer = entry;
+    } else {
+        cache->oldest = entry;
+    }
+    cache->newest = entry;
+}
+
+// Helper function to remove an entry from its hash chain
+static void RemoveFromBucket(cache_sf *cache, CacheEntry *entry) {
+    CacheEntry **link = BucketOf(cache, entry->key);
+    while (*link != entry) {
+        link = &(*link)->bucket_next;
+    }
+    *link = entry->bucket_next;
+}
+
+// Helper function to look up a key in the memory tier; the caller holds the lock
+static CacheEntry* FindEntry(cache_sf *cache, CacheKey key) {
+    for (CacheEntry *entry = *BucketOf(cache, key); entry != NULL; entry = entry->bucket_next) {
+        if (SameKey(entry->key, key)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Helper function to double the bucket array; on failure the table just stays denser
+static void GrowBuckets(cache_sf *cache) {
+    size_t bucket_count = cache->bucket_count * 2;
+    CacheEntry **buckets = calloc(bucket_count, sizeof(CacheEntry *));
+    if (buckets == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < cache->bucket_count; i++) {
+        CacheEntry *entry = cache->buckets[i];
+        while (entry != NULL) {
+            CacheEntry *next = entry->bucket_next;
+            CacheEntry **bucket = &buckets[entry->key.low & (bucket_count - 1)];
+            entry->bucket_next = *bucket;
+            *bucket = entry;
+            entry = next;
+        }
+    }
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->bucket_count = bucket_count;
+}
+
+// Helper function to build the disk tier path of a key, optionally with a suffix
+static void DiskPath(const cache_sf *cache, CacheKey key, const char *suffix, char *path, size_t path_size) {
+    snprintf(path, path_size, "%s/%016llx%016llx.msf%s", cache->disk_directory, (unsigned long long)key.high,
+             (unsigned long long)key.low, suffix);
+}
+
+// Spills so far in this process, to tell the temporary files of concurrent spills apart
+static atomic_ullong SpillCount;
+
+// Helper function to write a matrix to the disk tier, unless it is already there
+static void SpillToDisk(const cache_sf *cache, CacheKey key, const matrix_sf *mat) {
+    size_t path_size = strlen(cache->disk_directory) + CACHE_PATH_EXTRA;
+    char *path = malloc(path_size);
+    char *temporary_path = malloc(path_size);
+    if (path != NULL && temporary_path != NULL) {
+        DiskPath(cache, key, "", path, path_size);
+        if (access(path, F_OK) != 0) {
+            // Write under a name private to this spill and rename, so other processes never load a half-written file
+            // and two threads spilling the same key never write into one file
+            char suffix[48];
+            snprintf(suffix, sizeof(suffix), ".%ld.%llu", (long)getpid(), atomic_fetch_add(&SpillCount, 1));
+            DiskPath(cache, key, suffix, temporary_path, path_size);
+            if (!save_matrix_sf(temporary_path, mat, MATRIX_BINARY_SF) || rename(temporary_path, path) != 0) {
+                unlink(temporary_path);
+            }
+        }
+    }
+    free(path);
+    free(temporary_path);
+}
+
+// Helper function to read a matrix back from the disk tier
+static matrix_sf* LoadFromDisk(const cache_sf *cache, CacheKey key) {
+    size_t path_size = strlen(cache->disk_directory) + CACHE_PATH_EXTRA;
+    char *path = malloc(path_size);
+    if (path == NULL) {
+        return NULL;
+    }
+    DiskPath(cache, key, "", path, path_size);
+    matrix_sf *mat = load_matrix_sf(path);
+    free(path);
+    return mat;
+}
+
+// Helper function to add a malloc'ed matrix to the memory tier, taking ownership of it.
+// Entries pushed out of the byte budget are spilled to disk (if there is a disk tier) and freed.
+static void InsertOwned(cache_sf *cache, CacheKey key, matrix_sf *mat) {
+    size_t bytes = CachedBytes(mat->num_rows, mat->num_cols);
+    CacheEntry *entry = bytes <= cache->memory_budget ? malloc(sizeof(CacheEntry)) : NULL;
+    if (entry == NULL) {
+        // Too big for memory: it can still live on disk
+        if (cache->disk_directory != NULL) {
+            SpillToDisk(cache, key, mat);
+        }
+        free(mat);
+        return;
+    }
+    entry->key = key;
+    entry->mat = mat;
+    entry->bytes = bytes;
+
+    CacheEntry *evicted = NULL;
+    pthread_mutex_lock(&cache->lock);
+    if (FindEntry(cache, key) != NULL) {
+        // Another thread got there first
+        pthread_mutex_unlock(&cache->lock);
+        free(mat);
+        free(entry);
+        return;
+    }
+    CacheEntry **bucket = BucketOf(cache, key);
+    entry->bucket_next = *bucket;
+    *bucket = entry;
+    LinkNewest(cache, entry);
+    cache->bytes_used += bytes;
+    cache->stats.entries++;
+    cache->stats.insertions++;
+    if (cache->stats.entries > cache->bucket_count) {
+        GrowBuckets(cache);
+    }
+
+    // Evict from the least recently used end; the evicted entries are chained through bucket_next
+    while (cache->bytes_used > cache->memory_budget) {
+        CacheEntry *oldest = cache->oldest;
+        UnlinkEntry(cache, oldest);
+        RemoveFromBucket(cache, oldest);
+        cache->bytes_used -= oldest->bytes;
+        cache->stats.entries--;
+        cache->stats.evictions++;
+        oldest->bucket_next = evicted;
+        evicted = oldest;
+    }
+    cache->stats.bytes = cache->bytes_used;
+    pthread_mutex_unlock(&cache->lock);
+
+    // Disk writes happen outside the lock
+    while (evicted != NULL) {
+        CacheEntry *next = evicted->bucket_next;
+        if (cache->disk_directory != NULL) {
+            SpillToDisk(cache, evicted->key, evicted->mat);
+        }
+        free(evicted->mat);
+        free(evicted);
+        evicted = next;
+    }
+}
+
+// Helper function to copy a matrix into pool (or malloc when pool is NULL)
+static matrix_sf* CopyInto(pool_sf *pool, const matrix_sf *mat) {
+    size_t bytes = CachedBytes(mat->num_rows, mat->num_cols);
+    matrix_sf *copy = alloc_pool_sf(pool, bytes);
+    if (copy != NULL) {
+        memcpy(copy, mat, bytes);
+    }
+    return copy;
+}
+
+matrix_sf* CacheLookup(cache_sf *cache, CacheKey key, pool_sf *pool) {
+    pthread_mutex_lock(&cache->lock);
+    CacheEntry *entry = FindEntry(cache, key);
+    if (entry != NULL) {
+        UnlinkEntry(cache, entry);
+        LinkNewest(cache, entry);
+        matrix_sf *copy = CopyInto(pool, entry->mat);
+        cache->stats.hits += copy != NULL;
+        pthread_mutex_unlock(&cache->lock);
+        return copy;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    matrix_sf *loaded = cache->disk_directory != NULL ? LoadFromDisk(cache, key) : NULL;
+    matrix_sf *copy = loaded != NULL ? CopyInto(pool, loaded) : NULL;
+
+    pthread_mutex_lock(&cache->lock);
+    if (copy != NULL) {
+        cache->stats.hits++;
+        cache->stats.disk_hits++;
+    } else {
+        cache->stats.misses++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    if (copy == NULL) {
+        free(loaded);
+        return NULL;
+    }
+    // Promote what came off disk, so the next lookup stays in memory
+    InsertOwned(cache, key, loaded);
+    return copy;
+}
+
+void CacheInsert(cache_sf *cache, CacheKey key, const matrix_sf *mat) {
+    matrix_sf *copy = CopyInto(NULL, mat);
+    if (copy != NULL) {
+        InsertOwned(cache, key, copy);
+    }
+}
+
+cache_sf* create_cache_sf(size_t memory_budget, const char *disk_directory) {
+    cache_sf *cache = calloc(1, sizeof(cache_sf));
+    if (cache == NULL) {
+        return NULL;
+    }
+    cache->memory_budget = memory_budget;
+    cache->bucket_count = CACHE_INITIAL_BUCKETS;
+    cache->buckets = calloc(cache->bucket_count, sizeof(CacheEntry *));
+    if (disk_directory != NULL) {
+        if (mkdir(disk_directory, 0755) != 0 && errno != EEXIST) {
+            free(cache->buckets);
+            free(cache);
+            return NULL;
+        }
+        cache->disk_directory = strdup(disk_directory);
+    }
+    if (cache->buckets == NULL || (disk_directory != NULL && cache->disk_directory == NULL)) {
+        free(cache->buckets);
+        free(cache->disk_directory);
+        free(cache);
+        return NULL;
+    }
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+void free_cache_sf(cache_sf *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    CacheEntry *entry = cache->newest;
+    while (entry != NULL) {
+        CacheEntry *older = entry->older;
+        if (cache->disk_directory != NULL) {
+            SpillToDisk(cache, entry->key, entry->mat);
+        }
+        free(entry->mat);
+        free(entry);
+        entry = older;
+    }
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->buckets);
+    free(cache->disk_directory);
+    free(cache);
+}
+
+void get_cache_stats_sf(cache_sf *cache, cache_stats_sf *stats) {
+    pthread_mutex_lock(&cache->lock);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->lock);
+}
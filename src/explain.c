@@ -0,0 +1,561 @@
+#include "hw7.h"
+#include "hw7_internal.h"
+
+// Room for the comma-separated kernel list of one statement
+#define KERNEL_LIST_LEN 56
+
+// What shape inference knows about a name
+typedef struct {
+    unsigned int num_rows;
+    unsigned int num_cols;
+    int defined;
+} NameShape;
+
+// One operand on the shape-inference stack
+typedef struct {
+    unsigned int num_rows;
+    unsigned int num_cols;
+    int is_temporary;
+    int is_view;  // a slice of a named matrix, read in place by the strided kernels
+} ShapeEntry;
+
+// Estimated cost of one statement
+typedef struct {
+    unsigned int num_rows;
+    unsigned int num_cols;
+    unsigned long long multiply_adds;
+    unsigned long long bytes_moved;
+    unsigned long long peak_temporary_bytes;
+    char kernels[KERNEL_LIST_LEN];
+    int kernels_cut;
+    char error[96];
+} StatementEstimate;
+
+// Helper function to compute the bytes of a matrix the way the kernels allocate it
+static unsigned long long ShapeBytes(unsigned int num_rows, unsigned int num_cols) {
+    return sizeof(matrix_sf) + (unsigned long long)num_rows * num_cols * sizeof(int);
+}
+
+// Helper function to append a kernel name to the statement's kernel list
+static void AddKernel(StatementEstimate *estimate, const char *kernel) {
+    if (estimate->kernels_cut) {
+        return;
+    }
+    size_t used = strlen(estimate->kernels);
+    // Always leave room for a trailing ",..." in case a later kernel doesn't fit
+    if (used + 1 + strlen(kernel) + sizeof(",...") > KERNEL_LIST_LEN) {
+        strcat(estimate->kernels, used > 0 ? ",..." : "...");
+        estimate->kernels_cut = 1;
+        return;
+    }
+    if (used > 0) {
+        strcat(estimate->kernels, ",");
+    }
+    strcat(estimate->kernels, kernel);
+}
+
+// Helper function to estimate a literal "rows cols [ ... ]" without parsing its values. The header is read the way
+// create_matrix_sf reads it, so a literal accepted here is one it builds with this shape.
+static int EstimateLiteral(const char *rhs, StatementEstimate *estimate) {
+    if (ParseLiteralHeader(rhs, &estimate->num_rows, &estimate->num_cols) == NULL) {
+        snprintf(estimate->error, sizeof(estimate->error), "malformed matrix literal");
+        return 0;
+    }
+    size_t length = strlen(rhs);
+    unsigned long long element_count = (unsigned long long)estimate->num_rows * estimate->num_cols;
+    unsigned int threads = LiteralParseThreads(element_count, length);
+
+    estimate->bytes_moved = length + ShapeBytes(estimate->num_rows, estimate->num_cols);
+    if (threads > 1) {
+        snprintf(estimate->kernels, sizeof(estimate->kernels), "parse/%u threads", threads);
+    } else {
+        snprintf(estimate->kernels, sizeof(estimate->kernels), "parse");
+    }
+    return 1;
+}
+
+// Helper function to account for the copy EvaluateExpr makes of a slice before an operator that only reads whole
+// matrices (and of a slice left as the result)
+static void MaterializeView(ShapeEntry *entry, unsigned long long *live_temporary_bytes, StatementEstimate *estimate) {
+    if (!entry->is_view) {
+        return;
+    }
+    estimate->bytes_moved += 2ULL * entry->num_rows * entry->num_cols * sizeof(int);
+    AddKernel(estimate, "slice/copy");
+    *live_temporary_bytes += ShapeBytes(entry->num_rows, entry->num_cols);
+    if (*live_temporary_bytes > estimate->peak_temporary_bytes) {
+        estimate->peak_temporary_bytes = *live_temporary_bytes;
+    }
+    entry->is_view = 0;
+    entry->is_temporary = 1;
+}
+
+// Helper function to estimate a reduction of the top operand (fused_op 0), or of the top two combined by fused_op,
+// replacing them with its 1x1 result. Returns 0 (see estimate->error) if the shapes don't fit.
+static int EstimateReduction(ReduceKind kind, char fused_op, ShapeEntry *stack, int *stack_top,
+                             unsigned long long *live_temporary_bytes, StatementEstimate *estimate) {
+    const char *label = kind == REDUCE_TRACE ? "trace" : kind == REDUCE_SUM ? "sum" : "norm";
+    int operand_count = fused_op != 0 ? 2 : 1;
+    if (*stack_top + 1 < operand_count) {
+        snprintf(estimate->error, sizeof(estimate->error), "%s is missing its argument", label);
+        return 0;
+    }
+    ShapeEntry right = stack[(*stack_top)--];
+    ShapeEntry left = operand_count == 2 ? stack[(*stack_top)--] : right;
+    if (fused_op == '+' && (left.num_rows != right.num_rows || left.num_cols != right.num_cols)) {
+        snprintf(estimate->error, sizeof(estimate->error), "can't add %ux%u and %ux%u", left.num_rows, left.num_cols,
+                 right.num_rows, right.num_cols);
+        return 0;
+    }
+    if (fused_op == '*' && left.num_cols != right.num_rows) {
+        snprintf(estimate->error, sizeof(estimate->error), "can't multiply %ux%u by %ux%u", left.num_rows,
+                 left.num_cols, right.num_rows, right.num_cols);
+        return 0;
+    }
+    unsigned int rows = left.num_rows;
+    unsigned int cols = fused_op == '*' ? right.num_cols : left.num_cols;
+    if (kind == REDUCE_TRACE && rows != cols) {
+        snprintf(estimate->error, sizeof(estimate->error), "can't take the trace of %ux%u", rows, cols);
+        return 0;
+    }
+
+    // Every reduction reads its operands once, except a plain trace, which only reads diagonals
+    unsigned long long left_values = (unsigned long long)left.num_rows * left.num_cols;
+    unsigned long long right_values = (unsigned long long)right.num_rows * right.num_cols;
+    if (kind == REDUCE_TRACE && fused_op != '*') {
+        estimate->bytes_moved += (unsigned long long)operand_count * rows * sizeof(int);
+    } else {
+        estimate->bytes_moved += (left_values + (fused_op != 0 ? right_values : 0)) * sizeof(int);
+    }
+    // Same count as Reduce: a fused product reduction does one multiply-add per entry of left
+    if (fused_op == '*') {
+        estimate->multiply_adds += left_values;
+    }
+    char kernel[16];
+    snprintf(kernel, sizeof(kernel), "%s%s", label, fused_op != 0 ? "/fused" : "");
+    AddKernel(estimate, kernel);
+
+    *live_temporary_bytes += ShapeBytes(1, 1);
+    if (*live_temporary_bytes > estimate->peak_temporary_bytes) {
+        estimate->peak_temporary_bytes = *live_temporary_bytes;
+    }
+    if (right.is_temporary) {
+        *live_temporary_bytes -= ShapeBytes(right.num_rows, right.num_cols);
+    }
+    if (operand_count == 2 && left.is_temporary) {
+        *live_temporary_bytes -= ShapeBytes(left.num_rows, left.num_cols);
+    }
+    stack[++(*stack_top)] = (ShapeEntry){1, 1, 1, 0};
+    return 1;
+}
+
+// Helper function to infer the shape of an expression and the cost of each operator in it
+static int EstimateExpression(char *rhs, const NameShape *names, StatementEstimate *estimate) {
+    char *postfix_expr = infix2postfix_sf(rhs);
+    if (postfix_expr == NULL) {
+        snprintf(estimate->error, sizeof(estimate->error), "can't convert to postfix");
+        return 0;
+    }
+    ShapeEntry *stack = malloc((strlen(postfix_expr) + 1) * sizeof(ShapeEntry));
+    int stack_top = -1;
+    unsigned long long live_temporary_bytes = 0;
+    int ok = stack != NULL;
+
+    for (const char *cursor = postfix_expr; ok && *cursor != '\0'; cursor++) {
+        char token = *cursor;
+        if (token >= 'A' && token <= 'Z') {
+            if (!names[(unsigned char)token].defined) {
+                snprintf(estimate->error, sizeof(estimate->error), "%c is not defined", token);
+                ok = 0;
+                break;
+            }
+            ShapeEntry operand = {names[(unsigned char)token].num_rows, names[(unsigned char)token].num_cols, 0, 0};
+
+            // A slice costs nothing until an operator reads it
+            if (cursor[1] == '[') {
+                unsigned int row_begin, row_end, col_begin, col_end;
+                const char *slice_end = ParseSlice(cursor + 1, operand.num_rows, operand.num_cols, &row_begin,
+                                                   &row_end, &col_begin, &col_end);
+                if (slice_end == NULL) {
+                    snprintf(estimate->error, sizeof(estimate->error), "%c[...] is out of range for %ux%u", token,
+                             operand.num_rows, operand.num_cols);
+                    ok = 0;
+                    break;
+                }
+                stack[++stack_top] = (ShapeEntry){row_end - row_begin, col_end - col_begin, 0, 1};
+                cursor = slice_end - 1;
+                continue;
+            }
+
+            // Same dispatch as EvaluateExpr: A * A' and A' * A compute one triangle of the product from A directly
+            int self_product = MatchSelfTransposeProduct(cursor);
+            char after_product = self_product != 0 ? cursor[4] : 0;
+            if (IsReduction(after_product) && CanFuseReduction((ReduceKind)after_product, '*')) {
+                self_product = 0;
+            }
+            if (self_product != 0) {
+                unsigned int dim = self_product == SELF_TIMES_TRANSPOSE ? operand.num_rows : operand.num_cols;
+                unsigned int inner = self_product == SELF_TIMES_TRANSPOSE ? operand.num_cols : operand.num_rows;
+                estimate->multiply_adds += (unsigned long long)dim * (dim + 1) / 2 * inner;
+                estimate->bytes_moved += ((unsigned long long)operand.num_rows * operand.num_cols +
+                                          (unsigned long long)dim * dim) * sizeof(int);
+                AddKernel(estimate, "syrk");
+                live_temporary_bytes += ShapeBytes(dim, dim);
+                if (live_temporary_bytes > estimate->peak_temporary_bytes) {
+                    estimate->peak_temporary_bytes = live_temporary_bytes;
+                }
+                stack[++stack_top] = (ShapeEntry){dim, dim, 1, 0};
+                cursor += 3;
+                continue;
+            }
+            stack[++stack_top] = operand;
+            continue;
+        }
+        if (token == '^') {
+            if (stack_top < 0) {
+                snprintf(estimate->error, sizeof(estimate->error), "'^' is missing an operand");
+                ok = 0;
+                break;
+            }
+            MaterializeView(&stack[stack_top], &live_temporary_bytes, estimate);
+            ShapeEntry base = stack[stack_top];
+            if (base.num_rows != base.num_cols) {
+                snprintf(estimate->error, sizeof(estimate->error), "can't raise %ux%u to a power", base.num_rows,
+                         base.num_cols);
+                ok = 0;
+                break;
+            }
+            unsigned int exponent = 0;
+            cursor = ReadPowerExponent(cursor, &exponent) - 1;
+            if (exponent == 1) {
+                continue;
+            }
+            // Same as EvaluateExpr: repeated squaring ping-pongs between two temporaries (one for the identity)
+            unsigned long long n = base.num_rows;
+            unsigned int multiplies = PowerMultiplies(exponent);
+            estimate->multiply_adds += multiplies * n * n * n;
+            estimate->bytes_moved += (exponent == 0 ? 1 : 3ULL * multiplies) * n * n * sizeof(int);
+            AddKernel(estimate, "power");
+            unsigned long long buffer_bytes = ShapeBytes(base.num_rows, base.num_cols);
+            live_temporary_bytes += (exponent == 0 ? 1 : 2) * buffer_bytes;
+            if (live_temporary_bytes > estimate->peak_temporary_bytes) {
+                estimate->peak_temporary_bytes = live_temporary_bytes;
+            }
+            live_temporary_bytes -= exponent == 0 ? 0 : buffer_bytes;
+            if (base.is_temporary) {
+                live_temporary_bytes -= buffer_bytes;
+            }
+            stack[stack_top] = (ShapeEntry){base.num_rows, base.num_cols, 1, 0};
+            continue;
+        }
+        // Same dispatch as EvaluateExpr: a reduction right after a sum (or a product it fuses with) reads that
+        // operator's operands instead of its result, unless one is a slice, and one right after a transpose ignores
+        // the transpose
+        char fused_op = 0;
+        int reads_views = stack_top >= 1 && (stack[stack_top].is_view || stack[stack_top - 1].is_view);
+        if ((token == '+' || token == '*') && IsReduction(cursor[1]) &&
+            CanFuseReduction((ReduceKind)cursor[1], token) && !reads_views) {
+            fused_op = token;
+            token = *++cursor;
+        } else if (token == '\'' && IsReduction(cursor[1])) {
+            continue;
+        }
+        if (IsReduction(token)) {
+            if (fused_op == 0 && stack_top >= 0) {
+                MaterializeView(&stack[stack_top], &live_temporary_bytes, estimate);
+            }
+            if (!EstimateReduction((ReduceKind)token, fused_op, stack, &stack_top, &live_temporary_bytes, estimate)) {
+                ok = 0;
+                break;
+            }
+            continue;
+        }
+        if (token != '\'' && token != '+' && token != '*') {
+            continue;
+        }
+
+        int operand_count = token == '\'' ? 1 : 2;
+        if (stack_top + 1 < operand_count) {
+            snprintf(estimate->error, sizeof(estimate->error), "'%c' is missing an operand", token);
+            ok = 0;
+            break;
+        }
+        ShapeEntry right = stack[stack_top--];
+        ShapeEntry left = operand_count == 2 ? stack[stack_top--] : right;
+        ShapeEntry result = {0, 0, 1, 0};
+        int strided = left.is_view || right.is_view;
+
+        // The evaluator reuses a temporary operand's storage where it can
+        int in_place = 0;
+        if (token == '\'') {
+            result.num_rows = right.num_cols;
+            result.num_cols = right.num_rows;
+            estimate->bytes_moved += 2ULL * right.num_rows * right.num_cols * sizeof(int);
+            // Same dispatch as EvaluateExpr and TransposeMatrix
+            in_place = right.is_temporary;
+            AddKernel(estimate, strided    ? "transpose/strided"
+                                : in_place ? "transpose/in-place"
+                                : FindSmallTransposeKernel(right.num_rows, right.num_cols) != NULL ? "transpose/small"
+                                                                                                   : "transpose");
+        } else if (token == '+') {
+            if (left.num_rows != right.num_rows || left.num_cols != right.num_cols) {
+                snprintf(estimate->error, sizeof(estimate->error), "can't add %ux%u and %ux%u",
+                         left.num_rows, left.num_cols, right.num_rows, right.num_cols);
+                ok = 0;
+                break;
+            }
+            result.num_rows = left.num_rows;
+            result.num_cols = left.num_cols;
+            estimate->bytes_moved += 3ULL * left.num_rows * left.num_cols * sizeof(int);
+            in_place = left.is_temporary || right.is_temporary;
+            AddKernel(estimate, strided ? "add/strided" : in_place ? "add/in-place" : "add");
+        } else {
+            if (left.num_cols != right.num_rows) {
+                snprintf(estimate->error, sizeof(estimate->error), "can't multiply %ux%u by %ux%u",
+                         left.num_rows, left.num_cols, right.num_rows, right.num_cols);
+                ok = 0;
+                break;
+            }
+            result.num_rows = left.num_rows;
+            result.num_cols = right.num_cols;
+            estimate->multiply_adds += (unsigned long long)left.num_rows * left.num_cols * right.num_cols;
+            // Each operand read once and the product written once; the i-k-j loop streams through them
+            estimate->bytes_moved += ((unsigned long long)left.num_rows * left.num_cols +
+                                      (unsigned long long)right.num_rows * right.num_cols +
+                                      (unsigned long long)result.num_rows * result.num_cols) * sizeof(int);
+            // Same dispatch as EvaluateExpr: a product about to be added to a temporary of its shape accumulates
+            // into it, and a product of slices reads them where they lie
+            ShapeEntry *accumulator = stack_top >= 0 ? &stack[stack_top] : NULL;
+            if (strided) {
+                AddKernel(estimate, "mult/strided");
+            } else if (cursor[1] == '+' && accumulator != NULL && accumulator->is_temporary &&
+                       accumulator->num_rows == result.num_rows && accumulator->num_cols == result.num_cols) {
+                AddKernel(estimate, "mult/accumulate");
+                cursor++;
+                if (right.is_temporary) {
+                    live_temporary_bytes -= ShapeBytes(right.num_rows, right.num_cols);
+                }
+                if (left.is_temporary) {
+                    live_temporary_bytes -= ShapeBytes(left.num_rows, left.num_cols);
+                }
+                continue;
+            } else {
+                int small = FindSmallMultKernel(left.num_rows, left.num_cols, right.num_cols) != NULL;
+                AddKernel(estimate, small ? "mult/small" : "mult");
+            }
+        }
+
+        if (in_place) {
+            // The result takes over a temporary operand's storage; only a second temporary operand dies
+            if (operand_count == 2 && left.is_temporary && right.is_temporary) {
+                live_temporary_bytes -= ShapeBytes(right.num_rows, right.num_cols);
+            }
+            stack[++stack_top] = result;
+            continue;
+        }
+
+        // The result is allocated while the operands are still alive; temporaries die right after
+        live_temporary_bytes += ShapeBytes(result.num_rows, result.num_cols);
+        if (live_temporary_bytes > estimate->peak_temporary_bytes) {
+            estimate->peak_temporary_bytes = live_temporary_bytes;
+        }
+        if (right.is_temporary) {
+            live_temporary_bytes -= ShapeBytes(right.num_rows, right.num_cols);
+        }
+        if (operand_count == 2 && left.is_temporary) {
+            live_temporary_bytes -= ShapeBytes(left.num_rows, left.num_cols);
+        }
+        stack[++stack_top] = result;
+    }
+
+    if (ok && stack_top < 0) {
+        snprintf(estimate->error, sizeof(estimate->error), "empty expression");
+        ok = 0;
+    }
+    if (ok) {
+        MaterializeView(&stack[stack_top], &live_temporary_bytes, estimate);
+        estimate->num_rows = stack[stack_top].num_rows;
+        estimate->num_cols = stack[stack_top].num_cols;
+        if (estimate->kernels[0] == '\0') {
+            AddKernel(estimate, "none");
+        }
+    }
+    free(stack);
+    free(postfix_expr);
+    return ok;
+}
+
+// Helper function to split and estimate one script line, recording the shape of the name it defines.
+// Returns -1 for blank lines, 0 if the statement doesn't type-check (see estimate->error) and 1 otherwise.
+static int EstimateStatement(char *line, NameShape *names, char *name, char **rhs, int *is_literal,
+                             StatementEstimate *estimate) {
+    if (!SplitStatement(line, name, rhs, is_literal)) {
+        return -1;
+    }
+    memset(estimate, 0, sizeof(*estimate));
+    int ok = *is_literal ? EstimateLiteral(*rhs, estimate) : EstimateExpression(*rhs, names, estimate);
+    if (!ok) {
+        return 0;
+    }
+
+    // The BST keeps a name's first matrix, so later definitions don't change its shape
+    NameShape *target = &names[(unsigned char)*name];
+    if (!target->defined) {
+        target->num_rows = estimate->num_rows;
+        target->num_cols = estimate->num_cols;
+        target->defined = 1;
+    }
+    return 1;
+}
+
+// What shape inference knows about a script's names after the statements seen so far
+struct ScriptValidator {
+    NameShape names[256];
+};
+
+ScriptValidator* CreateScriptValidator(void) {
+    return calloc(1, sizeof(ScriptValidator));
+}
+
+// Split a script line in place and check it against the statements validated before it
+int ValidateStatement(ScriptValidator *validator, char *line, char *name, char **rhs, int *is_literal) {
+    StatementEstimate estimate;
+    return EstimateStatement(line, validator->names, name, rhs, is_literal, &estimate);
+}
+
+// validate_script_sf on a script that is already open
+int ValidateScriptStream(FILE *file, char *error, size_t error_size) {
+    char unused_error[1];
+    if (error == NULL) {
+        error = unused_error;
+        error_size = sizeof(unused_error);
+    }
+    error[0] = '\0';
+
+    NameShape names[256] = {{0}};
+    char *line = NULL;
+    size_t line_size = 0;
+    unsigned long long line_number = 0;
+    int valid = 1;
+
+    while (valid && getline(&line, &line_size, file) != -1) {
+        line_number++;
+        char name = 0;
+        char *rhs = NULL;
+        int is_literal = 0;
+        StatementEstimate estimate;
+        if (EstimateStatement(line, names, &name, &rhs, &is_literal, &estimate) == 0) {
+            snprintf(error, error_size, "line %llu (%c): %s", line_number, name, estimate.error);
+            valid = 0;
+        }
+    }
+
+    free(line);
+    return valid;
+}
+
+int validate_script_sf(char *filename, char *error, size_t error_size) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        if (error != NULL) {
+            snprintf(error, error_size, "can't open %s", filename);
+        }
+        return 0;
+    }
+    int valid = ValidateScriptStream(file, error, error_size);
+    fclose(file);
+    return valid;
+}
+
+int explain_script_sf(char *filename, FILE *out, int analyse, script_estimate_sf *totals) {
+    script_estimate_sf local_totals;
+    if (totals == NULL) {
+        totals = &local_totals;
+    }
+    memset(totals, 0, sizeof(*totals));
+
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    pool_sf *pool = analyse ? create_pool_sf() : NULL;
+    if (analyse && pool == NULL) {
+        fclose(file);
+        return 0;
+    }
+
+    NameShape names[256] = {{0}};
+    bst_sf *root = NULL;
+    char *line = NULL;
+    size_t line_size = 0;
+
+    fprintf(out, "%5s %-4s %-11s %-*s %14s %14s %12s", "stmt", "name", "shape", KERNEL_LIST_LEN - 1, "kernels",
+            "multiply-adds", "bytes moved", "peak temps");
+    if (analyse) {
+        fprintf(out, " %12s %14s %6s", "actual ns", "actual madds", "check");
+    }
+    fprintf(out, "\n");
+
+    while (getline(&line, &line_size, file) != -1) {
+        char name = 0;
+        char *rhs = NULL;
+        int is_literal = 0;
+        StatementEstimate estimate;
+        int ok = EstimateStatement(line, names, &name, &rhs, &is_literal, &estimate);
+        if (ok < 0) {
+            continue;
+        }
+        totals->statements++;
+        if (!ok) {
+            totals->errors++;
+            fprintf(out, "%5llu %-4c error: %s\n", totals->statements, name, estimate.error);
+            continue;
+        }
+
+        totals->multiply_adds += estimate.multiply_adds;
+        totals->bytes_moved += estimate.bytes_moved;
+        if (estimate.peak_temporary_bytes > totals->peak_temporary_bytes) {
+            totals->peak_temporary_bytes = estimate.peak_temporary_bytes;
+        }
+
+        char shape[24];
+        snprintf(shape, sizeof(shape), "%ux%u", estimate.num_rows, estimate.num_cols);
+        fprintf(out, "%5llu %-4c %-11s %-*s %14llu %14llu %12llu", totals->statements, name, shape, KERNEL_LIST_LEN - 1,
+                estimate.kernels, estimate.multiply_adds, estimate.bytes_moved, estimate.peak_temporary_bytes);
+
+        if (analyse) {
+            profile_counter_sf before, after;
+            get_profile_sf(PROFILE_MULT_SF, &before);
+            unsigned long long start_time = NowNanoseconds();
+            matrix_sf *new_mat = is_literal ? create_matrix_pool_sf(name, rhs, pool)
+                                            : evaluate_expr_pool_sf(name, rhs, root, pool);
+            unsigned long long elapsed = NowNanoseconds() - start_time;
+            get_profile_sf(PROFILE_MULT_SF, &after);
+
+            int matches = new_mat != NULL && new_mat->num_rows == estimate.num_rows &&
+                          new_mat->num_cols == estimate.num_cols;
+            if (!matches) {
+                totals->errors++;
+            }
+            fprintf(out, " %12llu", elapsed);
+            if (profile_enabled_sf()) {
+                fprintf(out, " %14llu", after.multiply_adds - before.multiply_adds);
+            } else {
+                fprintf(out, " %14s", "-");
+            }
+            fprintf(out, " %6s", matches ? "ok" : "DIFF");
+            if (new_mat != NULL) {
+                root = insert_bst_pool_sf(new_mat, root, pool);
+            }
+        }
+        fprintf(out, "\n");
+    }
+
+    fprintf(out, "total: %llu statements, %llu multiply-adds, %llu bytes moved, %llu peak temporary bytes, %llu errors\n",
+            totals->statements, totals->multiply_adds, totals->bytes_moved, totals->peak_temporary_bytes, totals->errors);
+
+    free(line);
+    fclose(file);
+    free_pool_sf(pool);
+    return totals->errors == 0;
+}
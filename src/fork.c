@@ -0,0 +1,192 @@
+#include "hw7.h"
+#include "hw7_internal.h"
+
+// One subtree of a postfix expression: its span of postfix chars, the shape it evaluates to and the work in it.
+// Work is counted in multiply-adds for products and powers, and by element for sums, transposes and reductions.
+typedef struct {
+    size_t begin;
+    size_t end;
+    unsigned int num_rows;
+    unsigned int num_cols;
+    unsigned long long work;
+    int is_view;      // a slice of a named matrix
+    int fused;        // a sum or product the reduction right after it reads through instead of building
+    int children[2];  // -1 where there is no child
+} SubtreeNode;
+
+// Helper function to look up the shape of a named operand the way EvaluateExpr finds it. Returns 0 if it is undefined.
+static int OperandShape(char name, bst_sf *root, const SymbolTable *symbols, unsigned int *num_rows,
+                        unsigned int *num_cols) {
+    const matrix_sf *mat = NULL;
+    if (symbols != NULL) {
+        const MatrixHandle *handle = symbols->bound[(unsigned char)name];
+        mat = handle != NULL ? handle->mat : NULL;
+    } else {
+        mat = find_bst_sf(name, root);
+    }
+    if (mat == NULL) {
+        return 0;
+    }
+    *num_rows = mat->num_rows;
+    *num_cols = mat->num_cols;
+    return 1;
+}
+
+// Helper function to build the node of an operator over the top operand_count subtrees on the stack, estimating its
+// work with the same dispatch as EvaluateExpr: a transpose right before a reduction is never built, and neither is a
+// sum or product a reduction right after it fuses with. Returns -1 if the shapes don't fit.
+static int ApplyOperator(const char *postfix, size_t position, size_t end, SubtreeNode *nodes, int *node_count,
+                         int *stack, int *stack_top) {
+    char token = postfix[position];
+    int operand_count = token == '+' || token == '*' ? 2 : 1;
+    if (*stack_top + 1 < operand_count) {
+        return -1;
+    }
+    const SubtreeNode *right = &nodes[stack[(*stack_top)--]];
+    const SubtreeNode *left = operand_count == 2 ? &nodes[stack[(*stack_top)--]] : right;
+    SubtreeNode node = {left->begin, end, left->num_rows, left->num_cols, left->work, 0, 0, {-1, -1}};
+    node.children[0] = (int)(left - nodes);
+    unsigned long long values = (unsigned long long)left->num_rows * left->num_cols;
+    char next = postfix[end];
+
+    if (token == '+' || token == '*') {
+        node.children[1] = (int)(right - nodes);
+        node.work += right->work;
+        if (token == '+' && (left->num_rows != right->num_rows || left->num_cols != right->num_cols)) {
+            return -1;
+        }
+        if (token == '*' && left->num_cols != right->num_rows) {
+            return -1;
+        }
+        node.num_cols = right->num_cols;
+        node.fused = IsReduction(next) && CanFuseReduction((ReduceKind)next, token) && !left->is_view &&
+                     !right->is_view;
+        if (node.fused) {
+            // The reduction reads both operands once (a product: one multiply-add per entry of left)
+            node.work += token == '+' ? 2 * values : values;
+        } else {
+            node.work += token == '+' ? values : values * right->num_cols;
+        }
+    } else if (token == '\'') {
+        node.num_rows = left->num_cols;
+        node.num_cols = left->num_rows;
+        node.work += IsReduction(next) ? 0 : values;
+    } else if (token == '^') {
+        unsigned int exponent = 0;
+        ReadPowerExponent(postfix + position, &exponent);
+        if (left->num_rows != left->num_cols) {
+            return -1;
+        }
+        node.work += (unsigned long long)PowerMultiplies(exponent) * values * left->num_cols;
+    } else {
+        if (token == REDUCE_TRACE && left->num_rows != left->num_cols) {
+            return -1;
+        }
+        node.num_rows = node.num_cols = 1;
+        node.work += left->fused ? 0 : values;
+    }
+    nodes[*node_count] = node;
+    stack[++(*stack_top)] = *node_count;
+    return (*node_count)++;
+}
+
+// Helper function to check cheaply whether two subtrees of the expression could each reach grain, before any shape is
+// inferred. No operator works on more rows or columns than the largest named operand has, which bounds the whole
+// expression's work; forking needs a sum or product and twice the grain.
+static int MayReachGrain(const char *postfix, bst_sf *root, const SymbolTable *symbols, unsigned long long grain) {
+    unsigned int max_dim = 0;
+    unsigned long long cubic_terms = 0, square_terms = 0, binary_operators = 0;
+    for (const char *cursor = postfix; *cursor != '\0'; cursor++) {
+        unsigned int num_rows, num_cols;
+        if (*cursor >= 'A' && *cursor <= 'Z') {
+            if (!OperandShape(*cursor, root, symbols, &num_rows, &num_cols)) {
+                return 0;
+            }
+            max_dim = num_rows > max_dim ? num_rows : max_dim;
+            max_dim = num_cols > max_dim ? num_cols : max_dim;
+        } else if (*cursor == '*') {
+            cubic_terms++;
+            binary_operators++;
+        } else if (*cursor == '^') {
+            unsigned int exponent;
+            cursor = ReadPowerExponent(cursor, &exponent) - 1;
+            cubic_terms += PowerMultiplies(exponent);
+        } else if (*cursor == '+') {
+            square_terms += 2;
+            binary_operators++;
+        } else if (*cursor == '\'' || IsReduction(*cursor)) {
+            square_terms++;
+        }
+    }
+    double dim = max_dim;
+    double work_bound = (double)cubic_terms * dim * dim * dim + (double)square_terms * dim * dim;
+    return binary_operators > 0 && work_bound >= 2.0 * (double)grain;
+}
+
+int PlanFork(const char *postfix, bst_sf *root, const SymbolTable *symbols, ForkPlan *plan) {
+    // Subtrees of fewer multiply-adds than the tuned grain stay on the thread evaluating their parent: starting a
+    // thread costs tens of microseconds, about what a million multiply-adds take
+    unsigned long long grain = Tuning()->fork_min_madds;
+    if (grain == 0 || !MayReachGrain(postfix, root, symbols, grain)) {
+        return 0;
+    }
+
+    size_t length = strlen(postfix);
+    SubtreeNode *nodes = malloc((length + 1) * sizeof(SubtreeNode));
+    int *stack = malloc((length + 1) * sizeof(int));
+    int node_count = 0, stack_top = -1, ok = nodes != NULL && stack != NULL;
+
+    // Shape inference over the whole expression, one node per operand and operator
+    for (size_t position = 0; ok && position < length;) {
+        char token = postfix[position];
+        size_t end = position + 1;
+        if (token >= 'A' && token <= 'Z') {
+            SubtreeNode node = {position, end, 0, 0, 0, 0, 0, {-1, -1}};
+            ok = OperandShape(token, root, symbols, &node.num_rows, &node.num_cols);
+            if (ok && postfix[end] == '[') {
+                unsigned int row_begin, row_end, col_begin, col_end;
+                const char *slice_end = ParseSlice(postfix + end, node.num_rows, node.num_cols, &row_begin, &row_end,
+                                                   &col_begin, &col_end);
+                ok = slice_end != NULL;
+                if (ok) {
+                    node.end = end = (size_t)(slice_end - postfix);
+                    node.num_rows = row_end - row_begin;
+                    node.num_cols = col_end - col_begin;
+                    node.is_view = 1;
+                }
+            }
+            nodes[node_count] = node;
+            stack[++stack_top] = node_count++;
+        } else if (token == '+' || token == '*' || token == '\'' || token == '^' || IsReduction(token)) {
+            if (token == '^') {
+                unsigned int exponent;
+                end = (size_t)(ReadPowerExponent(postfix + position, &exponent) - postfix);
+            }
+            ok = ApplyOperator(postfix, position, end, nodes, &node_count, stack, &stack_top) >= 0;
+        }
+        position = end;
+    }
+    ok = ok && stack_top == 0;
+
+    // Walk down from the root along the expensive side until both children of a node are worth a thread of their own
+    int found = 0;
+    for (int node = ok ? stack[0] : -1; node >= 0 && !found;) {
+        const SubtreeNode *current = &nodes[node];
+        int left = current->children[0], right = current->children[1];
+        if (left >= 0 && right >= 0 && nodes[left].work >= grain && nodes[right].work >= grain) {
+            plan->begin = nodes[left].begin;
+            plan->middle = nodes[right].begin;
+            plan->end = nodes[right].end;
+            found = 1;
+        } else if (left >= 0 && nodes[left].work >= grain) {
+            node = left;
+        } else if (right >= 0 && nodes[right].work >= grain) {
+            node = right;
+        } else {
+            node = -1;
+        }
+    }
+    free(nodes);
+    free(stack);
+    return found;
+}
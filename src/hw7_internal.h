@@ -0,0 +1,216 @@
+// Helpers shared between the source files in src/. Not part of the public interface in hw7.h.
+#ifndef __HW7_INTERNAL
+#define __HW7_INTERNAL
+
+#include <limits.h>
+#include <stdatomic.h>
+
+#include "hw7.h"
+
+// Split a script line "N = rhs" into the matrix name and right-hand side, in place.
+// Returns 0 for blank lines. A right-hand side starting with a digit is a matrix literal.
+int SplitStatement(char *line, char *name, char **rhs, int *is_literal);
+// Parse the "rows cols [" a matrix literal starts with; returns the position past the '[', or NULL if there is none
+const char* ParseLiteralHeader(const char *expr, unsigned int *num_rows, unsigned int *num_cols);
+// validate_script_sf on a script that is already open, read to its end
+int ValidateScriptStream(FILE *file, char *error, size_t error_size);
+// Shape inference over a script read one statement at a time; free it with free()
+typedef struct ScriptValidator ScriptValidator;
+ScriptValidator* CreateScriptValidator(void);
+// Split line in place, as SplitStatement does, and check the statement against the ones validated before it.
+// Returns -1 for blank lines, 0 if the statement is malformed or doesn't type-check and 1 otherwise.
+int ValidateStatement(ScriptValidator *validator, char *line, char *name, char **rhs, int *is_literal);
+// Read a whole script file into a malloc'ed buffer of *length bytes (not NUL-terminated), or NULL if it can't be read
+char* ReadScriptText(const char *filename, size_t *length);
+// Validate a script already read into text. Returns a stream over text, whose statements are exactly the ones
+// validated, or NULL if it doesn't validate. Close the stream before freeing text.
+FILE* OpenValidatedText(char *text, size_t length);
+// Copy a matrix (for example one living in a pool) into its own malloc'ed block
+matrix_sf* DetachMatrix(const matrix_sf *mat);
+// What is known about a matrix's zero pattern (see structure.c). Kept beside matrices the library made,
+// never in matrix_sf itself, whose callers allocate it without any such field.
+typedef enum {
+    STRUCTURE_GENERAL,
+    STRUCTURE_DIAGONAL,   // also upper, lower and symmetric
+    STRUCTURE_UPPER,      // zero below the diagonal
+    STRUCTURE_LOWER,      // zero above the diagonal
+    STRUCTURE_SYMMETRIC
+} MatrixStructure;
+// Square matrices smaller than this are always treated as general; scanning them would cost more than it saves
+#define STRUCTURE_MIN_DIM 16
+// Scan mat for structure; general matrices are usually recognised within the first few rows
+MatrixStructure ClassifyStructure(const matrix_sf *mat);
+// Structure of the transpose, sum and product of matrices with known structure
+MatrixStructure TransposedStructure(MatrixStructure structure);
+MatrixStructure SumStructure(MatrixStructure left, MatrixStructure right);
+MatrixStructure ProductStructure(MatrixStructure left, MatrixStructure right);
+// result = mat1 * mat2, skipping the zero regions of a diagonal or triangular operand. Returns 0 (doing nothing)
+// if neither operand has such structure.
+int MultStructured(matrix_sf *result, const matrix_sf *mat1, MatrixStructure left, const matrix_sf *mat2,
+                   MatrixStructure right);
+// result = mat1 + mat2 when one of them is diagonal, touching only the diagonal if result is the other one's storage.
+// Returns 0 (doing nothing) if neither is diagonal, or if result is the diagonal one's storage.
+int AddStructured(matrix_sf *result, const matrix_sf *mat1, MatrixStructure left, const matrix_sf *mat2,
+                  MatrixStructure right);
+// result = mat * mat' and result = mat' * mat (SYRK): only one triangle is computed, then mirrored
+void MultByOwnTranspose(matrix_sf *result, const matrix_sf *mat);
+void MultOwnTransposeBy(matrix_sf *result, const matrix_sf *mat);
+// Recognise "X X ' *" (X * X') or "X ' X *" (X' * X) at the start of a postfix string; returns 0 for neither
+#define SELF_TIMES_TRANSPOSE 1
+#define TRANSPOSE_TIMES_SELF 2
+int MatchSelfTransposeProduct(const char *postfix);
+
+// A matrix shared by every script name bound to it, plus the script's latest result while it is that
+typedef struct {
+    matrix_sf *mat;  // mat->name is the name it was built for, not necessarily every name bound to it
+    unsigned int refs;
+    int releasable;  // 0 for matrices owned by another pool; those only go away with that pool
+    MatrixStructure structure;
+} MatrixHandle;
+// The names a script run has defined. Replaces the BST so that several names can share one matrix.
+typedef struct {
+    MatrixHandle *bound[UCHAR_MAX + 1];  // first definition of each name, as in insert_bst_sf
+    unsigned char sealed[UCHAR_MAX + 1]; // names bound before the last SealSymbols; their next definition rebinds them
+    MatrixHandle *last;                  // result of the latest statement
+    char last_name;
+    pool_sf *pool;                       // where the handles and releasable matrices live
+} SymbolTable;
+// Start an empty symbol table whose handles (and releasable matrices) live in pool
+void InitSymbols(SymbolTable *symbols, pool_sf *pool);
+// Let the next definition of every name bound so far replace it, so a daemon request can redefine what an earlier
+// request defined. Within a request the first definition still wins.
+void SealSymbols(SymbolTable *symbols);
+// Define name as a matrix just built for it (NULL passes through). Returns the matrix now defined.
+matrix_sf* DefineMatrix(SymbolTable *symbols, char name, matrix_sf *mat, int releasable);
+// Define name by evaluating an expression. Without check_shapes the per-operator shape checks are skipped, which is
+// only safe for statements validate_script_sf has accepted. "B = A" makes B share A's matrix without a copy.
+matrix_sf* DefineExpression(SymbolTable *symbols, char name, char *expr, int check_shapes);
+// Evaluate expr against symbols, which it only reads, with the shape checks. The result is a new malloc'ed matrix.
+matrix_sf* EvaluateSymbols(char name, char *expr, const SymbolTable *symbols);
+// A malloc'ed copy of the latest statement's result, named after that statement
+matrix_sf* DetachResult(const SymbolTable *symbols);
+// The tuning the kernels run with, loaded from the tuning profile on first use (see tune.c)
+const tuning_sf* Tuning(void);
+// Fully unrolled kernels for small shapes (see small_kernels.c). Values are row-major, as in matrix_sf.
+typedef void (*SmallMultKernel)(int *result, const int *left, const int *right);
+typedef void (*SmallTransposeKernel)(int *result, const int *mat);
+// The specialised kernel for a (rows x inner) * (inner x cols) product, or NULL
+SmallMultKernel FindSmallMultKernel(unsigned int rows, unsigned int inner, unsigned int cols);
+// The specialised kernel for transposing a rows x cols matrix, or NULL
+SmallTransposeKernel FindSmallTransposeKernel(unsigned int rows, unsigned int cols);
+// Result cache (see cache.c). Keys are two independently seeded XXH64 hashes.
+typedef struct {
+    uint64_t low;
+    uint64_t high;
+} CacheKey;
+// Key of one statement's right-hand side. An operand name stands for content_ids[name], the key its matrix was
+// built under, so equal keys mean equal inputs all the way back to the literals. Returns 0 if out of memory.
+int StatementKey(const char *rhs, int is_literal, const CacheKey *content_ids, CacheKey *key);
+// Key of a whole script, already read into text, and the name its result gets. Returns 0 if it has no statements.
+int ScriptKey(const char *text, size_t length, CacheKey *key, char *last_name);
+// A copy of the cached matrix in pool (malloc'ed when pool is NULL), or NULL on a miss. Counts a hit or miss.
+matrix_sf* CacheLookup(cache_sf *cache, CacheKey key, pool_sf *pool);
+// Store a copy of mat under key
+void CacheInsert(cache_sf *cache, CacheKey key, const matrix_sf *mat);
+// Number of threads create_matrix_sf parses a literal of element_count values and length bytes on
+unsigned int LiteralParseThreads(unsigned long long element_count, size_t length);
+// Reductions of the expression language, as they appear in postfix form: trace(X) is 't', sum(X) is 's' and norm(X),
+// the sum of X's squared entries, is 'n'
+typedef enum {
+    REDUCE_TRACE = 't',
+    REDUCE_SUM = 's',
+    REDUCE_NORM = 'n'
+} ReduceKind;
+// Whether a postfix token is a reduction
+int IsReduction(char token);
+// Whether kind of an operator's result ('+' or '*') can be computed from its operands without building the result
+int CanFuseReduction(ReduceKind kind, char op);
+// kind of left (op 0), of left + right (op '+') or of left * right (op '*'), without building the sum or product.
+// The caller has checked the shapes, including that trace's argument is square. Sums wrap like int arithmetic.
+// Large inputs are split across cores. Returns 0 if a product's scratch row sums can't be allocated.
+int Reduce(ReduceKind kind, char op, const matrix_sf *left, const matrix_sf *right, int *value);
+
+// A read-only window onto num_rows x num_cols entries of a matrix whose rows lie stride entries apart. Slices such as
+// A[2:5, :] are evaluated as views of A, so taking one costs the same however large the block is.
+typedef struct {
+    const int *values;
+    unsigned int num_rows;
+    unsigned int num_cols;
+    unsigned int stride;
+} MatrixView;
+// The view of all of mat
+MatrixView WholeMatrix(const matrix_sf *mat);
+// Parse a slice "[rows,cols]" of a num_rows x num_cols matrix, each range being "a:b" (half-open), "a:", ":b", ":"
+// or a single index "a". Returns the first char after ']', or NULL if the slice is malformed, empty or out of range.
+const char* ParseSlice(const char *cursor, unsigned int num_rows, unsigned int num_cols, unsigned int *row_begin,
+                       unsigned int *row_end, unsigned int *col_begin, unsigned int *col_end);
+// Kernels reading strided views; result is a whole matrix of the right shape, which may share storage with an
+// operand only for AddViews
+void CopyView(matrix_sf *result, MatrixView mat);
+void AddViews(matrix_sf *result, MatrixView left, MatrixView right);
+void MultViews(matrix_sf *result, MatrixView left, MatrixView right);
+void TransposeView(matrix_sf *result, MatrixView mat);
+
+// Two sibling subtrees of a postfix expression, [begin, middle) and [middle, end), each expensive enough to be
+// evaluated on a thread of its own (see fork.c)
+typedef struct {
+    size_t begin;
+    size_t middle;
+    size_t end;
+} ForkPlan;
+// Estimate the work of every subtree of postfix and find the pair of siblings nearest the root that are both worth a
+// thread. Returns 0 if there is none, or if the expression doesn't type-check (the evaluator reports that).
+// Expressions too small for any such pair are turned away before anything is allocated.
+int PlanFork(const char *postfix, bst_sf *root, const SymbolTable *symbols, ForkPlan *plan);
+
+// Exponent of the '^' at power_operator in a postfix string, whose decimal digits follow it. Returns where they end.
+const char* ReadPowerExponent(const char *power_operator, unsigned int *exponent);
+// Number of multiplies repeated squaring takes to raise a matrix to exponent
+unsigned int PowerMultiplies(unsigned int exponent);
+// Monotonic clock in nanoseconds, for the stats the executors report
+unsigned long long NowNanoseconds(void);
+
+// A unit of work for RunParallel; task_index runs from 0 to task_count - 1
+typedef void (*ParallelTask)(void *arg, unsigned int task_index);
+// Number of threads the library may use in all (HW7_THREADS overrides the online core count)
+unsigned int AvailableCores(void);
+// Number of threads the code running on this thread may split its work across: AvailableCores(), or less inside a
+// forked subtree. Kernels size their task counts by it.
+unsigned int ParallelWidth(void);
+// Set this thread's ParallelWidth (0 for AvailableCores()) and return the previous setting, for restoring it
+unsigned int LimitParallelWidth(unsigned int width);
+// Run task(arg, 0) ... task(arg, task_count - 1) concurrently on the shared worker pool and wait for all of them.
+// Tasks may call RunParallel themselves, and run with their caller's ParallelWidth.
+void RunParallel(unsigned int task_count, ParallelTask task, void *arg);
+
+// Profiling hooks. They compile to nothing unless HW7_PROFILE is defined, so the arguments cost nothing either.
+#ifdef HW7_PROFILE
+unsigned long long ProfileCycles(void);
+void ProfileRecord(profile_op_sf op, unsigned long long cycles, unsigned long long bytes, unsigned long long multiply_adds);
+// Start timing op; pairs with PROFILE_END(op, ...) later in the same scope
+#define PROFILE_BEGIN(op) unsigned long long profile_start_##op = ProfileCycles()
+// Count one call of op, with the cycles since PROFILE_BEGIN(op)
+#define PROFILE_END(op, bytes, multiply_adds) \
+    ProfileRecord(op, ProfileCycles() - profile_start_##op, bytes, multiply_adds)
+#else
+#define PROFILE_BEGIN(op) ((void)0)
+#define PROFILE_END(op, bytes, multiply_adds) ((void)0)
+#endif
+
+// Event tracing hooks (see trace.c). While tracing is off each one costs a single relaxed load.
+extern atomic_int TraceActive;
+void TraceRecord(char phase, const char *event, char matrix_name, unsigned long long statement,
+                 const matrix_sf *first, const matrix_sf *second);
+#define TRACE_IF_ACTIVE(...) \
+    do { \
+        if (atomic_load_explicit(&TraceActive, memory_order_relaxed)) { \
+            TraceRecord(__VA_ARGS__); \
+        } \
+    } while (0)
+// Statements are numbered from 1 in script order
+#define TRACE_STATEMENT_BEGIN(matrix_name, statement) TRACE_IF_ACTIVE('B', "statement", matrix_name, statement, NULL, NULL)
+#define TRACE_STATEMENT_END(matrix_name, statement, result) TRACE_IF_ACTIVE('E', "statement", matrix_name, statement, result, NULL)
+#define TRACE_OP_BEGIN(op, left, right) TRACE_IF_ACTIVE('B', op, 0, 0, left, right)
+#define TRACE_OP_END(op, result) TRACE_IF_ACTIVE('E', op, 0, 0, result, NULL)
+
+#endif // __HW7_INTERNAL
@@ -0,0 +1,231 @@
+#include <errno.h>
+#include <fcntl.h>
+
+#include "hw7.h"
+
+// Longest text form of one value: sign, 10 digits and the separator
+#define MAX_VALUE_TEXT 12
+
+// Every pair of decimal digits, so each division by 100 emits two characters at once
+static const char DigitPairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// Helper function to write all of buffer to fd, retrying short writes
+static int WriteFully(int fd, const char *buffer, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, buffer, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        buffer += written;
+        length -= (size_t)written;
+    }
+    return 1;
+}
+
+// Helper function to append the decimal form of value at cursor, returns the new end
+static char* FormatInteger(char *cursor, long long value) {
+    unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+    if (value < 0) {
+        *cursor++ = '-';
+    }
+
+    // Build the digits right to left in a scratch buffer, then copy them out in order
+    char digits[20];
+    char *digit_cursor = digits + sizeof(digits);
+    while (magnitude >= 100) {
+        unsigned int pair = (unsigned int)(magnitude % 100) * 2;
+        magnitude /= 100;
+        *--digit_cursor = DigitPairs[pair + 1];
+        *--digit_cursor = DigitPairs[pair];
+    }
+    if (magnitude >= 10) {
+        unsigned int pair = (unsigned int)magnitude * 2;
+        *--digit_cursor = DigitPairs[pair + 1];
+        *--digit_cursor = DigitPairs[pair];
+    } else {
+        *--digit_cursor = (char)('0' + magnitude);
+    }
+
+    size_t digit_count = (size_t)(digits + sizeof(digits) - digit_cursor);
+    memcpy(cursor, digit_cursor, digit_count);
+    return cursor + digit_count;
+}
+
+// Helper function to make sure at least needed bytes are free in the buffer
+static int ReserveSpace(matrix_writer_sf *writer, size_t needed) {
+    if (writer->used + needed <= WRITER_BUFFER_SIZE) {
+        return 1;
+    }
+    return flush_writer_sf(writer);
+}
+
+void init_writer_sf(matrix_writer_sf *writer, int fd, matrix_format_sf format) {
+    writer->fd = fd;
+    writer->format = format;
+    writer->used = 0;
+    writer->values_left = 0;
+    writer->failed = 0;
+}
+
+int flush_writer_sf(matrix_writer_sf *writer) {
+    if (writer->failed) {
+        return 0;
+    }
+    if (!WriteFully(writer->fd, writer->buffer, writer->used)) {
+        writer->failed = 1;
+        return 0;
+    }
+    writer->used = 0;
+    return 1;
+}
+
+int write_matrix_header_sf(matrix_writer_sf *writer, unsigned int num_rows, unsigned int num_cols) {
+    if (!ReserveSpace(writer, sizeof(matrix_file_header_sf) + 2 * MAX_VALUE_TEXT)) {
+        return 0;
+    }
+    writer->values_left = (unsigned long long)num_rows * num_cols;
+
+    if (writer->format == MATRIX_BINARY_SF) {
+        matrix_file_header_sf header;
+        memcpy(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic));
+        header.num_rows = num_rows;
+        header.num_cols = num_cols;
+        header.reserved = 0;
+        memcpy(writer->buffer + writer->used, &header, sizeof(header));
+        writer->used += sizeof(header);
+        return 1;
+    }
+
+    // Same layout as the old printf-based print_matrix_sf: "rows cols v v ... v\n"
+    char *cursor = writer->buffer + writer->used;
+    cursor = FormatInteger(cursor, num_rows);
+    *cursor++ = ' ';
+    cursor = FormatInteger(cursor, num_cols);
+    *cursor++ = ' ';
+    if (writer->values_left == 0) {
+        *cursor++ = '\n';
+    }
+    writer->used = (size_t)(cursor - writer->buffer);
+    return 1;
+}
+
+int write_matrix_row_sf(matrix_writer_sf *writer, const int *row, unsigned int num_cols) {
+    if (writer->failed) {
+        return 0;
+    }
+
+    if (writer->format == MATRIX_BINARY_SF) {
+        const char *bytes = (const char *)row;
+        size_t bytes_left = (size_t)num_cols * sizeof(int);
+        while (bytes_left > 0) {
+            if (writer->used == WRITER_BUFFER_SIZE && !flush_writer_sf(writer)) {
+                return 0;
+            }
+            size_t chunk = WRITER_BUFFER_SIZE - writer->used;
+            if (chunk > bytes_left) {
+                chunk = bytes_left;
+            }
+            memcpy(writer->buffer + writer->used, bytes, chunk);
+            writer->used += chunk;
+            bytes += chunk;
+            bytes_left -= chunk;
+        }
+        writer->values_left -= num_cols;
+        return 1;
+    }
+
+    for (unsigned int col = 0; col < num_cols; col++) {
+        if (!ReserveSpace(writer, MAX_VALUE_TEXT)) {
+            return 0;
+        }
+        char *cursor = FormatInteger(writer->buffer + writer->used, row[col]);
+        writer->values_left--;
+        *cursor++ = writer->values_left == 0 ? '\n' : ' ';
+        writer->used = (size_t)(cursor - writer->buffer);
+    }
+    return 1;
+}
+
+int write_matrix_sf(matrix_writer_sf *writer, const matrix_sf *mat) {
+    if (mat == NULL || !write_matrix_header_sf(writer, mat->num_rows, mat->num_cols)) {
+        return 0;
+    }
+    for (unsigned int row = 0; row < mat->num_rows; row++) {
+        if (!write_matrix_row_sf(writer, mat->values + (size_t)row * mat->num_cols, mat->num_cols)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int save_matrix_sf(const char *filename, const matrix_sf *mat, matrix_format_sf format) {
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return 0;
+    }
+
+    matrix_writer_sf *writer = malloc(sizeof(matrix_writer_sf));
+    if (writer == NULL) {
+        close(fd);
+        return 0;
+    }
+    init_writer_sf(writer, fd, format);
+    int saved = write_matrix_sf(writer, mat) && flush_writer_sf(writer);
+    free(writer);
+
+    if (close(fd) != 0) {
+        saved = 0;
+    }
+    return saved;
+}
+
+matrix_sf* load_matrix_sf(const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    matrix_file_header_sf header;
+    matrix_sf *mat = NULL;
+    if (read(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+        memcmp(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic)) == 0) {
+        size_t value_bytes = (size_t)header.num_rows * header.num_cols * sizeof(int);
+        mat = malloc(sizeof(matrix_sf) + value_bytes);
+        if (mat != NULL) {
+            mat->name = '?';
+            mat->num_rows = header.num_rows;
+            mat->num_cols = header.num_cols;
+
+            char *cursor = (char *)mat->values;
+            while (value_bytes > 0) {
+                ssize_t got = read(fd, cursor, value_bytes);
+                if (got < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (got <= 0) {
+                    free(mat);
+                    mat = NULL;
+                    break;
+                }
+                cursor += got;
+                value_bytes -= (size_t)got;
+            }
+        }
+    }
+
+    close(fd);
+    return mat;
+}
@@ -0,0 +1,364 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hw7.h"
+
+// Tiles are kept a multiple of this so rows of a packed tile stay cache-line aligned
+#define OOC_TILE_QUANTUM 16
+#define OOC_MIN_BUDGET (64 * 1024)
+
+// A binary matrix file mapped read-only
+typedef struct {
+    int fd;
+    size_t mapped_bytes;
+    const unsigned char *mapping;
+    const int *values;
+    unsigned int num_rows;
+    unsigned int num_cols;
+} MappedMatrix;
+
+// One step of the tiled loop: the A(i,k) and B(k,j) tiles multiplied into C(i,j)
+typedef struct {
+    unsigned int row_start, row_count;
+    unsigned int col_start, col_count;
+    unsigned int shared_start, shared_count;
+} TileStep;
+
+// State shared between the compute thread and the prefetch thread
+typedef struct {
+    const MappedMatrix *left;
+    const MappedMatrix *right;
+    unsigned int tile_size;
+    unsigned long long step_count;
+    // Two slots: the prefetcher packs step n into slot n % 2 while step n - 1 is being computed
+    int *left_tiles[2];
+    int *right_tiles[2];
+    TileStep steps[2];
+    int slot_ready[2];
+    int stop;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} TilePipeline;
+
+// Helper function to map a binary matrix file and validate its header
+static int MapMatrixFile(const char *filename, MappedMatrix *mapped) {
+    mapped->fd = open(filename, O_RDONLY);
+    if (mapped->fd < 0) {
+        return 0;
+    }
+
+    struct stat file_info;
+    matrix_file_header_sf header;
+    if (fstat(mapped->fd, &file_info) != 0 || (size_t)file_info.st_size < sizeof(header) ||
+        pread(mapped->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic)) != 0) {
+        close(mapped->fd);
+        return 0;
+    }
+
+    size_t expected_bytes = sizeof(header) + (size_t)header.num_rows * header.num_cols * sizeof(int);
+    if ((size_t)file_info.st_size < expected_bytes) {
+        close(mapped->fd);
+        return 0;
+    }
+
+    void *mapping = mmap(NULL, expected_bytes, PROT_READ, MAP_SHARED, mapped->fd, 0);
+    if (mapping == MAP_FAILED) {
+        close(mapped->fd);
+        return 0;
+    }
+    madvise(mapping, expected_bytes, MADV_SEQUENTIAL);
+
+    mapped->mapped_bytes = expected_bytes;
+    mapped->mapping = mapping;
+    mapped->values = (const int *)(mapped->mapping + sizeof(header));
+    mapped->num_rows = header.num_rows;
+    mapped->num_cols = header.num_cols;
+    return 1;
+}
+
+static void UnmapMatrixFile(MappedMatrix *mapped) {
+    munmap((void *)mapped->mapping, mapped->mapped_bytes);
+    close(mapped->fd);
+}
+
+// Helper function to pass advice for the whole pages covering rows [row_start, row_start + row_count)
+static void AdviseRows(const MappedMatrix *mapped, unsigned int row_start, unsigned int row_count, int advice) {
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t first_byte = sizeof(matrix_file_header_sf) + (size_t)row_start * mapped->num_cols * sizeof(int);
+    size_t end_byte = first_byte + (size_t)row_count * mapped->num_cols * sizeof(int);
+    if (advice == MADV_DONTNEED) {
+        // Only pages entirely inside the range can be dropped
+        first_byte = (first_byte + page_size - 1) / page_size * page_size;
+        end_byte = end_byte / page_size * page_size;
+    } else {
+        first_byte = first_byte / page_size * page_size;
+    }
+    if (end_byte > first_byte) {
+        madvise((void *)(mapped->mapping + first_byte), end_byte - first_byte, advice);
+    }
+}
+
+// Helper function to pick a square tile size so that all five tile buffers fit in memory_budget. A tile is never
+// bigger than largest_dim (rounded up), since a bigger one would only be allocated, never filled.
+static unsigned int ChooseTileSize(size_t memory_budget, unsigned int largest_dim) {
+    if (memory_budget < OOC_MIN_BUDGET) {
+        memory_budget = OOC_MIN_BUDGET;
+    }
+    // Two left tiles, two right tiles and one result tile
+    double tile_size = sqrt((double)memory_budget / (5.0 * sizeof(int)));
+    double largest_tile = ceil((double)largest_dim / OOC_TILE_QUANTUM) * OOC_TILE_QUANTUM;
+    if (tile_size > largest_tile) {
+        tile_size = largest_tile;
+    }
+    unsigned int rounded_size = (unsigned int)tile_size / OOC_TILE_QUANTUM * OOC_TILE_QUANTUM;
+    return rounded_size < OOC_TILE_QUANTUM ? OOC_TILE_QUANTUM : rounded_size;
+}
+
+// Helper function to describe step number step_index of the (row tile, col tile, shared tile) loop
+static TileStep DescribeStep(const TilePipeline *pipeline, unsigned long long step_index) {
+    unsigned int tile = pipeline->tile_size;
+    unsigned long long shared_tiles = (pipeline->left->num_cols + tile - 1) / tile;
+    unsigned long long col_tiles = (pipeline->right->num_cols + tile - 1) / tile;
+
+    TileStep step;
+    step.shared_start = (unsigned int)(step_index % shared_tiles) * tile;
+    step.col_start = (unsigned int)(step_index / shared_tiles % col_tiles) * tile;
+    step.row_start = (unsigned int)(step_index / shared_tiles / col_tiles) * tile;
+
+    step.row_count = pipeline->left->num_rows - step.row_start;
+    step.col_count = pipeline->right->num_cols - step.col_start;
+    step.shared_count = pipeline->left->num_cols - step.shared_start;
+    if (step.row_count > tile) step.row_count = tile;
+    if (step.col_count > tile) step.col_count = tile;
+    if (step.shared_count > tile) step.shared_count = tile;
+    return step;
+}
+
+// Helper function to copy the operand tiles of step into contiguous buffers (this is where page faults happen)
+static void PackTiles(const TilePipeline *pipeline, const TileStep *step, int *left_tile, int *right_tile) {
+    const MappedMatrix *left = pipeline->left;
+    const MappedMatrix *right = pipeline->right;
+    for (unsigned int row = 0; row < step->row_count; row++) {
+        memcpy(left_tile + (size_t)row * step->shared_count,
+               left->values + (size_t)(step->row_start + row) * left->num_cols + step->shared_start,
+               step->shared_count * sizeof(int));
+    }
+    for (unsigned int shared_idx = 0; shared_idx < step->shared_count; shared_idx++) {
+        memcpy(right_tile + (size_t)shared_idx * step->col_count,
+               right->values + (size_t)(step->shared_start + shared_idx) * right->num_cols + step->col_start,
+               step->col_count * sizeof(int));
+    }
+}
+
+// Prefetch thread: reads tiles ahead of the compute loop so disk reads overlap the multiply
+static void* PrefetchTiles(void *arg) {
+    TilePipeline *pipeline = arg;
+    for (unsigned long long step_index = 0; step_index < pipeline->step_count; step_index++) {
+        int slot = (int)(step_index % 2);
+
+        pthread_mutex_lock(&pipeline->lock);
+        while (pipeline->slot_ready[slot] && !pipeline->stop) {
+            pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+        }
+        int stop = pipeline->stop;
+        pthread_mutex_unlock(&pipeline->lock);
+        if (stop) {
+            break;
+        }
+
+        TileStep step = DescribeStep(pipeline, step_index);
+        PackTiles(pipeline, &step, pipeline->left_tiles[slot], pipeline->right_tiles[slot]);
+
+        // Ask the kernel to start reading the rows the step after next will need
+        if (step_index + 2 < pipeline->step_count) {
+            TileStep later_step = DescribeStep(pipeline, step_index + 2);
+            AdviseRows(pipeline->left, later_step.row_start, later_step.row_count, MADV_WILLNEED);
+            AdviseRows(pipeline->right, later_step.shared_start, later_step.shared_count, MADV_WILLNEED);
+        }
+
+        pthread_mutex_lock(&pipeline->lock);
+        pipeline->steps[slot] = step;
+        pipeline->slot_ready[slot] = 1;
+        pthread_cond_broadcast(&pipeline->changed);
+        pthread_mutex_unlock(&pipeline->lock);
+    }
+    return NULL;
+}
+
+// Helper function to accumulate a packed left tile times a packed right tile into result_tile
+static void MultiplyTiles(int *result_tile, unsigned int result_stride, const int *left_tile, const int *right_tile, const TileStep *step) {
+    for (unsigned int row = 0; row < step->row_count; row++) {
+        int *result_row = result_tile + (size_t)row * result_stride;
+        for (unsigned int shared_idx = 0; shared_idx < step->shared_count; shared_idx++) {
+            int left_value = left_tile[(size_t)row * step->shared_count + shared_idx];
+            const int *right_row = right_tile + (size_t)shared_idx * step->col_count;
+            for (unsigned int col = 0; col < step->col_count; col++) {
+                result_row[col] += left_value * right_row[col];
+            }
+        }
+    }
+}
+
+// Helper function to write a finished result tile into its place in the output file
+static int WriteResultTile(int fd, unsigned int result_cols, const int *result_tile, unsigned int tile_stride, const TileStep *step) {
+    for (unsigned int row = 0; row < step->row_count; row++) {
+        off_t offset = (off_t)(sizeof(matrix_file_header_sf) + ((size_t)(step->row_start + row) * result_cols + step->col_start) * sizeof(int));
+        const char *bytes = (const char *)(result_tile + (size_t)row * tile_stride);
+        size_t bytes_left = step->col_count * sizeof(int);
+        while (bytes_left > 0) {
+            ssize_t written = pwrite(fd, bytes, bytes_left, offset);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return 0;
+            }
+            bytes += written;
+            bytes_left -= (size_t)written;
+            offset += written;
+        }
+    }
+    return 1;
+}
+
+// Helper function to create the output file with its header and full size
+static int CreateResultFile(const char *filename, unsigned int num_rows, unsigned int num_cols) {
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    matrix_file_header_sf header;
+    memcpy(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic));
+    header.num_rows = num_rows;
+    header.num_cols = num_cols;
+    header.reserved = 0;
+    off_t file_size = (off_t)(sizeof(header) + (size_t)num_rows * num_cols * sizeof(int));
+    if (pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || ftruncate(fd, file_size) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Helper function to run the tiled multiply with the prefetch thread feeding it
+static int RunTiledMultiply(TilePipeline *pipeline, int result_fd, int *result_tile) {
+    pthread_t prefetcher;
+    if (pthread_create(&prefetcher, NULL, PrefetchTiles, pipeline) != 0) {
+        return 0;
+    }
+
+    unsigned int tile = pipeline->tile_size;
+    int succeeded = 1;
+    for (unsigned long long step_index = 0; step_index < pipeline->step_count && succeeded; step_index++) {
+        int slot = (int)(step_index % 2);
+
+        pthread_mutex_lock(&pipeline->lock);
+        while (!pipeline->slot_ready[slot]) {
+            pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+        }
+        TileStep step = pipeline->steps[slot];
+        pthread_mutex_unlock(&pipeline->lock);
+
+        if (step.shared_start == 0) {
+            memset(result_tile, 0, (size_t)tile * tile * sizeof(int));
+        }
+        MultiplyTiles(result_tile, tile, pipeline->left_tiles[slot], pipeline->right_tiles[slot], &step);
+
+        pthread_mutex_lock(&pipeline->lock);
+        pipeline->slot_ready[slot] = 0;
+        pthread_cond_broadcast(&pipeline->changed);
+        pthread_mutex_unlock(&pipeline->lock);
+
+        // Last shared tile: C(i,j) is complete
+        if (step.shared_start + step.shared_count == pipeline->left->num_cols) {
+            succeeded = WriteResultTile(result_fd, pipeline->right->num_cols, result_tile, tile, &step);
+            // Last column tile: this band of left rows won't be read again
+            if (step.col_start + step.col_count == pipeline->right->num_cols) {
+                AdviseRows(pipeline->left, step.row_start, step.row_count, MADV_DONTNEED);
+                AdviseRows(pipeline->right, 0, pipeline->right->num_rows, MADV_DONTNEED);
+            }
+        }
+    }
+
+    if (!succeeded) {
+        pthread_mutex_lock(&pipeline->lock);
+        pipeline->stop = 1;
+        pthread_cond_broadcast(&pipeline->changed);
+        pthread_mutex_unlock(&pipeline->lock);
+    }
+    pthread_join(prefetcher, NULL);
+    return succeeded;
+}
+
+int mult_files_sf(const char *left_filename, const char *right_filename, const char *result_filename, size_t memory_budget) {
+    MappedMatrix left, right;
+    if (!MapMatrixFile(left_filename, &left)) {
+        return 0;
+    }
+    if (!MapMatrixFile(right_filename, &right)) {
+        UnmapMatrixFile(&left);
+        return 0;
+    }
+    if (left.num_cols != right.num_rows) {
+        UnmapMatrixFile(&left);
+        UnmapMatrixFile(&right);
+        return 0;
+    }
+
+    int result_fd = CreateResultFile(result_filename, left.num_rows, right.num_cols);
+    if (result_fd < 0) {
+        UnmapMatrixFile(&left);
+        UnmapMatrixFile(&right);
+        return 0;
+    }
+
+    int succeeded = 1;
+    // With an empty shared dimension the result is all zeros, which ftruncate already gave us
+    if (left.num_rows > 0 && right.num_cols > 0 && left.num_cols > 0) {
+        TilePipeline pipeline;
+        memset(&pipeline, 0, sizeof(pipeline));
+        pipeline.left = &left;
+        pipeline.right = &right;
+        unsigned int largest_dim = left.num_rows > right.num_cols ? left.num_rows : right.num_cols;
+        if (left.num_cols > largest_dim) {
+            largest_dim = left.num_cols;
+        }
+        pipeline.tile_size = ChooseTileSize(memory_budget, largest_dim);
+
+        unsigned int tile = pipeline.tile_size;
+        pipeline.step_count = (unsigned long long)((left.num_rows + tile - 1) / tile) *
+                              ((right.num_cols + tile - 1) / tile) *
+                              ((left.num_cols + tile - 1) / tile);
+
+        size_t tile_bytes = (size_t)tile * tile * sizeof(int);
+        int *buffers = malloc(5 * tile_bytes);
+        if (buffers == NULL) {
+            succeeded = 0;
+        } else {
+            pipeline.left_tiles[0] = buffers;
+            pipeline.left_tiles[1] = buffers + (size_t)tile * tile;
+            pipeline.right_tiles[0] = buffers + 2 * (size_t)tile * tile;
+            pipeline.right_tiles[1] = buffers + 3 * (size_t)tile * tile;
+            int *result_tile = buffers + 4 * (size_t)tile * tile;
+
+            pthread_mutex_init(&pipeline.lock, NULL);
+            pthread_cond_init(&pipeline.changed, NULL);
+            succeeded = RunTiledMultiply(&pipeline, result_fd, result_tile);
+            pthread_cond_destroy(&pipeline.changed);
+            pthread_mutex_destroy(&pipeline.lock);
+            free(buffers);
+        }
+    }
+
+    if (close(result_fd) != 0) {
+        succeeded = 0;
+    }
+    UnmapMatrixFile(&left);
+    UnmapMatrixFile(&right);
+    return succeeded;
+}
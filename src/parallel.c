@@ -0,0 +1,163 @@
+#include <pthread.h>
+
+#include "hw7.h"
+#include "hw7_internal.h"
+
+#define MAX_PARALLEL_TASKS 64
+
+static pthread_once_t CoresOnce = PTHREAD_ONCE_INIT;
+static unsigned int CoreCount = 1;
+
+// One RunParallel call: its tasks are claimed in index order, by pool workers and by the caller itself
+typedef struct TaskGroup {
+    ParallelTask task;
+    void *arg;
+    unsigned int task_count;
+    unsigned int claimed;      // tasks below this have been taken
+    unsigned int unfinished;   // tasks not done yet
+    unsigned int width;        // the caller's ParallelWidth, which its tasks inherit
+    struct TaskGroup *next;    // groups that still have unclaimed tasks, oldest first
+} TaskGroup;
+
+// Workers started once and shared by every RunParallel call. Everything is guarded by Lock.
+static pthread_once_t PoolOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t WorkQueued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t WorkFinished = PTHREAD_COND_INITIALIZER;
+static TaskGroup *QueueHead;
+static TaskGroup *QueueTail;
+
+// Threads the code running on this thread may use; 0 means all of them
+static _Thread_local unsigned int ThreadWidth;
+
+// Helper function to read HW7_THREADS (or the number of online cores) once
+static void CountCores(void) {
+    const char *configured = getenv("HW7_THREADS");
+    long cores = configured != NULL ? atol(configured) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) {
+        cores = 1;
+    }
+    if (cores > MAX_PARALLEL_TASKS) {
+        cores = MAX_PARALLEL_TASKS;
+    }
+    CoreCount = (unsigned int)cores;
+}
+
+// Number of threads the library may use in all (HW7_THREADS overrides the online core count)
+unsigned int AvailableCores(void) {
+    pthread_once(&CoresOnce, CountCores);
+    return CoreCount;
+}
+
+// Number of threads the code running on this thread may split its work across
+unsigned int ParallelWidth(void) {
+    return ThreadWidth != 0 ? ThreadWidth : AvailableCores();
+}
+
+// Set this thread's ParallelWidth, returning the previous setting
+unsigned int LimitParallelWidth(unsigned int width) {
+    unsigned int previous = ThreadWidth;
+    ThreadWidth = width;
+    return previous;
+}
+
+// Helper function to take the next task of group, dropping group from the queue once all of them are taken.
+// Called with Lock held; returns the task's index.
+static unsigned int ClaimTask(TaskGroup *group) {
+    unsigned int task_index = group->claimed++;
+    if (group->claimed == group->task_count) {
+        TaskGroup **link = &QueueHead;
+        TaskGroup *previous = NULL;
+        while (*link != group) {
+            previous = *link;
+            link = &(*link)->next;
+        }
+        *link = group->next;
+        if (QueueTail == group) {
+            QueueTail = previous;
+        }
+    }
+    return task_index;
+}
+
+// Helper function to run one claimed task with its group's width, then count it done. Called with Lock held.
+static void RunClaimedTask(TaskGroup *group, unsigned int task_index) {
+    pthread_mutex_unlock(&Lock);
+    unsigned int saved_width = LimitParallelWidth(group->width);
+    group->task(group->arg, task_index);
+    LimitParallelWidth(saved_width);
+    pthread_mutex_lock(&Lock);
+    if (--group->unfinished == 0) {
+        pthread_cond_broadcast(&WorkFinished);
+    }
+}
+
+// Pool worker: run queued tasks, oldest group first, for as long as the process lives
+static void* RunWorker(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&Lock);
+    for (;;) {
+        while (QueueHead == NULL) {
+            pthread_cond_wait(&WorkQueued, &Lock);
+        }
+        TaskGroup *group = QueueHead;
+        RunClaimedTask(group, ClaimTask(group));
+    }
+    return NULL;
+}
+
+// Helper function to start one worker per core besides the caller's. Workers that can't be started are simply
+// missing: callers run their own unclaimed tasks, so every task still runs.
+static void StartWorkers(void) {
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    for (unsigned int worker = 1; worker < AvailableCores(); worker++) {
+        pthread_t thread;
+        if (pthread_create(&thread, &attributes, RunWorker, NULL) != 0) {
+            break;
+        }
+    }
+    pthread_attr_destroy(&attributes);
+}
+
+// Run task(arg, 0) ... task(arg, task_count - 1) concurrently on the shared workers and wait for all of them.
+// Task 0 runs on the calling thread, which also runs any task no worker has taken by the time it is free. So a task
+// may call RunParallel itself: a caller never waits on a task that is only queued.
+void RunParallel(unsigned int task_count, ParallelTask task, void *arg) {
+    if (task_count > MAX_PARALLEL_TASKS) {
+        task_count = MAX_PARALLEL_TASKS;
+    }
+    if (task_count == 0) {
+        return;
+    }
+    if (task_count == 1) {
+        task(arg, 0);
+        return;
+    }
+    pthread_once(&PoolOnce, StartWorkers);
+
+    TaskGroup group = {task, arg, task_count, 1, task_count, ThreadWidth, NULL};
+    pthread_mutex_lock(&Lock);
+    if (QueueTail != NULL) {
+        QueueTail->next = &group;
+    } else {
+        QueueHead = &group;
+    }
+    QueueTail = &group;
+    pthread_cond_broadcast(&WorkQueued);
+    pthread_mutex_unlock(&Lock);
+
+    task(arg, 0);
+
+    pthread_mutex_lock(&Lock);
+    --group.unfinished;
+    while (group.unfinished > 0) {
+        if (group.claimed < group.task_count) {
+            RunClaimedTask(&group, ClaimTask(&group));
+        } else {
+            pthread_cond_wait(&WorkFinished, &Lock);
+        }
+    }
+    pthread_mutex_unlock(&Lock);
+}
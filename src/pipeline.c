@@ -0,0 +1,288 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#include "hw7.h"
+#include "hw7_internal.h"
+
+// Statements that can be in flight between the reader and the evaluator
+#define PIPELINE_DEPTH 64
+#define MAX_PARSE_THREADS 16
+// Spin this many times before yielding the core while waiting on another stage
+#define SPINS_BEFORE_YIELD 64
+
+// One statement travelling through the pipeline
+typedef struct {
+    char *line;
+    char name;
+    char *rhs;
+    int is_literal;
+    matrix_sf *literal;
+    atomic_int parsed;
+} StatementSlot;
+
+typedef struct Pipeline Pipeline;
+
+typedef struct {
+    Pipeline *pipeline;
+    pool_sf *pool;
+    unsigned long long stall_ns;
+} ParseWorker;
+
+// The queue is a ring of slots indexed by three monotonically increasing counters:
+// the reader fills slots below read_count, parsers claim them through claim_count,
+// and the evaluator retires them in order through eval_count.
+struct Pipeline {
+    StatementSlot slots[PIPELINE_DEPTH];
+    atomic_ullong read_count;
+    atomic_ullong claim_count;
+    atomic_ullong eval_count;
+    atomic_int reader_done;
+    atomic_int invalid;  // set by the reader, before reader_done, when a statement doesn't validate
+    FILE *file;
+    ScriptValidator *validator;
+    unsigned long long read_stall_ns;
+};
+
+// Helper function to back off while another stage catches up
+static void WaitABit(unsigned int *spins) {
+    if (++*spins >= SPINS_BEFORE_YIELD) {
+        sched_yield();
+        *spins = 0;
+    }
+}
+
+// Reader stage: read lines, split and validate them, publish them in order. The evaluator skips the shape checks,
+// so nothing is published past the first statement that doesn't validate.
+static void* ReadStatements(void *arg) {
+    Pipeline *pipeline = arg;
+    unsigned long long next_seq = 0;
+
+    for (;;) {
+        char *line = NULL;
+        size_t line_size = 0;
+        if (getline(&line, &line_size, pipeline->file) == -1) {
+            free(line);
+            break;
+        }
+
+        char name = 0;
+        char *rhs = NULL;
+        int is_literal = 0;
+        int valid = ValidateStatement(pipeline->validator, line, &name, &rhs, &is_literal);
+        if (valid <= 0) {
+            free(line);
+            if (valid == 0) {
+                atomic_store_explicit(&pipeline->invalid, 1, memory_order_release);
+                break;
+            }
+            continue;
+        }
+
+        // Wait for the evaluator to retire the statement that used this slot last time around
+        if (next_seq - atomic_load_explicit(&pipeline->eval_count, memory_order_acquire) >= PIPELINE_DEPTH) {
+            unsigned long long stall_start = NowNanoseconds();
+            unsigned int spins = 0;
+            while (next_seq - atomic_load_explicit(&pipeline->eval_count, memory_order_acquire) >= PIPELINE_DEPTH) {
+                WaitABit(&spins);
+            }
+            pipeline->read_stall_ns += NowNanoseconds() - stall_start;
+        }
+
+        StatementSlot *slot = &pipeline->slots[next_seq % PIPELINE_DEPTH];
+        slot->line = line;
+        slot->name = name;
+        slot->rhs = rhs;
+        slot->is_literal = is_literal;
+        slot->literal = NULL;
+        next_seq++;
+        atomic_store_explicit(&pipeline->read_count, next_seq, memory_order_release);
+    }
+
+    atomic_store_explicit(&pipeline->reader_done, 1, memory_order_release);
+    return NULL;
+}
+
+// Parse stage: claim the next unparsed statement and build its matrix literal into this worker's pool
+static void* ParseStatements(void *arg) {
+    ParseWorker *worker = arg;
+    Pipeline *pipeline = worker->pipeline;
+    unsigned int spins = 0;
+    unsigned long long stall_start = 0;
+
+    for (;;) {
+        unsigned long long claim = atomic_load_explicit(&pipeline->claim_count, memory_order_relaxed);
+        // Check reader_done before read_count, so a finished reader can't hide its last statements
+        int reader_done = atomic_load_explicit(&pipeline->reader_done, memory_order_acquire);
+        if (claim >= atomic_load_explicit(&pipeline->read_count, memory_order_acquire)) {
+            if (reader_done) {
+                break;
+            }
+            if (stall_start == 0) {
+                stall_start = NowNanoseconds();
+            }
+            WaitABit(&spins);
+            continue;
+        }
+        if (!atomic_compare_exchange_weak_explicit(&pipeline->claim_count, &claim, claim + 1,
+                                                   memory_order_acq_rel, memory_order_relaxed)) {
+            continue;
+        }
+        if (stall_start != 0) {
+            worker->stall_ns += NowNanoseconds() - stall_start;
+            stall_start = 0;
+        }
+
+        StatementSlot *slot = &pipeline->slots[claim % PIPELINE_DEPTH];
+        if (slot->is_literal) {
+            slot->literal = create_matrix_pool_sf(slot->name, slot->rhs, worker->pool);
+        }
+        atomic_store_explicit(&slot->parsed, 1, memory_order_release);
+    }
+
+    if (stall_start != 0) {
+        worker->stall_ns += NowNanoseconds() - stall_start;
+    }
+    return NULL;
+}
+
+// Evaluate stage (runs on the calling thread): retire statements strictly in script order
+static matrix_sf* EvaluateStatements(Pipeline *pipeline, pool_sf *pool, pipeline_stats_sf *stats) {
+    SymbolTable symbols;
+    InitSymbols(&symbols, pool);
+    unsigned long long seq = 0;
+    int failed = 0;
+
+    for (;;) {
+        StatementSlot *slot = &pipeline->slots[seq % PIPELINE_DEPTH];
+        if (!atomic_load_explicit(&slot->parsed, memory_order_acquire)) {
+            unsigned long long stall_start = NowNanoseconds();
+            unsigned int spins = 0;
+            int finished = 0;
+            while (!atomic_load_explicit(&slot->parsed, memory_order_acquire)) {
+                if (atomic_load_explicit(&pipeline->reader_done, memory_order_acquire) &&
+                    seq >= atomic_load_explicit(&pipeline->read_count, memory_order_acquire)) {
+                    finished = 1;
+                    break;
+                }
+                WaitABit(&spins);
+            }
+            stats->eval_stall_ns += NowNanoseconds() - stall_start;
+            if (finished) {
+                break;
+            }
+        }
+
+        // After a failed statement, or once the reader has found an invalid one, the rest are only retired, so the
+        // other stages can run off the end
+        failed = failed || atomic_load_explicit(&pipeline->invalid, memory_order_acquire);
+        if (!failed) {
+            TRACE_STATEMENT_BEGIN(slot->name, seq + 1);
+            matrix_sf *new_mat;
+            if (slot->is_literal) {
+                // Literals belong to the parse threads' pools, which are still allocating; they are never released
+                // early
+                new_mat = DefineMatrix(&symbols, slot->name, slot->literal, 0);
+            } else {
+                new_mat = DefineExpression(&symbols, slot->name, slot->rhs, 0);
+            }
+            TRACE_STATEMENT_END(slot->name, seq + 1, new_mat);
+            // Only out of memory gets here: later statements were validated against this one's shape
+            failed = new_mat == NULL;
+        }
+
+        free(slot->line);
+        atomic_store_explicit(&slot->parsed, 0, memory_order_relaxed);
+        seq++;
+        atomic_store_explicit(&pipeline->eval_count, seq, memory_order_release);
+    }
+
+    stats->statements = seq;
+    // The reader flags an invalid statement before it finishes, so this sees it even if every slot was retired first
+    failed = failed || atomic_load_explicit(&pipeline->invalid, memory_order_acquire);
+    return failed ? NULL : DetachResult(&symbols);
+}
+
+matrix_sf* execute_script_pipelined_sf(char *filename, unsigned int parse_threads, pipeline_stats_sf *stats) {
+    pipeline_stats_sf local_stats;
+    if (stats == NULL) {
+        stats = &local_stats;
+    }
+    memset(stats, 0, sizeof(*stats));
+    unsigned long long start_time = NowNanoseconds();
+
+    if (parse_threads == 0) {
+        unsigned int cores = AvailableCores();
+        // The reader and the evaluator each keep a core busy
+        parse_threads = cores > 2 ? cores - 2 : 1;
+    }
+    if (parse_threads > MAX_PARSE_THREADS) {
+        parse_threads = MAX_PARSE_THREADS;
+    }
+
+    Pipeline *pipeline = calloc(1, sizeof(Pipeline));
+    if (pipeline == NULL) {
+        return NULL;
+    }
+    // The reader streams the file and validates each statement as it goes, so reading overlaps evaluation
+    pipeline->file = fopen(filename, "r");
+    pipeline->validator = CreateScriptValidator();
+    pool_sf *eval_pool = create_pool_sf();
+    if (pipeline->file == NULL || pipeline->validator == NULL || eval_pool == NULL) {
+        if (pipeline->file != NULL) {
+            fclose(pipeline->file);
+        }
+        free(pipeline->validator);
+        free_pool_sf(eval_pool);
+        free(pipeline);
+        return NULL;
+    }
+
+    pthread_t reader;
+    pthread_t parsers[MAX_PARSE_THREADS];
+    ParseWorker workers[MAX_PARSE_THREADS];
+    unsigned int started_parsers = 0;
+
+    for (unsigned int worker_index = 0; worker_index < parse_threads; worker_index++) {
+        workers[worker_index].pipeline = pipeline;
+        workers[worker_index].pool = create_pool_sf();
+        workers[worker_index].stall_ns = 0;
+        if (workers[worker_index].pool == NULL ||
+            pthread_create(&parsers[worker_index], NULL, ParseStatements, &workers[worker_index]) != 0) {
+            free_pool_sf(workers[worker_index].pool);
+            break;
+        }
+        started_parsers++;
+    }
+
+    int reader_started = started_parsers > 0 && pthread_create(&reader, NULL, ReadStatements, pipeline) == 0;
+    matrix_sf *result = NULL;
+    if (reader_started) {
+        result = EvaluateStatements(pipeline, eval_pool, stats);
+        pthread_join(reader, NULL);
+    } else {
+        // Lets any parsers that did start run off the end of the (empty) queue
+        atomic_store(&pipeline->reader_done, 1);
+    }
+
+    for (unsigned int worker_index = 0; worker_index < started_parsers; worker_index++) {
+        pthread_join(parsers[worker_index], NULL);
+        stats->parse_stall_ns += workers[worker_index].stall_ns;
+        free_pool_sf(workers[worker_index].pool);
+    }
+
+    stats->parse_threads = started_parsers;
+    stats->read_stall_ns = pipeline->read_stall_ns;
+    fclose(pipeline->file);
+    free(pipeline->validator);
+    free_pool_sf(eval_pool);
+    free(pipeline);
+
+    // Couldn't start the threads: run the script the ordinary way
+    if (!reader_started) {
+        result = execute_script_sf(filename);
+    }
+
+    stats->elapsed_ns = NowNanoseconds() - start_time;
+    return result;
+}
@@ -0,0 +1,188 @@
+#include <stddef.h>
+
+#include "hw7.h"
+
+// Smallest size class; a bst_sf node (24 bytes) and a matrix with up to 5 values fit here
+#define POOL_MIN_CLASS_SIZE 32
+// Size classes are 32, 64, ..., 4096 bytes. Anything bigger goes straight to malloc
+#define POOL_CLASS_COUNT 8
+#define POOL_MAX_CLASS_SIZE (POOL_MIN_CLASS_SIZE << (POOL_CLASS_COUNT - 1))
+#define POOL_SLAB_SIZE (64 * 1024)
+
+// A released block is reused as a link in its size class's free list
+typedef struct PoolFreeBlock {
+    struct PoolFreeBlock *next;
+} PoolFreeBlock;
+
+// Slabs are carved from front to back and are kept across resets
+typedef struct PoolSlab {
+    struct PoolSlab *next;
+    size_t padding;
+    unsigned char bytes[];
+} PoolSlab;
+
+// Blocks larger than the biggest size class get their own malloc, linked so reset can find them
+typedef struct PoolLargeBlock {
+    struct PoolLargeBlock *prev;
+    struct PoolLargeBlock *next;
+    unsigned char bytes[];
+} PoolLargeBlock;
+
+struct pool_sf {
+    PoolFreeBlock *free_lists[POOL_CLASS_COUNT];
+    PoolSlab *first_slab;
+    PoolSlab *current_slab;
+    size_t slab_offset;
+    PoolLargeBlock *large_blocks;
+};
+
+// Helper function to map a request size to its size class (or -1 for large blocks)
+static int SizeClassOf(size_t size) {
+    if (size > POOL_MAX_CLASS_SIZE) {
+        return -1;
+    }
+    int class_index = 0;
+    size_t class_size = POOL_MIN_CLASS_SIZE;
+    while (class_size < size) {
+        class_size <<= 1;
+        class_index++;
+    }
+    return class_index;
+}
+
+// Helper function to move to the next slab, reusing slabs kept from before the last reset
+static int AdvanceSlab(pool_sf *pool) {
+    if (pool->current_slab != NULL && pool->current_slab->next != NULL) {
+        pool->current_slab = pool->current_slab->next;
+        pool->slab_offset = 0;
+        return 1;
+    }
+
+    PoolSlab *new_slab = malloc(sizeof(PoolSlab) + POOL_SLAB_SIZE);
+    if (new_slab == NULL) {
+        return 0;
+    }
+    new_slab->next = NULL;
+
+    if (pool->current_slab == NULL) {
+        pool->first_slab = new_slab;
+    } else {
+        pool->current_slab->next = new_slab;
+    }
+    pool->current_slab = new_slab;
+    pool->slab_offset = 0;
+    return 1;
+}
+
+// Helper function to carve a fresh block of class_size bytes out of the current slab
+static void* CarveBlock(pool_sf *pool, size_t class_size) {
+    if (pool->current_slab == NULL || pool->slab_offset + class_size > POOL_SLAB_SIZE) {
+        if (!AdvanceSlab(pool)) {
+            return NULL;
+        }
+    }
+    void *block = pool->current_slab->bytes + pool->slab_offset;
+    pool->slab_offset += class_size;
+    return block;
+}
+
+pool_sf* create_pool_sf(void) {
+    pool_sf *pool = calloc(1, sizeof(pool_sf));
+    return pool;
+}
+
+void* alloc_pool_sf(pool_sf *pool, size_t size) {
+    if (pool == NULL) {
+        return malloc(size);
+    }
+
+    int class_index = SizeClassOf(size);
+    if (class_index < 0) {
+        PoolLargeBlock *large_block = malloc(sizeof(PoolLargeBlock) + size);
+        if (large_block == NULL) {
+            return NULL;
+        }
+        large_block->prev = NULL;
+        large_block->next = pool->large_blocks;
+        if (pool->large_blocks != NULL) {
+            pool->large_blocks->prev = large_block;
+        }
+        pool->large_blocks = large_block;
+        return large_block->bytes;
+    }
+
+    PoolFreeBlock *reused_block = pool->free_lists[class_index];
+    if (reused_block != NULL) {
+        pool->free_lists[class_index] = reused_block->next;
+        return reused_block;
+    }
+
+    return CarveBlock(pool, (size_t)POOL_MIN_CLASS_SIZE << class_index);
+}
+
+void release_pool_sf(pool_sf *pool, void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return;
+    }
+    if (pool == NULL) {
+        free(ptr);
+        return;
+    }
+
+    int class_index = SizeClassOf(size);
+    if (class_index < 0) {
+        PoolLargeBlock *large_block = (PoolLargeBlock *)((unsigned char *)ptr - offsetof(PoolLargeBlock, bytes));
+        if (large_block->prev != NULL) {
+            large_block->prev->next = large_block->next;
+        } else {
+            pool->large_blocks = large_block->next;
+        }
+        if (large_block->next != NULL) {
+            large_block->next->prev = large_block->prev;
+        }
+        free(large_block);
+        return;
+    }
+
+    PoolFreeBlock *freed_block = ptr;
+    freed_block->next = pool->free_lists[class_index];
+    pool->free_lists[class_index] = freed_block;
+}
+
+void reset_pool_sf(pool_sf *pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    PoolLargeBlock *large_block = pool->large_blocks;
+    while (large_block != NULL) {
+        PoolLargeBlock *next_block = large_block->next;
+        free(large_block);
+        large_block = next_block;
+    }
+    pool->large_blocks = NULL;
+
+    for (int class_index = 0; class_index < POOL_CLASS_COUNT; class_index++) {
+        pool->free_lists[class_index] = NULL;
+    }
+
+    // Keep the slabs so the next script doesn't pay for them again
+    pool->current_slab = pool->first_slab;
+    pool->slab_offset = 0;
+}
+
+void free_pool_sf(pool_sf *pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    reset_pool_sf(pool);
+
+    PoolSlab *slab = pool->first_slab;
+    while (slab != NULL) {
+        PoolSlab *next_slab = slab->next;
+        free(slab);
+        slab = next_slab;
+    }
+    free(pool);
+}
@@ -0,0 +1,121 @@
+#include <stdatomic.h>
+
+#include "hw7.h"
+#include "hw7_internal.h"
+
+#ifdef HW7_PROFILE
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#endif
+
+static const char *const ProfileOpNames[PROFILE_OP_COUNT_SF] = {
+    [PROFILE_ADD_SF] = "add_mats_sf",
+    [PROFILE_MULT_SF] = "mult_mats_sf",
+    [PROFILE_TRANSPOSE_SF] = "transpose_mat_sf",
+    [PROFILE_CREATE_SF] = "create_matrix_sf",
+    [PROFILE_EVALUATE_SF] = "evaluate_expr_sf",
+    [PROFILE_INSERT_BST_SF] = "insert_bst_sf",
+    [PROFILE_FIND_BST_SF] = "find_bst_sf",
+    [PROFILE_FREE_BST_SF] = "free_bst_sf",
+};
+
+#ifdef HW7_PROFILE
+
+// One set of counters per operation, bumped with relaxed atomics so parse threads can share them
+typedef struct {
+    atomic_ullong calls;
+    atomic_ullong cycles;
+    atomic_ullong bytes_allocated;
+    atomic_ullong multiply_adds;
+} ProfileCounter;
+
+static ProfileCounter ProfileCounters[PROFILE_OP_COUNT_SF];
+
+// Read the time stamp counter, or a nanosecond clock where there isn't one
+unsigned long long ProfileCycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return NowNanoseconds();
+#endif
+}
+
+// Count one call of op
+void ProfileRecord(profile_op_sf op, unsigned long long cycles, unsigned long long bytes, unsigned long long multiply_adds) {
+    ProfileCounter *counter = &ProfileCounters[op];
+    atomic_fetch_add_explicit(&counter->calls, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&counter->cycles, cycles, memory_order_relaxed);
+    atomic_fetch_add_explicit(&counter->bytes_allocated, bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&counter->multiply_adds, multiply_adds, memory_order_relaxed);
+}
+
+// Helper function to print the counters on stderr when the program exits
+static void DumpProfileAtExit(void) {
+    dump_profile_sf(stderr);
+}
+
+// Helper function to arrange the exit dump if HW7_PROFILE is set in the environment
+__attribute__((constructor)) static void RegisterProfileDump(void) {
+    const char *requested = getenv("HW7_PROFILE");
+    if (requested != NULL && requested[0] != '\0') {
+        atexit(DumpProfileAtExit);
+    }
+}
+
+#endif // HW7_PROFILE
+
+int profile_enabled_sf(void) {
+#ifdef HW7_PROFILE
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+void get_profile_sf(profile_op_sf op, profile_counter_sf *counter) {
+    memset(counter, 0, sizeof(*counter));
+#ifdef HW7_PROFILE
+    if (op < PROFILE_OP_COUNT_SF) {
+        counter->calls = atomic_load_explicit(&ProfileCounters[op].calls, memory_order_relaxed);
+        counter->cycles = atomic_load_explicit(&ProfileCounters[op].cycles, memory_order_relaxed);
+        counter->bytes_allocated = atomic_load_explicit(&ProfileCounters[op].bytes_allocated, memory_order_relaxed);
+        counter->multiply_adds = atomic_load_explicit(&ProfileCounters[op].multiply_adds, memory_order_relaxed);
+    }
+#else
+    (void)op;
+#endif
+}
+
+void reset_profile_sf(void) {
+#ifdef HW7_PROFILE
+    for (int op = 0; op < PROFILE_OP_COUNT_SF; op++) {
+        atomic_store_explicit(&ProfileCounters[op].calls, 0, memory_order_relaxed);
+        atomic_store_explicit(&ProfileCounters[op].cycles, 0, memory_order_relaxed);
+        atomic_store_explicit(&ProfileCounters[op].bytes_allocated, 0, memory_order_relaxed);
+        atomic_store_explicit(&ProfileCounters[op].multiply_adds, 0, memory_order_relaxed);
+    }
+#endif
+}
+
+void dump_profile_sf(FILE *out) {
+    if (!profile_enabled_sf()) {
+        fprintf(out, "hw7 profile: not compiled in (build with -DHW7_PROFILE)\n");
+        return;
+    }
+
+    fprintf(out, "%-18s %12s %16s %14s %16s %16s\n", "operation", "calls", "cycles", "cycles/call", "bytes", "multiply-adds");
+    for (int op = 0; op < PROFILE_OP_COUNT_SF; op++) {
+        profile_counter_sf counter;
+        get_profile_sf((profile_op_sf)op, &counter);
+        if (counter.calls == 0) {
+            continue;
+        }
+        fprintf(out, "%-18s %12llu %16llu %14llu %16llu %16llu\n", ProfileOpNames[op], counter.calls, counter.cycles,
+                counter.cycles / counter.calls, counter.bytes_allocated, counter.multiply_adds);
+    }
+}
+
+const char* profile_op_name_sf(profile_op_sf op) {
+    return op < PROFILE_OP_COUNT_SF ? ProfileOpNames[op] : "unknown";
+}
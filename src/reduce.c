@@ -0,0 +1,207 @@
+#include "hw7.h"
+#include "hw7_internal.h"
+
+// Reductions over fewer values than this run on the calling thread
+#define PARALLEL_REDUCE_MIN_ELEMENTS (256 * 1024)
+#define MAX_REDUCE_TASKS 64
+
+// Four unsigned partial sums at once: one SSE2 or NEON register, which GCC and Clang target without any flags
+#define REDUCE_LANE_COUNT 4
+typedef unsigned int ReduceLanes __attribute__((vector_size(REDUCE_LANE_COUNT * sizeof(unsigned int))));
+
+// One reduction split by rows of left; each task leaves its share of the total in partial.
+// Totals are kept unsigned: unsigned sums wrap the same way in any order, so the compiler may vectorise them and the
+// tasks may split them, and the final conversion gives the int the materialised result would have summed to.
+typedef struct {
+    ReduceKind kind;
+    char op;
+    const matrix_sf *left;
+    const matrix_sf *right;
+    unsigned int *row_sums;  // sum(left * right): the sums of right's rows, filled in by a first pass
+    unsigned int task_count;
+    unsigned int partial[MAX_REDUCE_TASKS];
+} ReduceJob;
+
+int IsReduction(char token) {
+    return token == REDUCE_TRACE || token == REDUCE_SUM || token == REDUCE_NORM;
+}
+
+int CanFuseReduction(ReduceKind kind, char op) {
+    // The squares of a product's entries don't factor through its operands
+    return op == '+' || (op == '*' && kind != REDUCE_NORM);
+}
+
+// Helper function to find the rows [*begin, *end) that task_index of task_count covers
+static void TaskRows(unsigned int rows, unsigned int task_index, unsigned int task_count, unsigned int *begin,
+                     unsigned int *end) {
+    *begin = (unsigned int)((unsigned long long)rows * task_index / task_count);
+    *end = (unsigned int)((unsigned long long)rows * (task_index + 1) / task_count);
+}
+
+// Helper function to load REDUCE_LANE_COUNT values from wherever they happen to be aligned
+static ReduceLanes LoadLanes(const int *values) {
+    ReduceLanes lanes;
+    memcpy(&lanes, values, sizeof(lanes));
+    return lanes;
+}
+
+// Helper function to add up the lanes of a vector of partial sums
+static unsigned int SumLanes(ReduceLanes lanes) {
+    unsigned int parts[REDUCE_LANE_COUNT];
+    memcpy(parts, &lanes, sizeof(parts));
+    unsigned int total = 0;
+    for (unsigned int lane = 0; lane < REDUCE_LANE_COUNT; lane++) {
+        total += parts[lane];
+    }
+    return total;
+}
+
+// Helper function to sum count values, or their squares
+static unsigned int SumValues(const int *values, size_t count, int squares) {
+    ReduceLanes lanes = {0};
+    size_t i = 0;
+    for (; i + REDUCE_LANE_COUNT <= count; i += REDUCE_LANE_COUNT) {
+        ReduceLanes loaded = LoadLanes(values + i);
+        lanes += squares ? loaded * loaded : loaded;
+    }
+    unsigned int total = SumLanes(lanes);
+    for (; i < count; i++) {
+        unsigned int value = (unsigned int)values[i];
+        total += squares ? value * value : value;
+    }
+    return total;
+}
+
+// Helper function to sum count pairwise sums of left and right values, or their squares
+static unsigned int SumPairs(const int *left, const int *right, size_t count, int squares) {
+    ReduceLanes lanes = {0};
+    size_t i = 0;
+    for (; i + REDUCE_LANE_COUNT <= count; i += REDUCE_LANE_COUNT) {
+        ReduceLanes pairs = LoadLanes(left + i) + LoadLanes(right + i);
+        lanes += squares ? pairs * pairs : pairs;
+    }
+    unsigned int total = SumLanes(lanes);
+    for (; i < count; i++) {
+        unsigned int pair = (unsigned int)left[i] + (unsigned int)right[i];
+        total += squares ? pair * pair : pair;
+    }
+    return total;
+}
+
+// Helper function to dot count values with count unsigned weights
+static unsigned int DotWeights(const int *values, const unsigned int *weights, size_t count) {
+    ReduceLanes lanes = {0};
+    size_t i = 0;
+    for (; i + REDUCE_LANE_COUNT <= count; i += REDUCE_LANE_COUNT) {
+        ReduceLanes loaded_weights;
+        memcpy(&loaded_weights, weights + i, sizeof(loaded_weights));
+        lanes += LoadLanes(values + i) * loaded_weights;
+    }
+    unsigned int total = SumLanes(lanes);
+    for (; i < count; i++) {
+        total += (unsigned int)values[i] * weights[i];
+    }
+    return total;
+}
+
+// Helper function to sum the task_index-th share of right's rows into row_sums
+static void SumRightRows(void *arg, unsigned int task_index) {
+    ReduceJob *job = arg;
+    unsigned int cols = job->right->num_cols;
+    unsigned int begin, end;
+    TaskRows(job->right->num_rows, task_index, job->task_count, &begin, &end);
+    for (unsigned int row = begin; row < end; row++) {
+        job->row_sums[row] = SumValues(job->right->values + (size_t)row * cols, cols, 0);
+    }
+}
+
+// Helper function to reduce the task_index-th share of left's rows (and what they meet in right)
+static void ReduceRows(void *arg, unsigned int task_index) {
+    ReduceJob *job = arg;
+    unsigned int cols = job->left->num_cols;
+    const int *left = job->left->values;
+    const int *right = job->right != NULL ? job->right->values : NULL;
+    unsigned int begin, end;
+    TaskRows(job->left->num_rows, task_index, job->task_count, &begin, &end);
+
+    unsigned int total = 0;
+    if (job->kind == REDUCE_TRACE && job->op == '*') {
+        // Only the diagonal of the product: row i of left against column i of right
+        unsigned int right_cols = job->right->num_cols;
+        for (unsigned int row = begin; row < end; row++) {
+            for (unsigned int k = 0; k < cols; k++) {
+                total += (unsigned int)left[(size_t)row * cols + k] * (unsigned int)right[(size_t)k * right_cols + row];
+            }
+        }
+    } else if (job->kind == REDUCE_TRACE) {
+        for (unsigned int row = begin; row < end; row++) {
+            total += (unsigned int)left[(size_t)row * cols + row];
+            if (right != NULL) {
+                total += (unsigned int)right[(size_t)row * cols + row];
+            }
+        }
+    } else if (job->op == '*') {
+        // sum(left * right) is every row of left dotted with right's row sums
+        for (unsigned int row = begin; row < end; row++) {
+            total += DotWeights(left + (size_t)row * cols, job->row_sums, cols);
+        }
+    } else {
+        size_t offset = (size_t)begin * cols;
+        size_t count = (size_t)(end - begin) * cols;
+        int squares = job->kind == REDUCE_NORM;
+        total = right != NULL ? SumPairs(left + offset, right + offset, count, squares)
+                              : SumValues(left + offset, count, squares);
+    }
+    job->partial[task_index] = total;
+}
+
+// Helper function to pick how many tasks a reduction over element_count values is split into
+static unsigned int ReduceTasks(unsigned long long element_count) {
+    unsigned long long tasks = element_count / PARALLEL_REDUCE_MIN_ELEMENTS;
+    unsigned int cores = ParallelWidth();
+    if (tasks > cores) {
+        tasks = cores;
+    }
+    if (tasks > MAX_REDUCE_TASKS) {
+        tasks = MAX_REDUCE_TASKS;
+    }
+    return tasks < 1 ? 1 : (unsigned int)tasks;
+}
+
+// Helper function to run a reduction job and total its tasks' shares
+static int RunReduceJob(ReduceJob *job, int *value) {
+    unsigned long long element_count = (unsigned long long)job->left->num_rows * job->left->num_cols;
+    if (job->op == '*' && job->kind == REDUCE_SUM) {
+        job->row_sums = malloc((size_t)job->right->num_rows * sizeof(unsigned int));
+        if (job->row_sums == NULL) {
+            return 0;
+        }
+        job->task_count = ReduceTasks((unsigned long long)job->right->num_rows * job->right->num_cols);
+        RunParallel(job->task_count, SumRightRows, job);
+    }
+
+    // A plain trace only reads the diagonal
+    job->task_count = ReduceTasks(job->kind == REDUCE_TRACE && job->op != '*' ? job->left->num_rows : element_count);
+    RunParallel(job->task_count, ReduceRows, job);
+
+    unsigned int total = 0;
+    for (unsigned int task_index = 0; task_index < job->task_count; task_index++) {
+        total += job->partial[task_index];
+    }
+    free(job->row_sums);
+    *value = (int)total;
+    return 1;
+}
+
+int Reduce(ReduceKind kind, char op, const matrix_sf *left, const matrix_sf *right, int *value) {
+    ReduceJob job = {kind, op, left, op != 0 ? right : NULL, NULL, 0, {0}};
+    if (op != '*') {
+        return RunReduceJob(&job, value);
+    }
+
+    // A fused product reduction is the part of a multiply the reduction needs: one multiply-add per entry of left
+    PROFILE_BEGIN(PROFILE_MULT_SF);
+    int reduced = RunReduceJob(&job, value);
+    PROFILE_END(PROFILE_MULT_SF, 0, (unsigned long long)left->num_rows * left->num_cols);
+    return reduced;
+}
@@ -0,0 +1,575 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "hw7.h"
+#include "hw7_internal.h"
+
+#define MAX_SERVER_WORKERS 64
+// Bytes asked of the socket per read; a request bigger than this is assembled over several reads
+#define SESSION_READ_SIZE (64 * 1024)
+// A session that sends this much without closing a request is dropped
+#define MAX_REQUEST_BYTES (64ULL * 1024 * 1024)
+
+// IDLE sessions are polled by the dispatcher, QUEUED ones belong to the worker queue (and then to the worker serving
+// them) and CLOSED ones are waiting for the dispatcher to free them
+typedef enum {
+    SESSION_IDLE,
+    SESSION_QUEUED,
+    SESSION_CLOSED
+} SessionState;
+
+// One client connection: its own symbol table, which lives as long as the connection, and its unread input
+typedef struct Session {
+    int fd;
+    SessionState state;
+    pool_sf *pool;
+    SymbolTable symbols;
+    char *buffer;
+    size_t used;
+    size_t capacity;
+    size_t scanned;  // the lines before this offset are known not to close a request
+    struct Session *next;        // every open session, owned by the dispatcher
+    struct Session *next_ready;  // sessions with input, in the order they are served
+} Session;
+
+struct server_sf {
+    int listen_fd;
+    int wake_fds[2];  // workers write a byte to [1] to make the dispatcher poll the sessions they are done with
+    char socket_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    Session *sessions;
+    Session *ready_head;
+    Session *ready_tail;
+    int stopping;
+    int dispatching;
+    pthread_t dispatcher;
+    unsigned int worker_count;
+    pthread_t workers[MAX_SERVER_WORKERS];
+};
+
+// Helper function to fill in the address of a Unix domain socket. Returns 0 if the path doesn't fit.
+static int SocketAddress(const char *socket_path, struct sockaddr_un *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (socket_path == NULL || strlen(socket_path) >= sizeof(address->sun_path)) {
+        return 0;
+    }
+    strcpy(address->sun_path, socket_path);
+    return 1;
+}
+
+// Helper function to write all of buffer to a socket. A peer that has gone away is an error, not a SIGPIPE.
+static int SendFully(int fd, const char *buffer, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(fd, buffer, length, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        buffer += sent;
+        length -= (size_t)sent;
+    }
+    return 1;
+}
+
+// Helper function to make the dispatcher look at the sessions again. A full pipe already has a wakeup pending.
+static void WakeDispatcher(server_sf *server) {
+    char byte = 0;
+    ssize_t written = write(server->wake_fds[1], &byte, 1);
+    (void)written;
+}
+
+// Helper function to close a session's connection and free everything its statements defined
+static void CloseSession(Session *session) {
+    close(session->fd);
+    free_pool_sf(session->pool);
+    free(session->buffer);
+    free(session);
+}
+
+// Helper function to read whatever the client has sent so far. Returns 0 once the session is over.
+static int ReadIntoSession(Session *session) {
+    if (session->capacity - session->used < SESSION_READ_SIZE) {
+        size_t capacity = session->capacity * 2 > session->used + SESSION_READ_SIZE ? session->capacity * 2
+                                                                                     : session->used + SESSION_READ_SIZE;
+        if (capacity > MAX_REQUEST_BYTES) {
+            return 0;
+        }
+        char *buffer = realloc(session->buffer, capacity);
+        if (buffer == NULL) {
+            return 0;
+        }
+        session->buffer = buffer;
+        session->capacity = capacity;
+    }
+
+    ssize_t received;
+    do {
+        received = read(session->fd, session->buffer + session->used, session->capacity - session->used);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0) {
+        return 0;
+    }
+    session->used += (size_t)received;
+    return 1;
+}
+
+// Helper function to find the "." line that closes the first request in the session's buffer
+static int FindRequestEnd(Session *session, size_t *request_end) {
+    while (session->scanned < session->used) {
+        char *line = session->buffer + session->scanned;
+        char *newline = memchr(line, '\n', session->used - session->scanned);
+        if (newline == NULL) {
+            // The rest of this line hasn't arrived yet
+            return 0;
+        }
+        if (newline == line + 1 && line[0] == '.') {
+            *request_end = session->scanned;
+            return 1;
+        }
+        session->scanned += (size_t)(newline - line) + 1;
+    }
+    return 0;
+}
+
+// Helper function to append a protocol line to the response, after the matrices already in the writer's buffer
+static int WriteText(matrix_writer_sf *writer, const char *text) {
+    size_t length = strlen(text);
+    if (writer->used + length > WRITER_BUFFER_SIZE && !flush_writer_sf(writer)) {
+        return 0;
+    }
+    memcpy(writer->buffer + writer->used, text, length);
+    writer->used += length;
+    return 1;
+}
+
+// Helper function to run the statements of the request ending at request_end against the session's symbol table,
+// sending each statement's result line as soon as it is ready and then the "." line. A name an earlier request
+// defined is rebound by its first definition in this one.
+static int RunRequest(Session *session, size_t request_end, matrix_writer_sf *writer) {
+    init_writer_sf(writer, session->fd, MATRIX_TEXT_SF);
+    SealSymbols(&session->symbols);
+    char *line = session->buffer;
+    char *end = session->buffer + request_end;
+    while (line < end) {
+        // Every line before the "." line ends with a newline
+        char *newline = memchr(line, '\n', (size_t)(end - line));
+        *newline = '\0';
+        char name = 0;
+        char *rhs = NULL;
+        int is_literal = 0;
+        if (SplitStatement(line, &name, &rhs, &is_literal)) {
+            // Statements arrive unvalidated, so expressions keep their shape checks
+            matrix_sf *mat = is_literal
+                ? DefineMatrix(&session->symbols, name, create_matrix_pool_sf(name, rhs, session->pool), 1)
+                : DefineExpression(&session->symbols, name, rhs, 1);
+            int written;
+            if (mat != NULL) {
+                written = write_matrix_sf(writer, mat);
+            } else {
+                char error[64];
+                snprintf(error, sizeof(error), "! %c: %s\n", name,
+                         is_literal ? "malformed matrix literal" : "undefined name or mismatched shapes");
+                written = WriteText(writer, error);
+            }
+            if (!written || !flush_writer_sf(writer)) {
+                return 0;
+            }
+        }
+        line = newline + 1;
+    }
+    return WriteText(writer, ".\n") && flush_writer_sf(writer);
+}
+
+// Helper function to read from a session the dispatcher saw input on and answer every request that is now complete.
+// Returns 0 once the session is over.
+static int ServeSession(Session *session, matrix_writer_sf *writer) {
+    if (!ReadIntoSession(session)) {
+        return 0;
+    }
+    size_t request_end;
+    while (FindRequestEnd(session, &request_end)) {
+        if (!RunRequest(session, request_end, writer)) {
+            return 0;
+        }
+        size_t consumed = request_end + 2;
+        memmove(session->buffer, session->buffer + consumed, session->used - consumed);
+        session->used -= consumed;
+        session->scanned = 0;
+    }
+    return 1;
+}
+
+// Worker thread: serve sessions off the ready queue, one read (and the requests it completes) at a time
+static void* ServeSessions(void *arg) {
+    server_sf *server = arg;
+    // The writer goes through write(), so a client that hangs up mid-response must fail it with EPIPE instead of
+    // killing the process
+    sigset_t pipe_signal;
+    sigemptyset(&pipe_signal);
+    sigaddset(&pipe_signal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_signal, NULL);
+    matrix_writer_sf *writer = malloc(sizeof(matrix_writer_sf));
+
+    for (;;) {
+        pthread_mutex_lock(&server->lock);
+        while (!server->stopping && server->ready_head == NULL) {
+            pthread_cond_wait(&server->ready, &server->lock);
+        }
+        if (server->stopping) {
+            pthread_mutex_unlock(&server->lock);
+            break;
+        }
+        Session *session = server->ready_head;
+        server->ready_head = session->next_ready;
+        if (server->ready_head == NULL) {
+            server->ready_tail = NULL;
+        }
+        pthread_mutex_unlock(&server->lock);
+
+        int open = writer != NULL && ServeSession(session, writer);
+
+        pthread_mutex_lock(&server->lock);
+        session->state = open ? SESSION_IDLE : SESSION_CLOSED;
+        pthread_mutex_unlock(&server->lock);
+        WakeDispatcher(server);
+    }
+    free(writer);
+    return NULL;
+}
+
+// Helper function to accept a connection as a new idle session
+static void AcceptSession(server_sf *server) {
+    int fd = accept(server->listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+    Session *session = calloc(1, sizeof(Session));
+    pool_sf *pool = create_pool_sf();
+    if (session == NULL || pool == NULL) {
+        free(session);
+        free_pool_sf(pool);
+        close(fd);
+        return;
+    }
+    session->fd = fd;
+    session->state = SESSION_IDLE;
+    session->pool = pool;
+    InitSymbols(&session->symbols, pool);
+
+    pthread_mutex_lock(&server->lock);
+    session->next = server->sessions;
+    server->sessions = session;
+    pthread_mutex_unlock(&server->lock);
+}
+
+// Helper function to make room for polling count descriptors. Returns 0 if it can't, and the old room is still there.
+static int GrowPollSet(struct pollfd **fds, Session ***polled, size_t count) {
+    struct pollfd *grown_fds = realloc(*fds, count * sizeof(struct pollfd));
+    if (grown_fds == NULL) {
+        return 0;
+    }
+    *fds = grown_fds;
+    Session **grown_polled = realloc(*polled, count * sizeof(Session *));
+    if (grown_polled == NULL) {
+        return 0;
+    }
+    *polled = grown_polled;
+    return 1;
+}
+
+// Dispatcher thread: poll the listening socket and every idle session, accepting connections and queueing the
+// sessions that have input for the workers
+static void* DispatchSessions(void *arg) {
+    server_sf *server = arg;
+    struct pollfd *fds = NULL;
+    Session **polled = NULL;
+    size_t capacity = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&server->lock);
+        if (server->stopping) {
+            pthread_mutex_unlock(&server->lock);
+            break;
+        }
+        size_t count = 0;
+        for (Session *session = server->sessions; session != NULL; session = session->next) {
+            count++;
+        }
+        if (count + 2 > capacity && GrowPollSet(&fds, &polled, count + 2)) {
+            capacity = count + 2;
+        }
+
+        // Free the sessions workers have closed, and poll the idle ones
+        size_t polled_count = 2;
+        for (Session **link = &server->sessions; *link != NULL;) {
+            Session *session = *link;
+            if (session->state == SESSION_CLOSED) {
+                *link = session->next;
+                CloseSession(session);
+                continue;
+            }
+            if (session->state == SESSION_IDLE && polled_count < capacity) {
+                fds[polled_count] = (struct pollfd){session->fd, POLLIN, 0};
+                polled[polled_count++] = session;
+            }
+            link = &session->next;
+        }
+        pthread_mutex_unlock(&server->lock);
+        if (capacity < 2) {
+            break;
+        }
+        fds[0] = (struct pollfd){server->listen_fd, POLLIN, 0};
+        fds[1] = (struct pollfd){server->wake_fds[0], POLLIN, 0};
+
+        if (poll(fds, polled_count, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents != 0) {
+            char drained[64];
+            while (read(server->wake_fds[0], drained, sizeof(drained)) > 0) {
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            AcceptSession(server);
+        }
+
+        // A hangup counts as input too: the worker's read sees the end of the session
+        pthread_mutex_lock(&server->lock);
+        for (size_t i = 2; i < polled_count; i++) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            Session *session = polled[i];
+            session->state = SESSION_QUEUED;
+            session->next_ready = NULL;
+            if (server->ready_tail != NULL) {
+                server->ready_tail->next_ready = session;
+            } else {
+                server->ready_head = session;
+            }
+            server->ready_tail = session;
+            pthread_cond_signal(&server->ready);
+        }
+        pthread_mutex_unlock(&server->lock);
+    }
+    free(fds);
+    free(polled);
+    return NULL;
+}
+
+// Helper function to tell whether a daemon is already answering on socket_path
+static int SocketInUse(const struct sockaddr_un *address) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return 0;
+    }
+    int in_use = connect(fd, (const struct sockaddr *)address, sizeof(*address)) == 0;
+    close(fd);
+    return in_use;
+}
+
+server_sf* start_server_sf(const char *socket_path, unsigned int worker_count) {
+    struct sockaddr_un address;
+    if (!SocketAddress(socket_path, &address) || SocketInUse(&address)) {
+        return NULL;
+    }
+    // What's left at the path is a socket whose daemon has exited
+    struct stat existing;
+    if (stat(socket_path, &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+        unlink(socket_path);
+    }
+
+    server_sf *server = calloc(1, sizeof(server_sf));
+    if (server == NULL) {
+        return NULL;
+    }
+    server->wake_fds[0] = server->wake_fds[1] = -1;
+    server->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server->listen_fd < 0) {
+        free(server);
+        return NULL;
+    }
+    if (bind(server->listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(server->listen_fd);
+        free(server);
+        return NULL;
+    }
+    strcpy(server->socket_path, socket_path);
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->ready, NULL);
+    if (listen(server->listen_fd, SOMAXCONN) != 0 || pipe(server->wake_fds) != 0) {
+        stop_server_sf(server);
+        return NULL;
+    }
+    fcntl(server->wake_fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(server->wake_fds[1], F_SETFL, O_NONBLOCK);
+
+    if (worker_count == 0) {
+        worker_count = AvailableCores();
+    }
+    if (worker_count > MAX_SERVER_WORKERS) {
+        worker_count = MAX_SERVER_WORKERS;
+    }
+    while (server->worker_count < worker_count &&
+           pthread_create(&server->workers[server->worker_count], NULL, ServeSessions, server) == 0) {
+        server->worker_count++;
+    }
+    server->dispatching = server->worker_count > 0 &&
+                          pthread_create(&server->dispatcher, NULL, DispatchSessions, server) == 0;
+    if (!server->dispatching) {
+        stop_server_sf(server);
+        return NULL;
+    }
+    return server;
+}
+
+void stop_server_sf(server_sf *server) {
+    if (server == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&server->lock);
+    server->stopping = 1;
+    pthread_cond_broadcast(&server->ready);
+    pthread_mutex_unlock(&server->lock);
+    if (server->dispatching) {
+        WakeDispatcher(server);
+        pthread_join(server->dispatcher, NULL);
+    }
+    for (unsigned int worker = 0; worker < server->worker_count; worker++) {
+        pthread_join(server->workers[worker], NULL);
+    }
+
+    while (server->sessions != NULL) {
+        Session *session = server->sessions;
+        server->sessions = session->next;
+        CloseSession(session);
+    }
+    close(server->listen_fd);
+    unlink(server->socket_path);
+    if (server->wake_fds[0] >= 0) {
+        close(server->wake_fds[0]);
+        close(server->wake_fds[1]);
+    }
+    pthread_cond_destroy(&server->ready);
+    pthread_mutex_destroy(&server->lock);
+    free(server);
+}
+
+int connect_server_sf(const char *socket_path) {
+    struct sockaddr_un address;
+    if (!SocketAddress(socket_path, &address)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Helper function to parse a result line ("rows cols v v ... v") back into a matrix
+static matrix_sf* ParseResultLine(char name, const char *line) {
+    char *cursor;
+    unsigned long num_rows = strtoul(line, &cursor, 10);
+    unsigned long num_cols = strtoul(cursor, &cursor, 10);
+    if (num_rows > UINT_MAX || num_cols > UINT_MAX ||
+        (num_cols != 0 && num_rows > (SIZE_MAX - sizeof(matrix_sf)) / sizeof(int) / num_cols)) {
+        return NULL;
+    }
+    size_t count = (size_t)num_rows * num_cols;
+    matrix_sf *mat = malloc(sizeof(matrix_sf) + count * sizeof(int));
+    if (mat == NULL) {
+        return NULL;
+    }
+    mat->name = name;
+    mat->num_rows = (unsigned int)num_rows;
+    mat->num_cols = (unsigned int)num_cols;
+    for (size_t i = 0; i < count; i++) {
+        mat->values[i] = (int)strtol(cursor, &cursor, 10);
+    }
+    return mat;
+}
+
+matrix_sf* run_remote_script_sf(int fd, const char *script, FILE *results) {
+    if (fd < 0 || script == NULL) {
+        return NULL;
+    }
+    size_t length = strlen(script);
+    int needs_newline = length > 0 && script[length - 1] != '\n';
+    if (!SendFully(fd, script, length) || (needs_newline && !SendFully(fd, "\n", 1)) || !SendFully(fd, ".\n", 2)) {
+        return NULL;
+    }
+
+    // The server answers every statement, in order, so the names of the results come from the script itself
+    size_t statement_count = 0;
+    char *names = malloc(length + 1);
+    int response_fd = names != NULL ? dup(fd) : -1;
+    FILE *responses = response_fd >= 0 ? fdopen(response_fd, "r") : NULL;
+    if (responses == NULL) {
+        if (response_fd >= 0) {
+            close(response_fd);
+        }
+        free(names);
+        return NULL;
+    }
+    for (const char *line = script; *line != '\0';) {
+        const char *cursor = line;
+        while (*cursor == ' ') {
+            cursor++;
+        }
+        if (*cursor != '\n' && *cursor != '\0') {
+            names[statement_count++] = *cursor;
+        }
+        const char *newline = strchr(line, '\n');
+        line = newline != NULL ? newline + 1 : line + strlen(line);
+    }
+
+    // Only the last successful answer becomes the result, so the others are never parsed: the line buffers are
+    // swapped instead
+    char *line = NULL, *last_line = NULL;
+    size_t line_size = 0, last_line_size = 0;
+    char last_name = 0;
+    size_t answered = 0;
+    int finished = 0;
+    while (!finished && getline(&line, &line_size, responses) != -1) {
+        if (results != NULL) {
+            fputs(line, results);
+        }
+        if (strcmp(line, ".\n") == 0) {
+            finished = 1;
+        } else if (line[0] != '!' && answered < statement_count) {
+            char *swapped_line = last_line;
+            size_t swapped_size = last_line_size;
+            last_line = line;
+            last_line_size = line_size;
+            line = swapped_line;
+            line_size = swapped_size;
+            last_name = names[answered];
+        }
+        answered++;
+    }
+    // A broken connection before the "." line means the request wasn't answered
+    matrix_sf *result = finished && last_line != NULL ? ParseResultLine(last_name, last_line) : NULL;
+    free(line);
+    free(last_line);
+    free(names);
+    fclose(responses);
+    return result;
+}
@@ -0,0 +1,137 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#include "hw7.h"
+#include "hw7_internal.h"
+
+// Spin this many times before yielding the core while a writer waits out the readers
+#define SPINS_BEFORE_YIELD 64
+
+// Names are published as whole versions of a symbol table, which never change once published: a writer copies the
+// current version, changes the copy and swaps it in, so a reader sees every name as of one moment without a lock.
+// Handles the writer didn't touch are shared by both versions.
+//
+// Reclamation is epoch based. A reader counts itself into readers[epoch & 1] for as long as it uses a version. A reader
+// still holding a version the writer has just replaced counted itself in under whichever epoch it read, which may be
+// either parity, so the writer advances the epoch and waits for the old parity to drain, twice. Readers arriving during
+// a wait count under the other parity, so they can't hold it up.
+struct session_sf {
+    _Atomic(SymbolTable *) current;
+    atomic_ullong epoch;
+    atomic_ullong readers[2];
+    pthread_mutex_t writer_lock;  // writers are serialised; readers never take it
+};
+
+// Helper function to start using the current version; pass the epoch it returns to LeaveReader
+static unsigned long long EnterReader(session_sf *session) {
+    unsigned long long epoch = atomic_load(&session->epoch);
+    atomic_fetch_add(&session->readers[epoch & 1], 1);
+    return epoch;
+}
+
+// Helper function to stop using the version read after EnterReader
+static void LeaveReader(session_sf *session, unsigned long long epoch) {
+    atomic_fetch_sub(&session->readers[epoch & 1], 1);
+}
+
+// Helper function to wait for every reader that may still use a version the caller has just replaced
+static void WaitForReaders(session_sf *session) {
+    for (int advance = 0; advance < 2; advance++) {
+        unsigned long long epoch = atomic_fetch_add(&session->epoch, 1);
+        unsigned int spins = 0;
+        while (atomic_load(&session->readers[epoch & 1]) != 0) {
+            if (++spins >= SPINS_BEFORE_YIELD) {
+                sched_yield();
+                spins = 0;
+            }
+        }
+    }
+}
+
+// Helper function to free a handle along with the matrix the session owns through it
+static void FreeSessionHandle(MatrixHandle *handle) {
+    if (handle != NULL) {
+        free(handle->mat);
+        free(handle);
+    }
+}
+
+session_sf* create_session_sf(void) {
+    session_sf *session = calloc(1, sizeof(session_sf));
+    SymbolTable *version = malloc(sizeof(SymbolTable));
+    if (session == NULL || version == NULL) {
+        free(session);
+        free(version);
+        return NULL;
+    }
+    InitSymbols(version, NULL);
+    atomic_init(&session->current, version);
+    pthread_mutex_init(&session->writer_lock, NULL);
+    return session;
+}
+
+int set_session_matrix_sf(session_sf *session, char name, matrix_sf *mat) {
+    if (session == NULL) {
+        return 0;
+    }
+    MatrixHandle *handle = NULL;
+    if (mat != NULL) {
+        handle = malloc(sizeof(MatrixHandle));
+        if (handle == NULL) {
+            return 0;
+        }
+        handle->mat = mat;
+        handle->refs = 1;
+        handle->releasable = 1;
+        // Classified once here, instead of by every evaluation that reads it
+        handle->structure = ClassifyStructure(mat);
+    }
+    SymbolTable *version = malloc(sizeof(SymbolTable));
+    if (version == NULL) {
+        free(handle);
+        return 0;
+    }
+    // Nothing can fail from here on, so mat is only renamed once it is the session's. Readers can't see it before
+    // the version below is published.
+    if (mat != NULL) {
+        mat->name = name;
+    }
+
+    pthread_mutex_lock(&session->writer_lock);
+    SymbolTable *replaced_version = atomic_load(&session->current);
+    *version = *replaced_version;
+    MatrixHandle *replaced = version->bound[(unsigned char)name];
+    version->bound[(unsigned char)name] = handle;
+    atomic_store(&session->current, version);
+    WaitForReaders(session);
+    pthread_mutex_unlock(&session->writer_lock);
+
+    free(replaced_version);
+    FreeSessionHandle(replaced);
+    return 1;
+}
+
+matrix_sf* evaluate_session_sf(session_sf *session, char name, char *expr) {
+    if (session == NULL || expr == NULL) {
+        return NULL;
+    }
+    unsigned long long epoch = EnterReader(session);
+    const SymbolTable *version = atomic_load(&session->current);
+    matrix_sf *result = EvaluateSymbols(name, expr, version);
+    LeaveReader(session, epoch);
+    return result;
+}
+
+void free_session_sf(session_sf *session) {
+    if (session == NULL) {
+        return;
+    }
+    SymbolTable *version = atomic_load(&session->current);
+    for (unsigned int name = 0; name <= UCHAR_MAX; name++) {
+        FreeSessionHandle(version->bound[name]);
+    }
+    free(version);
+    pthread_mutex_destroy(&session->writer_lock);
+    free(session);
+}
@@ -0,0 +1,121 @@
+#include "hw7.h"
+#include "hw7_internal.h"
+
+// Kernels are generated for every shape with all dimensions up to SMALL_KERNEL_MAX_DIM. Past that, up to
+// SMALL_KERNEL_SQUARE_MAX, there are square products and transposes, and the matrix-vector products n x n by n x 1
+// and 1 x n by n x n; every other shape would multiply the code size for shapes scripts rarely use.
+#define SMALL_KERNEL_MAX_DIM 4
+#define SMALL_KERNEL_SQUARE_MAX 16
+
+// Every loop below has a compile-time trip count, so the optimizer unrolls it completely
+#define UNROLLED _Pragma("GCC unroll 16")
+
+// result (R x C) = left (R x K) * right (K x C)
+#define DEFINE_MULT_KERNEL(R, K, C) \
+    static void Mult##R##x##K##x##C(int *result, const int *left, const int *right) { \
+        UNROLLED for (unsigned int row = 0; row < R; row++) { \
+            UNROLLED for (unsigned int col = 0; col < C; col++) { \
+                int sum = 0; \
+                UNROLLED for (unsigned int inner = 0; inner < K; inner++) { \
+                    sum += left[row * K + inner] * right[inner * C + col]; \
+                } \
+                result[row * C + col] = sum; \
+            } \
+        } \
+    }
+
+// result (C x R) = mat (R x C) transposed
+#define DEFINE_TRANSPOSE_KERNEL(R, C) \
+    static void Transpose##R##x##C(int *result, const int *mat) { \
+        UNROLLED for (unsigned int row = 0; row < R; row++) { \
+            UNROLLED for (unsigned int col = 0; col < C; col++) { \
+                result[col * R + row] = mat[row * C + col]; \
+            } \
+        } \
+    }
+
+#define MULT_TABLE_ENTRY(R, K, C) [R][K][C] = Mult##R##x##K##x##C,
+#define TRANSPOSE_TABLE_ENTRY(R, C) [R][C] = Transpose##R##x##C,
+
+// Apply M to every (R, K, C) with dimensions 1 to 4. Each level needs its own macro, since
+// the preprocessor won't expand a macro inside its own expansion.
+#define EACH_SHAPE_C(M, R, K) M(R, K, 1) M(R, K, 2) M(R, K, 3) M(R, K, 4)
+#define EACH_SHAPE_K(M, R) EACH_SHAPE_C(M, R, 1) EACH_SHAPE_C(M, R, 2) EACH_SHAPE_C(M, R, 3) EACH_SHAPE_C(M, R, 4)
+#define EACH_MULT_SHAPE(M) EACH_SHAPE_K(M, 1) EACH_SHAPE_K(M, 2) EACH_SHAPE_K(M, 3) EACH_SHAPE_K(M, 4)
+#define EACH_TRANSPOSE_SHAPE_C(M, R) M(R, 1) M(R, 2) M(R, 3) M(R, 4)
+#define EACH_TRANSPOSE_SHAPE(M) \
+    EACH_TRANSPOSE_SHAPE_C(M, 1) EACH_TRANSPOSE_SHAPE_C(M, 2) EACH_TRANSPOSE_SHAPE_C(M, 3) EACH_TRANSPOSE_SHAPE_C(M, 4)
+
+// Apply M to every size past SMALL_KERNEL_MAX_DIM up to SMALL_KERNEL_SQUARE_MAX
+#define EACH_LARGER_SIZE(M) M(5) M(6) M(7) M(8) M(9) M(10) M(11) M(12) M(13) M(14) M(15) M(16)
+#define DEFINE_LARGER_KERNELS(N) \
+    DEFINE_MULT_KERNEL(N, N, N) DEFINE_MULT_KERNEL(N, N, 1) DEFINE_MULT_KERNEL(1, N, N) DEFINE_TRANSPOSE_KERNEL(N, N)
+#define SQUARE_MULT_TABLE_ENTRY(N) [N] = Mult##N##x##N##x##N,
+#define MATRIX_VECTOR_TABLE_ENTRY(N) [N] = Mult##N##x##N##x1,
+#define VECTOR_MATRIX_TABLE_ENTRY(N) [N] = Mult1x##N##x##N,
+#define SQUARE_TRANSPOSE_TABLE_ENTRY(N) [N] = Transpose##N##x##N,
+
+EACH_MULT_SHAPE(DEFINE_MULT_KERNEL)
+EACH_TRANSPOSE_SHAPE(DEFINE_TRANSPOSE_KERNEL)
+EACH_LARGER_SIZE(DEFINE_LARGER_KERNELS)
+
+// Shape-indexed dispatch tables; NULL where there is no specialised kernel
+static const SmallMultKernel MultKernels[SMALL_KERNEL_MAX_DIM + 1][SMALL_KERNEL_MAX_DIM + 1][SMALL_KERNEL_MAX_DIM + 1] = {
+    EACH_MULT_SHAPE(MULT_TABLE_ENTRY)
+};
+static const SmallTransposeKernel TransposeKernels[SMALL_KERNEL_MAX_DIM + 1][SMALL_KERNEL_MAX_DIM + 1] = {
+    EACH_TRANSPOSE_SHAPE(TRANSPOSE_TABLE_ENTRY)
+};
+// Indexed by n, for sizes past SMALL_KERNEL_MAX_DIM
+static const SmallMultKernel SquareMultKernels[SMALL_KERNEL_SQUARE_MAX + 1] = {
+    EACH_LARGER_SIZE(SQUARE_MULT_TABLE_ENTRY)
+};
+static const SmallMultKernel MatrixVectorKernels[SMALL_KERNEL_SQUARE_MAX + 1] = {
+    EACH_LARGER_SIZE(MATRIX_VECTOR_TABLE_ENTRY)
+};
+static const SmallMultKernel VectorMatrixKernels[SMALL_KERNEL_SQUARE_MAX + 1] = {
+    EACH_LARGER_SIZE(VECTOR_MATRIX_TABLE_ENTRY)
+};
+static const SmallTransposeKernel SquareTransposeKernels[SMALL_KERNEL_SQUARE_MAX + 1] = {
+    EACH_LARGER_SIZE(SQUARE_TRANSPOSE_TABLE_ENTRY)
+};
+
+// The specialised kernel for a (rows x inner) * (inner x cols) product, or NULL
+SmallMultKernel FindSmallMultKernel(unsigned int rows, unsigned int inner, unsigned int cols) {
+    // Past the tuned crossover the general loop is faster than the unrolled kernel on this machine
+    unsigned int max_dim = Tuning()->small_mult_max_dim;
+    if (rows > max_dim || inner > max_dim || cols > max_dim) {
+        return NULL;
+    }
+    if (rows <= SMALL_KERNEL_MAX_DIM && inner <= SMALL_KERNEL_MAX_DIM && cols <= SMALL_KERNEL_MAX_DIM) {
+        return MultKernels[rows][inner][cols];
+    }
+    if (inner > SMALL_KERNEL_SQUARE_MAX) {
+        return NULL;
+    }
+    if (rows == inner && inner == cols) {
+        return SquareMultKernels[inner];
+    }
+    if (rows == inner && cols == 1) {
+        return MatrixVectorKernels[inner];
+    }
+    if (rows == 1 && inner == cols) {
+        return VectorMatrixKernels[inner];
+    }
+    return NULL;
+}
+
+// The specialised kernel for transposing a rows x cols matrix, or NULL
+SmallTransposeKernel FindSmallTransposeKernel(unsigned int rows, unsigned int cols) {
+    unsigned int max_dim = Tuning()->small_transpose_max_dim;
+    if (rows > max_dim || cols > max_dim) {
+        return NULL;
+    }
+    if (rows <= SMALL_KERNEL_MAX_DIM && cols <= SMALL_KERNEL_MAX_DIM) {
+        return TransposeKernels[rows][cols];
+    }
+    if (rows == cols && rows <= SMALL_KERNEL_SQUARE_MAX) {
+        return SquareTransposeKernels[rows];
+    }
+    return NULL;
+}
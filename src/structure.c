@@ -0,0 +1,210 @@
+#include "hw7.h"
+#include "hw7_internal.h"
+
+// Helper function to check for structure that makes a lower-triangle entry zero (or the whole matrix diagonal)
+static int IsUpperLike(MatrixStructure structure) {
+    return structure == STRUCTURE_UPPER || structure == STRUCTURE_DIAGONAL;
+}
+
+// Helper function to check for structure that makes an upper-triangle entry zero (or the whole matrix diagonal)
+static int IsLowerLike(MatrixStructure structure) {
+    return structure == STRUCTURE_LOWER || structure == STRUCTURE_DIAGONAL;
+}
+
+// Helper function to check for structure that makes mat equal to its transpose
+static int IsSymmetricLike(MatrixStructure structure) {
+    return structure == STRUCTURE_SYMMETRIC || structure == STRUCTURE_DIAGONAL;
+}
+
+MatrixStructure ClassifyStructure(const matrix_sf *mat) {
+    unsigned int n = mat->num_rows;
+    if (n != mat->num_cols || n < STRUCTURE_MIN_DIM) {
+        return STRUCTURE_GENERAL;
+    }
+
+    // Walk the strictly lower triangle against its mirror image; a general matrix is ruled out within a few entries
+    int upper = 1, lower = 1, symmetric = 1;
+    for (unsigned int row = 1; row < n; row++) {
+        for (unsigned int col = 0; col < row; col++) {
+            int below = mat->values[row * n + col];
+            int above = mat->values[col * n + row];
+            upper &= below == 0;
+            lower &= above == 0;
+            symmetric &= below == above;
+        }
+        if (!upper && !lower && !symmetric) {
+            return STRUCTURE_GENERAL;
+        }
+    }
+    if (upper && lower) {
+        return STRUCTURE_DIAGONAL;
+    }
+    return upper ? STRUCTURE_UPPER : lower ? STRUCTURE_LOWER : STRUCTURE_SYMMETRIC;
+}
+
+MatrixStructure TransposedStructure(MatrixStructure structure) {
+    if (structure == STRUCTURE_UPPER) {
+        return STRUCTURE_LOWER;
+    }
+    if (structure == STRUCTURE_LOWER) {
+        return STRUCTURE_UPPER;
+    }
+    return structure;
+}
+
+MatrixStructure SumStructure(MatrixStructure left, MatrixStructure right) {
+    if (left == STRUCTURE_DIAGONAL && right == STRUCTURE_DIAGONAL) {
+        return STRUCTURE_DIAGONAL;
+    }
+    if (IsUpperLike(left) && IsUpperLike(right)) {
+        return STRUCTURE_UPPER;
+    }
+    if (IsLowerLike(left) && IsLowerLike(right)) {
+        return STRUCTURE_LOWER;
+    }
+    if (IsSymmetricLike(left) && IsSymmetricLike(right)) {
+        return STRUCTURE_SYMMETRIC;
+    }
+    return STRUCTURE_GENERAL;
+}
+
+MatrixStructure ProductStructure(MatrixStructure left, MatrixStructure right) {
+    if (left == STRUCTURE_DIAGONAL && right == STRUCTURE_DIAGONAL) {
+        return STRUCTURE_DIAGONAL;
+    }
+    if (IsUpperLike(left) && IsUpperLike(right)) {
+        return STRUCTURE_UPPER;
+    }
+    if (IsLowerLike(left) && IsLowerLike(right)) {
+        return STRUCTURE_LOWER;
+    }
+    // The product of two symmetric matrices is only symmetric if they commute
+    return STRUCTURE_GENERAL;
+}
+
+int MultStructured(matrix_sf *result, const matrix_sf *mat1, MatrixStructure left, const matrix_sf *mat2,
+                   MatrixStructure right) {
+    unsigned int rows = result->num_rows;
+    unsigned int cols = result->num_cols;
+    unsigned int inner = mat1->num_cols;
+    const int *a = mat1->values;
+    const int *b = mat2->values;
+    int *c = result->values;
+
+    if (left == STRUCTURE_DIAGONAL) {
+        // Row i of the product is row i of mat2 scaled by the i-th diagonal entry
+        for (unsigned int row = 0; row < rows; row++) {
+            int scale = a[row * inner + row];
+            for (unsigned int col = 0; col < cols; col++) {
+                c[row * cols + col] = scale * b[row * cols + col];
+            }
+        }
+        return 1;
+    }
+    if (right == STRUCTURE_DIAGONAL) {
+        // Column j of the product is column j of mat1 scaled by the j-th diagonal entry
+        for (unsigned int row = 0; row < rows; row++) {
+            for (unsigned int col = 0; col < cols; col++) {
+                c[row * cols + col] = a[row * inner + col] * b[col * cols + col];
+            }
+        }
+        return 1;
+    }
+    if (left != STRUCTURE_UPPER && left != STRUCTURE_LOWER && right != STRUCTURE_UPPER && right != STRUCTURE_LOWER) {
+        return 0;
+    }
+
+    // The i-k-j loop with the k and j ranges cut down to the operands' nonzero triangles
+    memset(c, 0, (size_t)rows * cols * sizeof(int));
+    for (unsigned int row = 0; row < rows; row++) {
+        unsigned int k_begin = left == STRUCTURE_UPPER ? row : 0;
+        unsigned int k_end = left == STRUCTURE_LOWER ? row + 1 : inner;
+        for (unsigned int k = k_begin; k < k_end; k++) {
+            int left_value = a[row * inner + k];
+            unsigned int j_begin = right == STRUCTURE_UPPER ? k : 0;
+            unsigned int j_end = right == STRUCTURE_LOWER ? k + 1 : cols;
+            for (unsigned int col = j_begin; col < j_end; col++) {
+                c[row * cols + col] += left_value * b[k * cols + col];
+            }
+        }
+    }
+    return 1;
+}
+
+int AddStructured(matrix_sf *result, const matrix_sf *mat1, MatrixStructure left, const matrix_sf *mat2,
+                  MatrixStructure right) {
+    const matrix_sf *diagonal = left == STRUCTURE_DIAGONAL ? mat1 : right == STRUCTURE_DIAGONAL ? mat2 : NULL;
+    // Overwriting the diagonal operand itself would lose its values before they are added
+    if (diagonal == NULL || result == diagonal) {
+        return 0;
+    }
+    const matrix_sf *other = diagonal == mat1 ? mat2 : mat1;
+    unsigned int n = result->num_rows;
+
+    // Only the diagonal has anything to add; when result is other's own storage nothing else even moves
+    if (result != other) {
+        memcpy(result->values, other->values, (size_t)n * n * sizeof(int));
+    }
+    for (unsigned int i = 0; i < n; i++) {
+        result->values[i * n + i] += diagonal->values[i * n + i];
+    }
+    return 1;
+}
+
+void MultByOwnTranspose(matrix_sf *result, const matrix_sf *mat) {
+    unsigned int n = mat->num_rows;
+    unsigned int inner = mat->num_cols;
+    // Entry (i, j) is the dot product of rows i and j, so both reads run along contiguous rows
+    for (unsigned int i = 0; i < n; i++) {
+        const int *row_i = mat->values + (size_t)i * inner;
+        for (unsigned int j = i; j < n; j++) {
+            const int *row_j = mat->values + (size_t)j * inner;
+            int sum = 0;
+            for (unsigned int k = 0; k < inner; k++) {
+                sum += row_i[k] * row_j[k];
+            }
+            result->values[i * n + j] = sum;
+            result->values[j * n + i] = sum;
+        }
+    }
+}
+
+void MultOwnTransposeBy(matrix_sf *result, const matrix_sf *mat) {
+    unsigned int n = mat->num_cols;
+    unsigned int rows = mat->num_rows;
+    int *c = result->values;
+    memset(c, 0, (size_t)n * n * sizeof(int));
+
+    // Each row of mat adds its outer product with itself; only the upper triangle is accumulated
+    for (unsigned int r = 0; r < rows; r++) {
+        const int *row = mat->values + (size_t)r * n;
+        for (unsigned int i = 0; i < n; i++) {
+            int scale = row[i];
+            if (scale == 0) {
+                continue;
+            }
+            for (unsigned int j = i; j < n; j++) {
+                c[i * n + j] += scale * row[j];
+            }
+        }
+    }
+    for (unsigned int i = 1; i < n; i++) {
+        for (unsigned int j = 0; j < i; j++) {
+            c[i * n + j] = c[j * n + i];
+        }
+    }
+}
+
+int MatchSelfTransposeProduct(const char *postfix) {
+    char operand = postfix[0];
+    if (operand < 'A' || operand > 'Z') {
+        return 0;
+    }
+    if (postfix[1] == operand && postfix[2] == '\'' && postfix[3] == '*') {
+        return SELF_TIMES_TRANSPOSE;
+    }
+    if (postfix[1] == '\'' && postfix[2] == operand && postfix[3] == '*') {
+        return TRANSPOSE_TIMES_SELF;
+    }
+    return 0;
+}
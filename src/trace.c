@@ -0,0 +1,206 @@
+#include <pthread.h>
+
+#include "hw7.h"
+#include "hw7_internal.h"
+
+// Events each thread can buffer between two write_trace_sf calls; later ones are dropped and counted
+#define TRACE_RING_CAPACITY 8192
+
+// One begin ('B') or end ('E') event
+typedef struct {
+    unsigned long long timestamp_ns;
+    const char *event;
+    char phase;
+    char matrix_name;
+    unsigned long long statement;
+    unsigned int shape[2][2];  // rows and cols of up to two matrices; 0 x 0 means no matrix
+} TraceEvent;
+
+// Single-producer ring: only the owning thread moves head, only the (locked) flusher moves tail. When its thread
+// exits the ring goes on the free list, and the next thread to trace takes it over with whatever is left in it.
+typedef struct TraceRing {
+    struct TraceRing *next;
+    struct TraceRing *next_free;
+    unsigned int thread_id;
+    atomic_ullong head;
+    atomic_ullong tail;
+    atomic_ullong dropped;
+    TraceEvent events[TRACE_RING_CAPACITY];
+} TraceRing;
+
+atomic_int TraceActive;
+
+static _Atomic(TraceRing *) TraceRings;
+static atomic_uint NextThreadId;
+static _Thread_local TraceRing *ThreadRing;
+static pthread_once_t ThreadRingKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t ThreadRingKey;
+static pthread_mutex_t FreeRingsLock = PTHREAD_MUTEX_INITIALIZER;
+static TraceRing *FreeRings;
+static pthread_mutex_t FlushLock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long long TraceEpochNs;
+
+// Helper function to put an exiting thread's ring on the free list
+static void ReleaseThreadRing(void *ring) {
+    pthread_mutex_lock(&FreeRingsLock);
+    ((TraceRing *)ring)->next_free = FreeRings;
+    FreeRings = ring;
+    pthread_mutex_unlock(&FreeRingsLock);
+    ThreadRing = NULL;
+}
+
+// Helper function to create the key whose destructor releases a thread's ring
+static void CreateThreadRingKey(void) {
+    pthread_key_create(&ThreadRingKey, ReleaseThreadRing);
+}
+
+// Helper function to give the calling thread its ring the first time it records an event: a ring an exited thread
+// released if there is one, otherwise a new one
+static TraceRing* ClaimThreadRing(void) {
+    pthread_once(&ThreadRingKeyOnce, CreateThreadRingKey);
+    pthread_mutex_lock(&FreeRingsLock);
+    TraceRing *ring = FreeRings;
+    if (ring != NULL) {
+        FreeRings = ring->next_free;
+    }
+    pthread_mutex_unlock(&FreeRingsLock);
+    if (ring != NULL) {
+        pthread_setspecific(ThreadRingKey, ring);
+        return ring;
+    }
+
+    ring = calloc(1, sizeof(TraceRing));
+    if (ring == NULL) {
+        return NULL;
+    }
+    ring->thread_id = atomic_fetch_add(&NextThreadId, 1) + 1;
+    pthread_setspecific(ThreadRingKey, ring);
+
+    // Push onto the global list; rings are never unlinked, so a flush can always walk it
+    TraceRing *first = atomic_load(&TraceRings);
+    do {
+        ring->next = first;
+    } while (!atomic_compare_exchange_weak(&TraceRings, &first, ring));
+    return ring;
+}
+
+// Helper function to copy a matrix's shape into an event slot
+static void RecordShape(unsigned int shape[2], const matrix_sf *mat) {
+    shape[0] = mat != NULL ? mat->num_rows : 0;
+    shape[1] = mat != NULL ? mat->num_cols : 0;
+}
+
+// Append one event to the calling thread's ring
+void TraceRecord(char phase, const char *event, char matrix_name, unsigned long long statement,
+                 const matrix_sf *first, const matrix_sf *second) {
+    if (ThreadRing == NULL) {
+        ThreadRing = ClaimThreadRing();
+        if (ThreadRing == NULL) {
+            return;
+        }
+    }
+    TraceRing *ring = ThreadRing;
+
+    unsigned long long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == TRACE_RING_CAPACITY) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    TraceEvent *slot = &ring->events[head % TRACE_RING_CAPACITY];
+    slot->timestamp_ns = NowNanoseconds();
+    slot->event = event;
+    slot->phase = phase;
+    slot->matrix_name = matrix_name;
+    slot->statement = statement;
+    RecordShape(slot->shape[0], first);
+    RecordShape(slot->shape[1], second);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// Helper function to print one event as a Chrome trace JSON object
+static void WriteEvent(FILE *file, const TraceEvent *slot, unsigned int thread_id, int pid) {
+    double timestamp_us = (double)(slot->timestamp_ns - TraceEpochNs) / 1000.0;
+    fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u,\"args\":{",
+            slot->event, slot->phase, timestamp_us, pid, thread_id);
+
+    const char *separator = "";
+    if (slot->statement != 0) {
+        fprintf(file, "\"statement\":%llu", slot->statement);
+        separator = ",";
+    }
+    if (slot->matrix_name != 0) {
+        fprintf(file, "%s\"matrix\":\"%c\"", separator, slot->matrix_name);
+        separator = ",";
+    }
+    for (int i = 0; i < 2; i++) {
+        if (slot->shape[i][0] == 0 && slot->shape[i][1] == 0) {
+            continue;
+        }
+        // Begin events carry the operands, end events the result
+        const char *key = slot->phase == 'E' ? "result" : i == 0 ? "left" : "right";
+        fprintf(file, "%s\"%s\":\"%ux%u\"", separator, key, slot->shape[i][0], slot->shape[i][1]);
+        separator = ",";
+    }
+    fprintf(file, "}}");
+}
+
+int start_trace_sf(void) {
+    if (TraceEpochNs == 0) {
+        TraceEpochNs = NowNanoseconds();
+    }
+    atomic_store(&TraceActive, 1);
+    return 1;
+}
+
+void stop_trace_sf(void) {
+    atomic_store(&TraceActive, 0);
+}
+
+int write_trace_sf(const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&FlushLock);
+    int pid = (int)getpid();
+    unsigned long long dropped = 0;
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"hw7\"}}", pid);
+
+    for (TraceRing *ring = atomic_load(&TraceRings); ring != NULL; ring = ring->next) {
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"hw7 thread %u\"}}",
+                pid, ring->thread_id, ring->thread_id);
+
+        // Drain what the owner has published so far; it may keep appending behind us
+        unsigned long long tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        unsigned long long head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        for (; tail < head; tail++) {
+            WriteEvent(file, &ring->events[tail % TRACE_RING_CAPACITY], ring->thread_id, pid);
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        dropped += atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+    }
+
+    fprintf(file, "\n],\"otherData\":{\"dropped_events\":%llu}}\n", dropped);
+    pthread_mutex_unlock(&FlushLock);
+    return fclose(file) == 0;
+}
+
+// Helper function to write the trace named by HW7_TRACE when the program exits
+static void WriteTraceAtExit(void) {
+    const char *filename = getenv("HW7_TRACE");
+    if (filename != NULL && !write_trace_sf(filename)) {
+        fprintf(stderr, "hw7 trace: can't write %s\n", filename);
+    }
+}
+
+// Helper function to start tracing from the first instruction if HW7_TRACE names an output file
+__attribute__((constructor)) static void StartTraceFromEnvironment(void) {
+    const char *filename = getenv("HW7_TRACE");
+    if (filename != NULL && filename[0] != '\0') {
+        start_trace_sf();
+        atexit(WriteTraceAtExit);
+    }
+}
@@ -0,0 +1,166 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "hw7.h"
+#include "hw7_internal.h"
+
+#define TUNING_PATH_LEN 4096
+
+// One profile entry: its name in the file and where it lives in tuning_sf
+typedef struct {
+    const char *name;
+    size_t offset;
+    int is_wide;  // unsigned long long rather than unsigned int
+} TuningField;
+
+static const TuningField TuningFields[] = {
+    {"mult_block_cols", offsetof(tuning_sf, mult_block_cols), 0},
+    {"transpose_block", offsetof(tuning_sf, transpose_block), 0},
+    {"small_mult_max_dim", offsetof(tuning_sf, small_mult_max_dim), 0},
+    {"small_transpose_max_dim", offsetof(tuning_sf, small_transpose_max_dim), 0},
+    {"parallel_mult_min_madds", offsetof(tuning_sf, parallel_mult_min_madds), 1},
+    {"parallel_add_min_values", offsetof(tuning_sf, parallel_add_min_values), 1},
+    {"parallel_transpose_min_values", offsetof(tuning_sf, parallel_transpose_min_values), 1},
+    {"fork_min_madds", offsetof(tuning_sf, fork_min_madds), 1},
+    {"stream_min_bytes", offsetof(tuning_sf, stream_min_bytes), 1},
+};
+
+// A tuning set_tuning_sf published. Kernels running on other threads may still be reading one that has been
+// replaced, so replaced tunings are kept (on the chain behind the active one) rather than freed.
+typedef struct PublishedTuning {
+    tuning_sf tuning;
+    struct PublishedTuning *replaced;
+} PublishedTuning;
+
+static pthread_once_t TuningOnce = PTHREAD_ONCE_INIT;
+static tuning_sf LoadedTuning;
+static _Atomic(PublishedTuning *) ActiveTuning;
+static pthread_mutex_t PublishLock = PTHREAD_MUTEX_INITIALIZER;
+static char TuningPath[TUNING_PATH_LEN];
+
+// Helper function to find the size of the last-level cache, or 0 if the system doesn't say
+static unsigned long long LastLevelCacheBytes(void) {
+    long bytes = 0;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    bytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+#ifdef _SC_LEVEL2_CACHE_SIZE
+    if (bytes <= 0) {
+        bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    }
+#endif
+    return bytes > 0 ? (unsigned long long)bytes : 0;
+}
+
+void default_tuning_sf(tuning_sf *tuning) {
+    // Whole-row multiplies and untiled transposes, every unrolled kernel, thread cutoffs at the few milliseconds
+    // of work where a thread start (tens of microseconds) stops mattering, and streaming stores for results that
+    // wouldn't fit in the last-level cache anyway
+    tuning->mult_block_cols = 0;
+    tuning->transpose_block = 0;
+    tuning->small_mult_max_dim = 16;
+    tuning->small_transpose_max_dim = 16;
+    tuning->parallel_mult_min_madds = 1ULL << 22;
+    tuning->parallel_add_min_values = 1ULL << 20;
+    tuning->parallel_transpose_min_values = 1ULL << 20;
+    tuning->fork_min_madds = 1ULL << 20;
+    tuning->stream_min_bytes = LastLevelCacheBytes();
+}
+
+int load_tuning_sf(const char *filename, tuning_sf *tuning) {
+    default_tuning_sf(tuning);
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char name[64];
+        unsigned long long value;
+        // Comments, blank lines and names this build doesn't know are skipped, so profiles outlive their builds
+        if (line[0] == '#' || sscanf(line, "%63s %llu", name, &value) != 2) {
+            continue;
+        }
+        for (size_t i = 0; i < sizeof(TuningFields) / sizeof(TuningFields[0]); i++) {
+            if (strcmp(name, TuningFields[i].name) != 0) {
+                continue;
+            }
+            char *field = (char *)tuning + TuningFields[i].offset;
+            if (TuningFields[i].is_wide) {
+                memcpy(field, &value, sizeof(unsigned long long));
+            } else {
+                unsigned int narrow = value > UINT_MAX ? UINT_MAX : (unsigned int)value;
+                memcpy(field, &narrow, sizeof(unsigned int));
+            }
+        }
+    }
+    fclose(file);
+    return 1;
+}
+
+int save_tuning_sf(const char *filename, const tuning_sf *tuning) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        return 0;
+    }
+    fprintf(file, "# hw7 tuning profile, written by autotune; 0 turns a block size or parallel path off\n");
+    for (size_t i = 0; i < sizeof(TuningFields) / sizeof(TuningFields[0]); i++) {
+        const char *field = (const char *)tuning + TuningFields[i].offset;
+        unsigned long long value;
+        if (TuningFields[i].is_wide) {
+            memcpy(&value, field, sizeof(unsigned long long));
+        } else {
+            unsigned int narrow;
+            memcpy(&narrow, field, sizeof(unsigned int));
+            value = narrow;
+        }
+        fprintf(file, "%s %llu\n", TuningFields[i].name, value);
+    }
+    return fclose(file) == 0;
+}
+
+// Helper function to work out the profile's path and load it (or the defaults) once
+static void LoadTuning(void) {
+    const char *configured = getenv("HW7_TUNE");
+    const char *home = getenv("HOME");
+    if (configured != NULL && configured[0] != '\0') {
+        snprintf(TuningPath, sizeof(TuningPath), "%s", configured);
+    } else {
+        snprintf(TuningPath, sizeof(TuningPath), "%s/.config/hw7/tune", home != NULL ? home : ".");
+    }
+    load_tuning_sf(TuningPath, &LoadedTuning);
+}
+
+const char* tuning_path_sf(void) {
+    pthread_once(&TuningOnce, LoadTuning);
+    return TuningPath;
+}
+
+const tuning_sf* Tuning(void) {
+    PublishedTuning *published = atomic_load_explicit(&ActiveTuning, memory_order_acquire);
+    if (published != NULL) {
+        return &published->tuning;
+    }
+    pthread_once(&TuningOnce, LoadTuning);
+    return &LoadedTuning;
+}
+
+void get_tuning_sf(tuning_sf *tuning) {
+    *tuning = *Tuning();
+}
+
+void set_tuning_sf(const tuning_sf *tuning) {
+    // Loading first keeps a later first use from loading the profile while this is being published
+    pthread_once(&TuningOnce, LoadTuning);
+    PublishedTuning *published = malloc(sizeof(PublishedTuning));
+    if (published == NULL) {
+        return;
+    }
+    published->tuning = *tuning;
+    // Readers only ever see a fully written copy; the lock orders publishers against each other
+    pthread_mutex_lock(&PublishLock);
+    published->replaced = atomic_load_explicit(&ActiveTuning, memory_order_relaxed);
+    atomic_store_explicit(&ActiveTuning, published, memory_order_release);
+    pthread_mutex_unlock(&PublishLock);
+}
@@ -0,0 +1,99 @@
+#include "hw7.h"
+#include "hw7_internal.h"
+
+MatrixView WholeMatrix(const matrix_sf *mat) {
+    return (MatrixView){mat->values, mat->num_rows, mat->num_cols, mat->num_cols};
+}
+
+const char* ParseSlice(const char *cursor, unsigned int num_rows, unsigned int num_cols, unsigned int *row_begin,
+                       unsigned int *row_end, unsigned int *col_begin, unsigned int *col_end) {
+    if (*cursor != '[') {
+        return NULL;
+    }
+    unsigned int extents[2] = {num_rows, num_cols};
+    unsigned int *begins[2] = {row_begin, col_begin};
+    unsigned int *ends[2] = {row_end, col_end};
+    cursor++;
+
+    // Each range is "a:b", "a:", ":b", ":" or a single index "a"; a missing bound means the edge of the matrix
+    for (int dim = 0; dim < 2; dim++) {
+        unsigned long long begin = 0, end = extents[dim];
+        int has_begin = *cursor >= '0' && *cursor <= '9';
+        if (has_begin) {
+            while (*cursor >= '0' && *cursor <= '9' && begin <= UINT_MAX) {
+                begin = begin * 10 + (unsigned long long)(*cursor++ - '0');
+            }
+            end = begin + 1;
+        }
+        if (*cursor == ':') {
+            cursor++;
+            end = extents[dim];
+            if (*cursor >= '0' && *cursor <= '9') {
+                end = 0;
+                while (*cursor >= '0' && *cursor <= '9' && end <= UINT_MAX) {
+                    end = end * 10 + (unsigned long long)(*cursor++ - '0');
+                }
+            }
+        } else if (!has_begin) {
+            return NULL;
+        }
+        if (*cursor != (dim == 0 ? ',' : ']') || begin >= end || end > extents[dim]) {
+            return NULL;
+        }
+        cursor++;
+        *begins[dim] = (unsigned int)begin;
+        *ends[dim] = (unsigned int)end;
+    }
+    return cursor;
+}
+
+void CopyView(matrix_sf *result, MatrixView mat) {
+    for (unsigned int row = 0; row < mat.num_rows; row++) {
+        memcpy(result->values + (size_t)row * mat.num_cols, mat.values + (size_t)row * mat.stride,
+               (size_t)mat.num_cols * sizeof(int));
+    }
+}
+
+void AddViews(matrix_sf *result, MatrixView left, MatrixView right) {
+    PROFILE_BEGIN(PROFILE_ADD_SF);
+    unsigned int cols = left.num_cols;
+    for (unsigned int row = 0; row < left.num_rows; row++) {
+        int *out = result->values + (size_t)row * cols;
+        const int *left_row = left.values + (size_t)row * left.stride;
+        const int *right_row = right.values + (size_t)row * right.stride;
+        for (unsigned int col = 0; col < cols; col++) {
+            out[col] = left_row[col] + right_row[col];
+        }
+    }
+    PROFILE_END(PROFILE_ADD_SF, 0, 0);
+}
+
+void MultViews(matrix_sf *result, MatrixView left, MatrixView right) {
+    PROFILE_BEGIN(PROFILE_MULT_SF);
+    unsigned int cols = right.num_cols;
+    memset(result->values, 0, (size_t)left.num_rows * cols * sizeof(int));
+    // The i-k-j loop, reading each operand row where its view puts it
+    for (unsigned int row = 0; row < left.num_rows; row++) {
+        int *out = result->values + (size_t)row * cols;
+        const int *left_row = left.values + (size_t)row * left.stride;
+        for (unsigned int k = 0; k < left.num_cols; k++) {
+            int left_value = left_row[k];
+            const int *right_row = right.values + (size_t)k * right.stride;
+            for (unsigned int col = 0; col < cols; col++) {
+                out[col] += left_value * right_row[col];
+            }
+        }
+    }
+    PROFILE_END(PROFILE_MULT_SF, 0, (unsigned long long)left.num_rows * left.num_cols * cols);
+}
+
+void TransposeView(matrix_sf *result, MatrixView mat) {
+    PROFILE_BEGIN(PROFILE_TRANSPOSE_SF);
+    for (unsigned int row = 0; row < mat.num_rows; row++) {
+        const int *source = mat.values + (size_t)row * mat.stride;
+        for (unsigned int col = 0; col < mat.num_cols; col++) {
+            result->values[(size_t)col * mat.num_rows + row] = source[col];
+        }
+    }
+    PROFILE_END(PROFILE_TRANSPOSE_SF, 0, 0);
+}
@@ -1,3 +1,1780 @@
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
 #include "unit_tests.h"
 
 TestSuite(student_tests, .timeout=TEST_TIMEOUT); 
+
+/* pool_sf tests */
+Test(student_tests, pool_reuse01, .description="Released blocks are handed out again from the same size class") {
+    pool_sf *pool = create_pool_sf();
+    void *first = alloc_pool_sf(pool, sizeof(bst_sf));
+    void *second = alloc_pool_sf(pool, sizeof(bst_sf));
+    cr_expect_neq(first, second);
+    release_pool_sf(pool, first, sizeof(bst_sf));
+    cr_expect_eq(alloc_pool_sf(pool, 30), first, "A 30-byte request should reuse the released 32-byte block.");
+    void *large = alloc_pool_sf(pool, 100000);
+    cr_expect_not_null(large);
+    release_pool_sf(pool, large, 100000);
+    free_pool_sf(pool);
+}
+
+Test(student_tests, pool_reset01, .description="Reset hands the same slab memory to the next script") {
+    pool_sf *pool = create_pool_sf();
+    void *before = alloc_pool_sf(pool, 64);
+    alloc_pool_sf(pool, 200000);
+    reset_pool_sf(pool);
+    cr_expect_eq(alloc_pool_sf(pool, 64), before);
+    free_pool_sf(pool);
+}
+
+Test(student_tests, pool_script01, .description="One pool can run many scripts back to back") {
+    pool_sf *pool = create_pool_sf();
+    for (int round = 0; round < 3; round++) {
+        matrix_sf *pooled = execute_script_pool_sf(TEST_INPUT_DIR "/script14.txt", pool);
+        matrix_sf *plain = execute_script_sf(TEST_INPUT_DIR "/script14.txt");
+        expect_matrices_equal(pooled, plain->num_rows, plain->num_cols, plain->values);
+        cr_expect_eq(pooled->name, plain->name);
+        free(pooled);
+        free(plain);
+    }
+    free_pool_sf(pool);
+}
+
+/* matrix_writer_sf tests */
+static size_t read_back(FILE *file, char *buffer, size_t capacity) {
+    rewind(file);
+    size_t length = fread(buffer, 1, capacity - 1, file);
+    buffer[length] = '\0';
+    return length;
+}
+
+Test(student_tests, writer_text01, .description="Text output matches the print_matrix_sf format") {
+    matrix_sf *mat = copy_matrix(2, 3, (int[]){0, -7, 2147483647, -2147483647 - 1, 10, 99});
+    FILE *file = tmpfile();
+    matrix_writer_sf writer;
+    init_writer_sf(&writer, fileno(file), MATRIX_TEXT_SF);
+    cr_expect_eq(write_matrix_sf(&writer, mat), 1);
+    cr_expect_eq(flush_writer_sf(&writer), 1);
+    char output[200];
+    read_back(file, output, sizeof(output));
+    cr_expect_str_eq(output, "2 3 0 -7 2147483647 -2147483648 10 99\n");
+    fclose(file);
+    free(mat);
+}
+
+Test(student_tests, writer_binary01, .description="Binary output is a header followed by the raw values") {
+    int values[] = {1, -2, 3, -4};
+    matrix_sf *mat = copy_matrix(2, 2, values);
+    FILE *file = tmpfile();
+    matrix_writer_sf writer;
+    init_writer_sf(&writer, fileno(file), MATRIX_BINARY_SF);
+    write_matrix_sf(&writer, mat);
+    flush_writer_sf(&writer);
+    char output[200];
+    size_t length = read_back(file, output, sizeof(output));
+    cr_expect_eq(length, sizeof(matrix_file_header_sf) + sizeof(values));
+    matrix_file_header_sf header;
+    memcpy(&header, output, sizeof(header));
+    cr_expect_arr_eq(header.magic, MATRIX_FILE_MAGIC, 4);
+    cr_expect_eq(header.num_rows, 2);
+    cr_expect_eq(header.num_cols, 2);
+    cr_expect_arr_eq(output + sizeof(header), values, sizeof(values));
+    fclose(file);
+    free(mat);
+}
+
+Test(student_tests, writer_large01, .description="Matrices bigger than 1000x1000 can be written") {
+    unsigned int rows = 1200, cols = 1001;
+    matrix_sf *mat = calloc(1, sizeof(matrix_sf) + (size_t)rows * cols * sizeof(int));
+    mat->num_rows = rows;
+    mat->num_cols = cols;
+    mat->values[(size_t)rows * cols - 1] = -5;
+    FILE *file = tmpfile();
+    matrix_writer_sf *writer = malloc(sizeof(matrix_writer_sf));
+    init_writer_sf(writer, fileno(file), MATRIX_TEXT_SF);
+    cr_expect_eq(write_matrix_sf(writer, mat), 1);
+    cr_expect_eq(flush_writer_sf(writer), 1);
+    fseek(file, 0, SEEK_END);
+    // "1200 1001 " + (n-1) "0 " + "-5\n"
+    cr_expect_eq(ftell(file), 10 + ((long)rows * cols - 1) * 2 + 3);
+    fclose(file);
+    free(writer);
+    free(mat);
+}
+
+/* mult_files_sf tests */
+static matrix_sf* make_pattern_matrix(unsigned int rows, unsigned int cols, int seed) {
+    matrix_sf *mat = malloc(sizeof(matrix_sf) + (size_t)rows * cols * sizeof(int));
+    mat->name = '?';
+    mat->num_rows = rows;
+    mat->num_cols = cols;
+    for (size_t i = 0; i < (size_t)rows * cols; i++)
+        mat->values[i] = (int)((i * 7919 + (size_t)seed * 104729) % 201) - 100;
+    return mat;
+}
+
+// Tests that check kernel choices or fork decisions run with the built-in tuning, whatever profile the machine has
+static void use_default_tuning(void) {
+    tuning_sf tuning;
+    default_tuning_sf(&tuning);
+    set_tuning_sf(&tuning);
+}
+
+Test(student_tests, mult_files01, .description="Out-of-core multiply with many tiles matches mult_mats_sf") {
+    matrix_sf *A = make_pattern_matrix(150, 97, 1);
+    matrix_sf *B = make_pattern_matrix(97, 133, 2);
+    char left[] = TEST_OUTPUT_DIR "/ooc_left.bin", right[] = TEST_OUTPUT_DIR "/ooc_right.bin", product[] = TEST_OUTPUT_DIR "/ooc_product.bin";
+    cr_assert_eq(save_matrix_sf(left, A, MATRIX_BINARY_SF), 1);
+    cr_assert_eq(save_matrix_sf(right, B, MATRIX_BINARY_SF), 1);
+    // The smallest budget forces 48x48 tiles, so every dimension has a partial edge tile
+    cr_expect_eq(mult_files_sf(left, right, product, 0), 1);
+    matrix_sf *expected = mult_mats_sf(A, B);
+    matrix_sf *actual = load_matrix_sf(product);
+    cr_assert_not_null(actual);
+    expect_matrices_equal(actual, 150, 133, expected->values);
+    free(A);
+    free(B);
+    free(expected);
+    free(actual);
+}
+
+Test(student_tests, mult_files03, .description="Out-of-core multiply sizes its tiles to the operands, not only to a huge budget") {
+    matrix_sf *A = make_pattern_matrix(100, 37, 5);
+    matrix_sf *B = make_pattern_matrix(37, 100, 6);
+    char left[] = TEST_OUTPUT_DIR "/ooc_small_left.bin", right[] = TEST_OUTPUT_DIR "/ooc_small_right.bin";
+    char product[] = TEST_OUTPUT_DIR "/ooc_small_product.bin";
+    cr_assert_eq(save_matrix_sf(left, A, MATRIX_BINARY_SF), 1);
+    cr_assert_eq(save_matrix_sf(right, B, MATRIX_BINARY_SF), 1);
+    // Tiles sized from a 1 TiB budget alone would need more than a terabyte of buffers
+    cr_expect_eq(mult_files_sf(left, right, product, (size_t)1 << 40), 1);
+    matrix_sf *expected = mult_mats_sf(A, B);
+    matrix_sf *actual = load_matrix_sf(product);
+    cr_assert_not_null(actual);
+    expect_matrices_equal(actual, 100, 100, expected->values);
+    free(A);
+    free(B);
+    free(expected);
+    free(actual);
+}
+
+Test(student_tests, mult_files02, .description="Out-of-core multiply rejects mismatched shapes") {
+    matrix_sf *A = make_pattern_matrix(4, 5, 1);
+    char left[] = TEST_OUTPUT_DIR "/ooc_bad.bin", product[] = TEST_OUTPUT_DIR "/ooc_bad_product.bin";
+    save_matrix_sf(left, A, MATRIX_BINARY_SF);
+    cr_expect_eq(mult_files_sf(left, left, product, 1 << 20), 0);
+    free(A);
+}
+
+/* execute_script_pipelined_sf tests */
+Test(student_tests, pipelined01, .description="The pipelined executor gives the same result as execute_script_sf on every script") {
+    for (int i = 1; i <= 20; i++) {
+        char script[100];
+        sprintf(script, TEST_INPUT_DIR "/script%02d.txt", i);
+        matrix_sf *expected = execute_script_sf(script);
+        pipeline_stats_sf stats;
+        matrix_sf *actual = execute_script_pipelined_sf(script, 2, &stats);
+        cr_assert_not_null(actual);
+        cr_expect_eq(actual->name, expected->name);
+        expect_matrices_equal(actual, expected->num_rows, expected->num_cols, expected->values);
+        cr_expect_eq(stats.parse_threads, 2);
+        cr_expect_geq(stats.elapsed_ns, stats.eval_stall_ns);
+        free(expected);
+        free(actual);
+    }
+}
+
+Test(student_tests, pipelined02, .description="Scripts longer than the statement queue keep their order") {
+    char script[] = TEST_OUTPUT_DIR "/pipelined02.txt";
+    FILE *file = fopen(script, "w");
+    fprintf(file, "A = 2 2 [1 2 ; 3 4 ; ]\n");
+    for (int i = 0; i < 300; i++) {
+        // Three statements per round, far more than fit in the statement queue at once
+        fprintf(file, "B = 2 2 [%d 0 ; 0 1 ; ]\n\n", i % 3);
+        fprintf(file, "%c = A * B + A\n", i % 2 ? 'A' : 'C');
+        fprintf(file, "A = C'\n");
+    }
+    fclose(file);
+    matrix_sf *expected = execute_script_sf(script);
+    pipeline_stats_sf stats;
+    matrix_sf *actual = execute_script_pipelined_sf(script, 0, &stats);
+    expect_matrices_equal(actual, expected->num_rows, expected->num_cols, expected->values);
+    cr_expect_eq(stats.statements, 901);
+    free(expected);
+    free(actual);
+}
+
+Test(student_tests, pipelined03, .description="The pipelined executor stops at the first statement that doesn't validate, and sizes itself by HW7_THREADS") {
+    char script[] = TEST_OUTPUT_DIR "/pipelined03.txt";
+    FILE *file = fopen(script, "w");
+    fprintf(file, "A = 2 2 [1 2 ; 3 4 ; ]\nD = 3 1 [1 ; 2 ; 3 ; ]\n");
+    for (int i = 0; i < 200; i++)
+        fprintf(file, "B = A * A + A\n");
+    // Well past the statement queue, so the statements before it are already running when the reader gets here
+    fprintf(file, "C = A * D\n");
+    for (int i = 0; i < 100; i++)
+        fprintf(file, "B = A'\n");
+    fclose(file);
+    setenv("HW7_THREADS", "5", 1);
+    pipeline_stats_sf stats;
+    cr_expect_null(execute_script_pipelined_sf(script, 0, &stats));
+    cr_expect_eq(stats.statements, 202);
+    // The reader and the evaluator each have a core of their own
+    cr_expect_eq(stats.parse_threads, 3);
+}
+
+/* execute_script_stats_sf tests */
+Test(student_tests, script_stats01, .description="execute_script_stats_sf gives the same result as execute_script_sf and counts every statement") {
+    matrix_sf *expected = execute_script_sf(TEST_INPUT_DIR "/script05.txt");
+    script_stats_sf stats;
+    matrix_sf *actual = execute_script_stats_sf(TEST_INPUT_DIR "/script05.txt", &stats);
+    cr_assert_not_null(actual);
+    cr_expect_eq(actual->name, expected->name);
+    expect_matrices_equal(actual, expected->num_rows, expected->num_cols, expected->values);
+    cr_expect_eq(stats.statements, 2);
+    cr_expect_leq(stats.parse_ns + stats.evaluate_ns + stats.free_ns, stats.elapsed_ns);
+    free(expected);
+    free(actual);
+}
+
+Test(student_tests, script_stats02, .description="execute_script_stats_sf reports a missing script") {
+    script_stats_sf stats;
+    cr_expect_null(execute_script_stats_sf(TEST_INPUT_DIR "/no_such_script.txt", &stats));
+    cr_expect_eq(stats.statements, 0);
+}
+
+/* profiling counter tests */
+Test(student_tests, profile01, .description="Profiling counters count kernel calls in a profiling build and stay at zero otherwise") {
+    int left_values[] = {1, 2, 3, 4, 5, 6};
+    int right_values[] = {1, 0, 0, 1, 1, 1, 0, 1, 0, 0, 1, 1};
+    matrix_sf *left = copy_matrix(2, 3, left_values);
+    matrix_sf *right = copy_matrix(3, 4, right_values);
+    reset_profile_sf();
+    matrix_sf *product = mult_mats_sf(left, right);
+    matrix_sf *transposed = transpose_mat_sf(product);
+    profile_counter_sf mult, transpose, add;
+    get_profile_sf(PROFILE_MULT_SF, &mult);
+    get_profile_sf(PROFILE_TRANSPOSE_SF, &transpose);
+    get_profile_sf(PROFILE_ADD_SF, &add);
+    if (profile_enabled_sf()) {
+        cr_expect_eq(mult.calls, 1);
+        cr_expect_eq(mult.multiply_adds, 24);
+        cr_expect_eq(mult.bytes_allocated, sizeof(matrix_sf) + 8 * sizeof(int));
+        cr_expect_eq(transpose.calls, 1);
+        cr_expect_eq(transpose.multiply_adds, 0);
+    } else {
+        cr_expect_eq(mult.calls, 0);
+        cr_expect_eq(mult.cycles, 0);
+        cr_expect_eq(transpose.calls, 0);
+    }
+    cr_expect_eq(add.calls, 0);
+    free(left);
+    free(right);
+    free(product);
+    free(transposed);
+}
+
+Test(student_tests, profile02, .description="Evaluating a script counts its statements, lookups and inserts") {
+    reset_profile_sf();
+    matrix_sf *result = execute_script_sf(TEST_INPUT_DIR "/script05.txt");
+    profile_counter_sf create, evaluate, insert;
+    get_profile_sf(PROFILE_CREATE_SF, &create);
+    get_profile_sf(PROFILE_EVALUATE_SF, &evaluate);
+    get_profile_sf(PROFILE_INSERT_BST_SF, &insert);
+    unsigned long long expected_calls = profile_enabled_sf() ? 1 : 0;
+    cr_expect_eq(create.calls, expected_calls);
+    cr_expect_eq(evaluate.calls, expected_calls);
+    cr_expect_eq(insert.calls, 2 * expected_calls);
+    cr_expect_eq(insert.bytes_allocated, 2 * expected_calls * sizeof(bst_sf));
+    cr_expect_str_eq(profile_op_name_sf(PROFILE_EVALUATE_SF), "evaluate_expr_sf");
+    free(result);
+}
+
+/* trace tests */
+static unsigned int count_occurrences(const char *text, const char *pattern) {
+    unsigned int count = 0;
+    for (const char *match = strstr(text, pattern); match != NULL; match = strstr(match + 1, pattern))
+        count++;
+    return count;
+}
+
+Test(student_tests, trace01, .description="A traced script run writes matched begin/end events tagged with shapes") {
+    char trace_file[] = TEST_OUTPUT_DIR "/trace01.json";
+    cr_assert_eq(start_trace_sf(), 1);
+    matrix_sf *result = execute_script_sf(TEST_INPUT_DIR "/script05.txt");
+    stop_trace_sf();
+    cr_assert_eq(write_trace_sf(trace_file), 1);
+    FILE *file = fopen(trace_file, "r");
+    char trace[8192];
+    read_back(file, trace, sizeof(trace));
+    fclose(file);
+    cr_expect_eq(count_occurrences(trace, "\"name\":\"statement\",\"ph\":\"B\""), 2);
+    cr_expect_eq(count_occurrences(trace, "\"name\":\"statement\",\"ph\":\"E\""), 2);
+    cr_expect_eq(count_occurrences(trace, "\"ph\":\"B\""), count_occurrences(trace, "\"ph\":\"E\""));
+    cr_expect_not_null(strstr(trace, "\"name\":\"transpose\",\"ph\":\"B\""));
+    cr_expect_not_null(strstr(trace, "\"args\":{\"statement\":2,\"matrix\":\"G\"}"));
+    cr_expect_not_null(strstr(trace, "\"left\":\"7x7\""));
+    free(result);
+}
+
+Test(student_tests, trace02, .description="Writing a trace drains the buffers, and nothing is recorded while tracing is off") {
+    char trace_file[] = TEST_OUTPUT_DIR "/trace02.json";
+    matrix_sf *mat = copy_matrix(1, 2, (int[]){1, 2});
+    mat->name = 'A';
+    bst_sf *root = insert_bst_sf(mat, NULL);
+    start_trace_sf();
+    free(evaluate_expr_sf('X', "A' * A", root));
+    stop_trace_sf();
+    free_bst_sf(root);
+    cr_assert_eq(write_trace_sf(trace_file), 1);
+    free(execute_script_sf(TEST_INPUT_DIR "/script05.txt"));
+    cr_assert_eq(write_trace_sf(trace_file), 1);
+    FILE *file = fopen(trace_file, "r");
+    char trace[8192];
+    read_back(file, trace, sizeof(trace));
+    fclose(file);
+    cr_expect_eq(count_occurrences(trace, "\"ph\":\"B\""), 0);
+    cr_expect_not_null(strstr(trace, "\"dropped_events\":0"));
+}
+
+static void* run_trace03_thread(void *arg) {
+    free(evaluate_expr_sf('X', "A' * A", arg));
+    return NULL;
+}
+
+Test(student_tests, trace03, .description="Threads that trace one after another reuse the rings of the threads before them") {
+    char trace_file[] = TEST_OUTPUT_DIR "/trace03.json";
+    matrix_sf *mat = copy_matrix(1, 2, (int[]){1, 2});
+    mat->name = 'A';
+    bst_sf *root = insert_bst_sf(mat, NULL);
+    char trace[32768];
+    unsigned int rings[2];
+    start_trace_sf();
+    for (int round = 0; round < 2; round++) {
+        // One thread the first time, eight in a row the second: each takes over the ring the last one released
+        for (int i = 0; i < (round == 0 ? 1 : 8); i++) {
+            pthread_t thread;
+            pthread_create(&thread, NULL, run_trace03_thread, root);
+            pthread_join(thread, NULL);
+        }
+        cr_assert_eq(write_trace_sf(trace_file), 1);
+        FILE *file = fopen(trace_file, "r");
+        read_back(file, trace, sizeof(trace));
+        fclose(file);
+        rings[round] = count_occurrences(trace, "\"name\":\"thread_name\"");
+    }
+    stop_trace_sf();
+    free_bst_sf(root);
+    cr_expect_eq(rings[1], rings[0]);
+    cr_expect_eq(count_occurrences(trace, "\"name\":\"syrk\",\"ph\":\"B\""), 8);
+}
+
+/* explain_script_sf tests */
+Test(student_tests, explain01, .description="explain_script_sf infers shapes and counts multiply-adds, and analyse mode agrees") {
+    use_default_tuning();
+    char script[] = TEST_OUTPUT_DIR "/explain01.txt";
+    FILE *file = fopen(script, "w");
+    fprintf(file, "A = 2 3 [1 2 3 ; 4 5 6 ; ]\n\nB = A * A'\nC = (B + B) * A\n");
+    fclose(file);
+    FILE *out = tmpfile();
+    script_estimate_sf totals;
+    cr_expect_eq(explain_script_sf(script, out, 1, &totals), 1);
+    cr_expect_eq(totals.statements, 3);
+    cr_expect_eq(totals.errors, 0);
+    // A * A' only computes one triangle of its 2x2 product
+    cr_expect_eq(totals.multiply_adds, 3 * 3 + 2 * 2 * 3);
+    char output[2048];
+    read_back(out, output, sizeof(output));
+    fclose(out);
+    cr_expect_not_null(strstr(output, "2x2"));
+    cr_expect_not_null(strstr(output, "syrk"));
+    cr_expect_not_null(strstr(output, "add,mult/small"));
+    cr_expect_eq(count_occurrences(output, " ok\n"), 3);
+}
+
+Test(student_tests, explain02, .description="explain_script_sf reports shape mismatches and undefined names without running anything") {
+    char script[] = TEST_OUTPUT_DIR "/explain02.txt";
+    FILE *file = fopen(script, "w");
+    fprintf(file, "A = 2 3 [1 2 3 ; 4 5 6 ; ]\nB = A * A\nC = A + A'\nD = A' * Q\nE = A' * A\n");
+    fclose(file);
+    FILE *out = tmpfile();
+    script_estimate_sf totals;
+    cr_expect_eq(explain_script_sf(script, out, 0, &totals), 0);
+    cr_expect_eq(totals.statements, 5);
+    cr_expect_eq(totals.errors, 3);
+    cr_expect_eq(totals.multiply_adds, 6 * 2);
+    char output[2048];
+    read_back(out, output, sizeof(output));
+    fclose(out);
+    cr_expect_not_null(strstr(output, "can't multiply 2x3 by 2x3"));
+    cr_expect_not_null(strstr(output, "can't add 2x3 and 3x2"));
+    cr_expect_not_null(strstr(output, "Q is not defined"));
+    cr_expect_eq(explain_script_sf(TEST_INPUT_DIR "/no_such_script.txt", stdout, 0, NULL), 0);
+}
+
+/* shape validation tests */
+Test(student_tests, validate01, .description="A badly shaped script is rejected up front with the line and the shapes") {
+    char script[] = TEST_OUTPUT_DIR "/validate01.txt";
+    FILE *file = fopen(script, "w");
+    fprintf(file, "A = 2 3 [1 2 3 ; 4 5 6 ; ]\nB = A * A'\n\nC = B + A\nD = C * C\n");
+    fclose(file);
+    char error[200];
+    cr_expect_eq(validate_script_sf(script, error, sizeof(error)), 0);
+    cr_expect_str_eq(error, "line 4 (C): can't add 2x2 and 2x3");
+    cr_expect_null(execute_script_sf(script));
+    cr_expect_null(execute_script_pipelined_sf(script, 1, NULL));
+    cr_expect_eq(validate_script_sf(TEST_INPUT_DIR "/script14.txt", error, sizeof(error)), 1);
+    cr_expect_str_eq(error, "");
+}
+
+Test(student_tests, validate02, .description="The checked kernels and evaluate_expr_sf return NULL on mismatched shapes") {
+    matrix_sf *mat = copy_matrix(2, 3, (int[]){1, 2, 3, 4, 5, 6});
+    mat->name = 'A';
+    matrix_sf *other = copy_matrix(3, 2, (int[]){1, 2, 3, 4, 5, 6});
+    other->name = 'B';
+    cr_expect_null(add_mats_sf(mat, other));
+    cr_expect_null(mult_mats_sf(mat, mat));
+    bst_sf *root = insert_bst_sf(other, insert_bst_sf(mat, NULL));
+    cr_expect_null(evaluate_expr_sf('C', "(A * B + A * B) * (A + B)", root));
+    matrix_sf *good = evaluate_expr_sf('C', "(A * B + A * B)' * A", root);
+    expect_matrices_equal(good, 2, 3, (int[]){436, 578, 720, 568, 752, 936});
+    free(good);
+    free_bst_sf(root);
+}
+
+Test(student_tests, validate03, .description="A literal create_matrix_sf can't build fails validation instead of leaving its name to a later definition") {
+    char script[] = TEST_OUTPUT_DIR "/validate03.txt";
+    FILE *file = fopen(script, "w");
+    fprintf(file, "A = 2 2 1 2 3 4\nA = 3 3 [1 2 3; 4 5 6; 7 8 9]\nB = 2 2 [1 2; 3 4]\nC = A + B\n");
+    fclose(file);
+    char error[200];
+    cr_expect_eq(validate_script_sf(script, error, sizeof(error)), 0);
+    cr_expect_str_eq(error, "line 1 (A): malformed matrix literal");
+    cr_expect_null(execute_script_sf(script));
+    cr_expect_null(execute_script_pipelined_sf(script, 1, NULL));
+    cr_expect_null(execute_script_stats_sf(script, &(script_stats_sf){0}));
+}
+
+Test(student_tests, small_kernels, .description="The specialised small-shape kernels agree with the general loops") {
+    use_default_tuning();
+    // Every size with a kernel, and the first one without
+    unsigned int dims[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17};
+    unsigned int dim_count = sizeof(dims) / sizeof(dims[0]);
+    for (unsigned int r = 0; r < dim_count; r++)
+        for (unsigned int k = 0; k < dim_count; k++)
+            for (unsigned int c = 0; c < dim_count; c++) {
+                unsigned int rows = dims[r], inner = dims[k], cols = dims[c];
+                matrix_sf *left = make_pattern_matrix(rows, inner, 7);
+                matrix_sf *right = make_pattern_matrix(inner, cols, 3);
+                matrix_sf *product = mult_mats_sf(left, right);
+                int *expected = calloc(rows * cols, sizeof(int));
+                for (unsigned int row = 0; row < rows; row++)
+                    for (unsigned int i = 0; i < inner; i++)
+                        for (unsigned int col = 0; col < cols; col++)
+                            expected[row * cols + col] += left->values[row * inner + i] * right->values[i * cols + col];
+                expect_matrices_equal(product, rows, cols, expected);
+
+                matrix_sf *transposed = transpose_mat_sf(left);
+                for (unsigned int row = 0; row < rows; row++)
+                    for (unsigned int i = 0; i < inner; i++)
+                        cr_expect_eq(transposed->values[i * rows + row], left->values[row * inner + i]);
+                free(expected);
+                free(left);
+                free(right);
+                free(product);
+                free(transposed);
+            }
+}
+
+Test(student_tests, eval_scratch, .description="Evaluation gives the same result whether temporaries fit in the scratch buffer or spill to the heap") {
+    for (unsigned int n = 2; n <= 24; n += 11) {
+        matrix_sf *mat = make_pattern_matrix(n, n, 5);
+        mat->name = 'A';
+        matrix_sf *other = make_pattern_matrix(n, n, 9);
+        other->name = 'B';
+        bst_sf *root = insert_bst_sf(other, insert_bst_sf(mat, NULL));
+        matrix_sf *result = evaluate_expr_sf('C', "(A * B + B')' + (A + B) * A' + A", root);
+
+        matrix_sf *product = mult_mats_sf(mat, other);
+        matrix_sf *transposed_other = transpose_mat_sf(other);
+        matrix_sf *sum = add_mats_sf(product, transposed_other);
+        matrix_sf *first = transpose_mat_sf(sum);
+        matrix_sf *both = add_mats_sf(mat, other);
+        matrix_sf *transposed_mat = transpose_mat_sf(mat);
+        matrix_sf *second = mult_mats_sf(both, transposed_mat);
+        matrix_sf *partial = add_mats_sf(first, second);
+        matrix_sf *expected = add_mats_sf(partial, mat);
+        cr_expect_eq(result->name, 'C');
+        expect_matrices_equal(result, n, n, expected->values);
+
+        matrix_sf *pieces[] = {result, product, transposed_other, sum, first, both, transposed_mat, second, partial, expected};
+        for (unsigned int i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++)
+            free(pieces[i]);
+        free_bst_sf(root);
+    }
+}
+
+/* parallel create_matrix_sf tests */
+static char* write_literal(unsigned int rows, unsigned int cols, const char *row_separator) {
+    char *literal = malloc((size_t)rows * cols * 8 + (size_t)rows * 4 + 64);
+    char *cursor = literal + sprintf(literal, "%u %u [", rows, cols);
+    for (unsigned int row = 0; row < rows; row++) {
+        for (unsigned int col = 0; col < cols; col++)
+            cursor += sprintf(cursor, "%d ", (int)((row * 31 + col * 17) % 2001) - 1000);
+        cursor += sprintf(cursor, "%s", row_separator);
+    }
+    sprintf(cursor, "]");
+    return literal;
+}
+
+Test(student_tests, parallel_create01, .description="A large literal parsed on 4 threads matches the values it was written from") {
+    setenv("HW7_THREADS", "4", 1);
+    unsigned int rows = 700, cols = 300;
+    char *literal = write_literal(rows, cols, "; ");
+    matrix_sf *mat = create_matrix_sf('L', literal);
+    cr_assert_not_null(mat);
+    cr_expect_eq(mat->name, 'L');
+    cr_expect_eq(mat->num_rows, rows);
+    cr_expect_eq(mat->num_cols, cols);
+    int mismatches = 0;
+    for (unsigned int row = 0; row < rows; row++)
+        for (unsigned int col = 0; col < cols; col++)
+            mismatches += mat->values[row * cols + col] != (int)((row * 31 + col * 17) % 2001) - 1000;
+    cr_expect_eq(mismatches, 0);
+    free(mat);
+    free(literal);
+}
+
+Test(student_tests, parallel_create02, .description="A large literal with ragged rows falls back to the serial parser") {
+    setenv("HW7_THREADS", "4", 1);
+    unsigned int rows = 700, cols = 300;
+    // Declared with one column too many: every row is short by one value
+    char *literal = write_literal(rows, cols, "; ");
+    char *declared = strchr(literal, ' ');
+    memcpy(declared, " 301", 4);
+    matrix_sf *mat = create_matrix_sf('L', literal);
+    cr_assert_not_null(mat);
+    cr_expect_eq(mat->num_cols, cols + 1);
+    // Serial parser: the short row reads a 0 at the ';' and the next row carries on from there
+    cr_expect_eq(mat->values[cols], 0);
+    cr_expect_eq(mat->values[cols + 1], -1000 + 31);
+    free(mat);
+    free(literal);
+}
+
+/* result cache tests */
+Test(student_tests, cache01, .description="A repeated script is answered whole and renamed statements hit per statement") {
+    char script[] = TEST_OUTPUT_DIR "/cache01.txt";
+    char renamed[] = TEST_OUTPUT_DIR "/cache01_renamed.txt";
+    FILE *file = fopen(script, "w");
+    fprintf(file, "A = 2 2 [1 2 ; 3 4 ; ]\nB = 2 2 [5 6 ; 7 8 ; ]\nC = A * B + A\n");
+    fclose(file);
+    file = fopen(renamed, "w");
+    fprintf(file, "X = 2 2 [1 2 ; 3 4 ; ]\n\nY = 2 2 [5 6 ; 7 8 ; ]\nZ = (X*Y) + X\n");
+    fclose(file);
+
+    cache_sf *cache = create_cache_sf(1 << 20, NULL);
+    cache_stats_sf stats;
+    matrix_sf *first = execute_script_cached_sf(script, cache);
+    expect_matrices_equal(first, 2, 2, (int[]){20, 24, 46, 54});
+    cr_expect_eq(first->name, 'C');
+    get_cache_stats_sf(cache, &stats);
+    cr_expect_eq(stats.hits, 0);
+    cr_expect_eq(stats.misses, 4);
+    cr_expect_eq(stats.insertions, 4);
+
+    matrix_sf *again = execute_script_cached_sf(script, cache);
+    expect_matrices_equal(again, 2, 2, first->values);
+    cr_expect_eq(again->name, 'C');
+    get_cache_stats_sf(cache, &stats);
+    cr_expect_eq(stats.hits, 1);
+    cr_expect_eq(stats.misses, 4);
+
+    matrix_sf *other = execute_script_cached_sf(renamed, cache);
+    expect_matrices_equal(other, 2, 2, first->values);
+    cr_expect_eq(other->name, 'Z');
+    get_cache_stats_sf(cache, &stats);
+    cr_expect_eq(stats.hits, 4);
+    cr_expect_eq(stats.misses, 5);
+    cr_expect_eq(stats.entries, 5);
+    free(first);
+    free(again);
+    free(other);
+    free_cache_sf(cache);
+}
+
+Test(student_tests, cache02, .description="Entries evicted from a small memory tier come back from the disk tier") {
+    char script[] = TEST_OUTPUT_DIR "/cache02.txt";
+    FILE *file = fopen(script, "w");
+    fprintf(file, "A = 2 3 [1 2 3 ; 4 5 6 ; ]\nA = 1 1 [9 ; ]\nB = A * A'\nC = B + B\nD = C * B'\n");
+    fclose(file);
+    matrix_sf *expected = execute_script_sf(script);
+    char directory[64];
+    snprintf(directory, sizeof(directory), TEST_OUTPUT_DIR "/cache02.%d.d", (int)getpid());
+
+    // Room for about two of the 2x2 results, so the LRU tier keeps evicting
+    cache_sf *small = create_cache_sf(2 * (sizeof(matrix_sf) + 4 * sizeof(int)), directory);
+    cr_assert_not_null(small);
+    matrix_sf *result = execute_script_cached_sf(script, small);
+    expect_matrices_equal(result, 2, 2, expected->values);
+    cache_stats_sf stats;
+    get_cache_stats_sf(small, &stats);
+    cr_expect_gt(stats.evictions, 0);
+    cr_expect_leq(stats.bytes, 2 * (sizeof(matrix_sf) + 4 * sizeof(int)));
+    free(result);
+    free_cache_sf(small);
+
+    cache_sf *reopened = create_cache_sf(1 << 20, directory);
+    result = execute_script_cached_sf(script, reopened);
+    expect_matrices_equal(result, 2, 2, expected->values);
+    cr_expect_eq(result->name, 'D');
+    get_cache_stats_sf(reopened, &stats);
+    cr_expect_eq(stats.disk_hits, 1);
+    cr_expect_eq(stats.misses, 0);
+    free(result);
+    free(expected);
+    free_cache_sf(reopened);
+}
+
+typedef struct {
+    const char *script;
+    const char *directory;
+    matrix_sf *result;
+} cache03_thread;
+
+static void* run_cache03_thread(void *arg) {
+    cache03_thread *thread = arg;
+    // No memory tier: every result goes straight to disk
+    cache_sf *cache = create_cache_sf(0, thread->directory);
+    thread->result = execute_script_cached_sf((char *)thread->script, cache);
+    free_cache_sf(cache);
+    return NULL;
+}
+
+Test(student_tests, cache03, .description="Threads spilling the same results at once leave whole files and no temporaries") {
+    char script[] = TEST_OUTPUT_DIR "/cache03.txt";
+    FILE *file = fopen(script, "w");
+    // Results big enough that a spill is still writing when the next thread starts on the same key
+    fprintf(file, "A = 128 64 [");
+    for (int i = 0; i < 128 * 64; i++)
+        fprintf(file, "%d %s", i % 7, i % 64 == 63 ? "; " : "");
+    fprintf(file, "]\nB = A * A'\nC = B + B\nD = C * B'\n");
+    fclose(file);
+    matrix_sf *expected = execute_script_sf(script);
+    char directory[64];
+    snprintf(directory, sizeof(directory), TEST_OUTPUT_DIR "/cache03.%d.d", (int)getpid());
+
+    cache03_thread threads[8];
+    pthread_t ids[8];
+    for (int i = 0; i < 8; i++) {
+        threads[i] = (cache03_thread){script, directory, NULL};
+        pthread_create(&ids[i], NULL, run_cache03_thread, &threads[i]);
+    }
+    for (int i = 0; i < 8; i++) {
+        pthread_join(ids[i], NULL);
+        expect_matrices_equal(threads[i].result, 128, 128, expected->values);
+        free(threads[i].result);
+    }
+
+    DIR *listing = opendir(directory);
+    cr_assert_not_null(listing);
+    unsigned int files = 0;
+    for (struct dirent *entry = readdir(listing); entry != NULL; entry = readdir(listing)) {
+        if (entry->d_name[0] == '.')
+            continue;
+        files++;
+        size_t length = strlen(entry->d_name);
+        cr_expect(length > 4 && strcmp(entry->d_name + length - 4, ".msf") == 0, "left behind %s", entry->d_name);
+    }
+    closedir(listing);
+    cr_expect_gt(files, 0);
+
+    cache_sf *reopened = create_cache_sf(1 << 20, directory);
+    matrix_sf *result = execute_script_cached_sf(script, reopened);
+    expect_matrices_equal(result, 128, 128, expected->values);
+    cache_stats_sf stats;
+    get_cache_stats_sf(reopened, &stats);
+    cr_expect_eq(stats.misses, 0);
+    free(result);
+    free(expected);
+    free_cache_sf(reopened);
+}
+
+/* shared matrix tests */
+Test(student_tests, alias01, .description="Evaluating a bare name gives a new matrix and leaves the named one alone") {
+    matrix_sf *mat = copy_matrix(2, 2, (int[]){1, 2, 3, 4});
+    mat->name = 'A';
+    bst_sf *root = insert_bst_sf(mat, NULL);
+    matrix_sf *alias = evaluate_expr_sf('B', "(A)", root);
+    cr_assert_not_null(alias);
+    cr_expect_neq(alias, mat);
+    cr_expect_eq(alias->name, 'B');
+    expect_matrices_equal(alias, 2, 2, mat->values);
+    cr_expect_eq(mat->name, 'A');
+    cr_expect_eq(find_bst_sf('A', root), mat);
+    free(alias);
+
+    // Long chains used to run temporary names into the letters
+    char chain[200] = "A";
+    for (int i = 0; i < 40; i++)
+        strcat(chain, i % 2 ? " + A" : " * A'");
+    matrix_sf *long_result = evaluate_expr_sf('C', chain, root);
+    cr_assert_not_null(long_result);
+    cr_expect_eq(long_result->name, 'C');
+    cr_expect_eq(mat->name, 'A');
+    free(long_result);
+    free_bst_sf(root);
+}
+
+Test(student_tests, alias02, .description="Aliases and redefinitions in a script share matrices and keep first-definition semantics") {
+    char script[] = TEST_OUTPUT_DIR "/alias02.txt";
+    FILE *file = fopen(script, "w");
+    fprintf(file, "A = 2 2 [1 2 ; 3 4 ; ]\nB = A\nC = B + A\nA = 1 1 [7 ; ]\nB = C * A\nD = (B)\nE = A + D\nF = E\n");
+    fclose(file);
+    // A and B keep their first definitions, so C = 2A, D = A, E = 2A and F = E
+    int expected[] = {2, 4, 6, 8};
+    matrix_sf *result = execute_script_sf(script);
+    expect_matrices_equal(result, 2, 2, expected);
+    cr_expect_eq(result->name, 'F');
+    free(result);
+    result = execute_script_pipelined_sf(script, 2, NULL);
+    expect_matrices_equal(result, 2, 2, expected);
+    cr_expect_eq(result->name, 'F');
+    free(result);
+
+    file = fopen(script, "w");
+    fprintf(file, "A = 2 2 [1 2 ; 3 4 ; ]\nB = 2 2 [1 0 ; 0 1 ; ]\nA = B\n");
+    fclose(file);
+    result = execute_script_sf(script);
+    expect_matrices_equal(result, 2, 2, (int[]){1, 0, 0, 1});
+    cr_expect_eq(result->name, 'A');
+    free(result);
+}
+
+/* in-place kernel tests */
+Test(student_tests, in_place01, .description="add_into_sf, transpose_in_place_sf and mult_into_sf match the allocating kernels") {
+    unsigned int shapes[][2] = {{1, 5}, {5, 1}, {4, 4}, {3, 7}, {7, 3}, {16, 9}, {2, 64}};
+    for (unsigned int i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+        matrix_sf *mat = make_pattern_matrix(shapes[i][0], shapes[i][1], (int)i);
+        matrix_sf *expected = transpose_mat_sf(mat);
+        cr_expect_eq(transpose_in_place_sf(mat), 1);
+        expect_matrices_equal(mat, shapes[i][1], shapes[i][0], expected->values);
+        free(mat);
+        free(expected);
+    }
+
+    matrix_sf *left = make_pattern_matrix(3, 5, 1);
+    matrix_sf *right = make_pattern_matrix(5, 2, 2);
+    matrix_sf *other = make_pattern_matrix(3, 2, 3);
+    matrix_sf *product = mult_mats_sf(left, right);
+    matrix_sf *sum = add_mats_sf(product, other);
+    matrix_sf *result = make_pattern_matrix(3, 2, 4);
+    cr_expect_eq(mult_into_sf(result, left, right, 0), 1);
+    expect_matrices_equal(result, 3, 2, product->values);
+    cr_expect_eq(add_into_sf(result, other), 1);
+    expect_matrices_equal(result, 3, 2, sum->values);
+    memcpy(result->values, other->values, 6 * sizeof(int));
+    cr_expect_eq(mult_into_sf(result, left, right, 1), 1);
+    expect_matrices_equal(result, 3, 2, sum->values);
+
+    cr_expect_eq(add_into_sf(result, left), 0);
+    cr_expect_eq(mult_into_sf(result, right, left, 0), 0);
+    cr_expect_eq(mult_into_sf(other, other, result, 0), 0);
+    matrix_sf *pieces[] = {left, right, other, product, sum, result};
+    for (unsigned int i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++)
+        free(pieces[i]);
+}
+
+Test(student_tests, in_place02, .description="Expressions that transpose and accumulate into temporaries give the same result, and explain shows it") {
+    use_default_tuning();
+    matrix_sf *A = make_pattern_matrix(3, 4, 1), *B = make_pattern_matrix(4, 5, 2), *C = make_pattern_matrix(5, 6, 3);
+    matrix_sf *D = make_pattern_matrix(6, 3, 4), *E = make_pattern_matrix(5, 3, 5);
+    A->name = 'A'; B->name = 'B'; C->name = 'C'; D->name = 'D'; E->name = 'E';
+    bst_sf *root = NULL;
+    matrix_sf *mats[] = {A, B, C, D, E};
+    for (int i = 0; i < 5; i++)
+        root = insert_bst_sf(mats[i], root);
+    matrix_sf *result = evaluate_expr_sf('R', "(A * B)' + C * D + E", root);
+
+    matrix_sf *product = mult_mats_sf(A, B);
+    matrix_sf *transposed = transpose_mat_sf(product);
+    matrix_sf *second = mult_mats_sf(C, D);
+    matrix_sf *partial = add_mats_sf(transposed, second);
+    matrix_sf *expected = add_mats_sf(partial, E);
+    expect_matrices_equal(result, 5, 3, expected->values);
+    matrix_sf *pieces[] = {result, product, transposed, second, partial, expected};
+    for (unsigned int i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++)
+        free(pieces[i]);
+    free_bst_sf(root);
+
+    char script[] = TEST_OUTPUT_DIR "/in_place02.txt";
+    FILE *file = fopen(script, "w");
+    fprintf(file, "A = 2 3 [1 2 3 ; 4 5 6 ; ]\nC = 3 2 [1 4 ; 2 5 ; 3 6 ; ]\nB = (A * C)' + A * C\n");
+    fclose(file);
+    FILE *out = tmpfile();
+    cr_expect_eq(explain_script_sf(script, out, 1, NULL), 1);
+    char output[2048];
+    read_back(out, output, sizeof(output));
+    fclose(out);
+    cr_expect_not_null(strstr(output, "mult/small,transpose/in-place,mult/accumulate"));
+    result = execute_script_sf(script);
+    expect_matrices_equal(result, 2, 2, (int[]){28, 64, 64, 154});
+    free(result);
+}
+
+/* Structure-aware kernel tests */
+// Zero the entries of a square matrix that the given structure ('D', 'U' or 'L') says are zero
+static matrix_sf* make_structured_matrix(unsigned int n, int seed, char structure) {
+    matrix_sf *mat = make_pattern_matrix(n, n, seed);
+    for (unsigned int row = 0; row < n; row++)
+        for (unsigned int col = 0; col < n; col++)
+            if ((structure == 'D' && row != col) || (structure == 'U' && row > col) || (structure == 'L' && row < col))
+                mat->values[row * n + col] = 0;
+    return mat;
+}
+
+static void write_matrix_statement(FILE *file, char name, const matrix_sf *mat) {
+    fprintf(file, "%c = %u %u [", name, mat->num_rows, mat->num_cols);
+    for (unsigned int row = 0; row < mat->num_rows; row++) {
+        for (unsigned int col = 0; col < mat->num_cols; col++)
+            fprintf(file, "%d ", mat->values[row * mat->num_cols + col]);
+        fprintf(file, "; ");
+    }
+    fprintf(file, "]\n");
+}
+
+Test(student_tests, structure01, .description="A * A' and A' * A match the general multiply, alone and inside larger expressions") {
+    matrix_sf *A = make_pattern_matrix(20, 7, 1), *B = make_pattern_matrix(20, 20, 2);
+    A->name = 'A'; B->name = 'B';
+    bst_sf *root = insert_bst_sf(B, insert_bst_sf(A, NULL));
+    matrix_sf *At = transpose_mat_sf(A);
+    matrix_sf *outer = mult_mats_sf(A, At), *inner = mult_mats_sf(At, A);
+    matrix_sf *outer_plus = add_mats_sf(outer, B);
+
+    matrix_sf *result = evaluate_expr_sf('R', "A * A'", root);
+    expect_matrices_equal(result, 20, 20, outer->values);
+    free(result);
+    result = evaluate_expr_sf('R', "A' * A", root);
+    expect_matrices_equal(result, 7, 7, inner->values);
+    free(result);
+    result = evaluate_expr_sf('R', "B + (A * A')'", root);
+    expect_matrices_equal(result, 20, 20, outer_plus->values);
+    free(result);
+
+    char script[] = TEST_OUTPUT_DIR "/structure01.txt";
+    FILE *file = fopen(script, "w");
+    write_matrix_statement(file, 'A', A);
+    write_matrix_statement(file, 'B', B);
+    fprintf(file, "C = A * A'\nD = C' + B\n");
+    fclose(file);
+    result = execute_script_sf(script);
+    expect_matrices_equal(result, 20, 20, outer_plus->values);
+    free(result);
+
+    matrix_sf *pieces[] = {At, outer, inner, outer_plus};
+    for (unsigned int i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++)
+        free(pieces[i]);
+    free_bst_sf(root);
+}
+
+Test(student_tests, structure02, .description="Products and sums with diagonal and triangular operands match the general kernels") {
+    matrix_sf *D = make_structured_matrix(20, 3, 'D'), *U = make_structured_matrix(20, 4, 'U');
+    matrix_sf *L = make_structured_matrix(20, 5, 'L'), *G = make_pattern_matrix(20, 20, 6);
+    // One entry below the diagonal makes N general, even though it is otherwise upper triangular
+    matrix_sf *N = make_structured_matrix(20, 7, 'U');
+    N->values[19 * 20] = 5;
+    D->name = 'D'; U->name = 'U'; L->name = 'L'; G->name = 'G'; N->name = 'N';
+    bst_sf *root = NULL;
+    matrix_sf *mats[] = {D, U, L, G, N};
+    for (int i = 0; i < 5; i++)
+        root = insert_bst_sf(mats[i], root);
+    // The BST's operands are taken as general; a session's are classified when they are set
+    session_sf *session = create_session_sf();
+    for (int i = 0; i < 5; i++) {
+        matrix_sf *copy = malloc(sizeof(matrix_sf) + 20 * 20 * sizeof(int));
+        memcpy(copy, mats[i], sizeof(matrix_sf) + 20 * 20 * sizeof(int));
+        cr_assert_eq(set_session_matrix_sf(session, mats[i]->name, copy), 1);
+    }
+
+    struct { const char *expr; matrix_sf *left, *right; char op; } cases[] = {
+        {"D * G", D, G, '*'}, {"G * D", G, D, '*'}, {"U * G", U, G, '*'}, {"G * U", G, U, '*'},
+        {"L * G", L, G, '*'}, {"G * L", G, L, '*'}, {"U * L", U, L, '*'}, {"L * U", L, U, '*'},
+        {"U * U", U, U, '*'}, {"D * D", D, D, '*'}, {"N * G", N, G, '*'}, {"G * N", G, N, '*'},
+        {"D + G", D, G, '+'}, {"G + D", G, D, '+'}, {"D + D", D, D, '+'},
+    };
+    for (unsigned int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        matrix_sf *expected = cases[i].op == '*' ? mult_mats_sf(cases[i].left, cases[i].right)
+                                                 : add_mats_sf(cases[i].left, cases[i].right);
+        matrix_sf *result = evaluate_expr_sf('R', (char *)cases[i].expr, root);
+        cr_expect_not_null(result, "%s", cases[i].expr);
+        if (result != NULL)
+            expect_matrices_equal(result, 20, 20, expected->values);
+        free(result);
+        result = evaluate_session_sf(session, 'R', (char *)cases[i].expr);
+        cr_expect_not_null(result, "%s", cases[i].expr);
+        if (result != NULL)
+            expect_matrices_equal(result, 20, 20, expected->values);
+        free(result);
+        free(expected);
+    }
+    free_session_sf(session);
+
+    // Structure carried through temporaries: U' is lower, U * U is upper, and (D * U)' * G + D mixes them
+    char script[] = TEST_OUTPUT_DIR "/structure02.txt";
+    FILE *file = fopen(script, "w");
+    write_matrix_statement(file, 'D', D);
+    write_matrix_statement(file, 'U', U);
+    write_matrix_statement(file, 'G', G);
+    fprintf(file, "X = (D * U)' * G + D\n");
+    fclose(file);
+    matrix_sf *DU = mult_mats_sf(D, U), *DUt = transpose_mat_sf(DU), *product = mult_mats_sf(DUt, G);
+    matrix_sf *expected = add_mats_sf(product, D);
+    matrix_sf *result = execute_script_sf(script);
+    expect_matrices_equal(result, 20, 20, expected->values);
+    matrix_sf *pieces[] = {DU, DUt, product, expected, result};
+    for (unsigned int i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++)
+        free(pieces[i]);
+    free_bst_sf(root);
+}
+
+/* Power operator tests */
+Test(student_tests, power01, .description="A^k converts to postfix with its exponent and matches repeated multiplication") {
+    char *postfix = infix2postfix_sf("(A + B)^12' * C ^ 3");
+    cr_expect_str_eq(postfix, "AB+^12'C^3*");
+    free(postfix);
+    postfix = infix2postfix_sf("B * A'^2");
+    cr_expect_str_eq(postfix, "BA'^2*");
+    free(postfix);
+    cr_expect_null(infix2postfix_sf("A^"));
+    cr_expect_null(infix2postfix_sf("A^1234567890"));
+
+    // Entries of -1, 0 and 1 keep every power well inside an int
+    matrix_sf *A = make_pattern_matrix(6, 6, 1), *U = make_structured_matrix(20, 2, 'U'), *C = make_pattern_matrix(2, 3, 3);
+    for (unsigned int i = 0; i < 6 * 6; i++)
+        A->values[i] %= 2;
+    for (unsigned int i = 0; i < 20 * 20; i++)
+        U->values[i] = U->values[i] != 0;
+    A->name = 'A'; U->name = 'U'; C->name = 'C';
+    bst_sf *root = insert_bst_sf(C, insert_bst_sf(U, insert_bst_sf(A, NULL)));
+
+    matrix_sf *expected = make_pattern_matrix(6, 6, 0);
+    for (unsigned int i = 0; i < 36; i++)
+        expected->values[i] = i % 7 == 0;
+    char expr[16];
+    for (unsigned int k = 0; k <= 9; k++) {
+        sprintf(expr, "A^%u", k);
+        matrix_sf *result = evaluate_expr_sf('R', expr, root);
+        expect_matrices_equal(result, 6, 6, expected->values);
+        free(result);
+        matrix_sf *next = mult_mats_sf(expected, A);
+        free(expected);
+        expected = next;
+    }
+    free(expected);
+
+    matrix_sf *U2 = mult_mats_sf(U, U), *U4 = mult_mats_sf(U2, U2), *U5 = mult_mats_sf(U4, U);
+    matrix_sf *result = evaluate_expr_sf('R', "U^5", root);
+    expect_matrices_equal(result, 20, 20, U5->values);
+    free(result);
+    cr_expect_null(evaluate_expr_sf('R', "C^2", root));
+    free(U2); free(U4); free(U5);
+    free_bst_sf(root);
+}
+
+Test(student_tests, power02, .description="Scripts use A^k, and explain and validate account for its squarings and its shape rule") {
+    use_default_tuning();
+    char script[] = TEST_OUTPUT_DIR "/power02.txt";
+    FILE *file = fopen(script, "w");
+    fprintf(file, "A = 2 2 [1 1 ; 1 0 ; ]\nB = A^10 + A^0\n");
+    fclose(file);
+    // A^10 holds Fibonacci numbers: F(11) F(10) ; F(10) F(9)
+    matrix_sf *result = execute_script_sf(script);
+    expect_matrices_equal(result, 2, 2, (int[]){90, 55, 55, 35});
+    free(result);
+
+    FILE *out = tmpfile();
+    script_estimate_sf totals;
+    cr_expect_eq(explain_script_sf(script, out, 1, &totals), 1);
+    // 10 is 1010 in binary: three squarings and one multiply by A
+    cr_expect_eq(totals.multiply_adds, 4 * 2 * 2 * 2);
+    char output[2048];
+    read_back(out, output, sizeof(output));
+    fclose(out);
+    cr_expect_not_null(strstr(output, "power,power,add/in-place"));
+    cr_expect_eq(count_occurrences(output, " ok\n"), 2);
+
+    file = fopen(script, "w");
+    fprintf(file, "A = 2 3 [1 2 3 ; 4 5 6 ; ]\nB = A^2\n");
+    fclose(file);
+    char error[128];
+    cr_expect_eq(validate_script_sf(script, error, sizeof(error)), 0);
+    cr_expect_not_null(strstr(error, "can't raise 2x3 to a power"));
+    cr_expect_null(execute_script_sf(script));
+}
+
+/* Reduction tests */
+Test(student_tests, reduce01, .description="trace, sum and norm match reducing the materialised result, fused or not") {
+    char *postfix = infix2postfix_sf("trace(A * B) * sum(C' + D)");
+    cr_expect_str_eq(postfix, "AB*tC'D+s*");
+    free(postfix);
+    postfix = infix2postfix_sf("norm ((A))");
+    cr_expect_str_eq(postfix, "An");
+    free(postfix);
+    cr_expect_null(infix2postfix_sf("foo(A)"));
+    cr_expect_null(infix2postfix_sf("trace A"));
+
+    matrix_sf *A = make_pattern_matrix(5, 7, 1), *B = make_pattern_matrix(7, 5, 2), *C = make_pattern_matrix(5, 7, 3);
+    A->name = 'A'; B->name = 'B'; C->name = 'C';
+    bst_sf *root = insert_bst_sf(C, insert_bst_sf(B, insert_bst_sf(A, NULL)));
+    matrix_sf *AB = mult_mats_sf(A, B), *AC = add_mats_sf(A, C), *At = transpose_mat_sf(A), *AAt = mult_mats_sf(A, At);
+    int trace_AB = 0, sum_AB = 0, sum_AC = 0, norm_AC = 0, norm_AB = 0, sum_A = 0, trace_AAt = 0;
+    for (unsigned int i = 0; i < 25; i++) {
+        sum_AB += AB->values[i];
+        norm_AB += AB->values[i] * AB->values[i];
+        trace_AB += i % 6 == 0 ? AB->values[i] : 0;
+        trace_AAt += i % 6 == 0 ? AAt->values[i] : 0;
+    }
+    for (unsigned int i = 0; i < 35; i++) {
+        sum_AC += AC->values[i];
+        norm_AC += AC->values[i] * AC->values[i];
+        sum_A += A->values[i];
+    }
+    struct { const char *expr; int expected; } cases[] = {
+        {"trace(A * B)", trace_AB}, {"sum(A * B)", sum_AB}, {"norm(A * B)", norm_AB}, {"trace(B' * A')", trace_AB},
+        {"sum(A + C)", sum_AC}, {"norm(C + A)", norm_AC}, {"sum(A')", sum_A}, {"trace(A * A')", trace_AAt},
+        {"trace(A * B + A * B)", 2 * trace_AB}, {"sum(A * (B + B))", 2 * sum_AB},
+    };
+    for (unsigned int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        matrix_sf *result = evaluate_expr_sf('R', (char *)cases[i].expr, root);
+        cr_expect_not_null(result, "%s", cases[i].expr);
+        if (result != NULL)
+            expect_matrices_equal(result, 1, 1, (int[]){cases[i].expected});
+        free(result);
+    }
+    cr_expect_null(evaluate_expr_sf('R', "trace(A)", root));
+    cr_expect_null(evaluate_expr_sf('R', "trace(A * C)", root));
+    matrix_sf *pieces[] = {AB, AC, At, AAt};
+    for (unsigned int i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++)
+        free(pieces[i]);
+    free_bst_sf(root);
+
+    // Large enough to be split across cores
+    matrix_sf *L = make_pattern_matrix(520, 520, 4), *R = make_pattern_matrix(520, 520, 5);
+    L->name = 'L'; R->name = 'R';
+    root = insert_bst_sf(R, insert_bst_sf(L, NULL));
+    unsigned int big_trace = 0, big_sum = 0, big_norm = 0;
+    for (unsigned int i = 0; i < 520; i++) {
+        unsigned int row_sum = 0;
+        for (unsigned int k = 0; k < 520; k++) {
+            big_trace += (unsigned int)L->values[i * 520 + k] * (unsigned int)R->values[k * 520 + i];
+            row_sum += (unsigned int)R->values[i * 520 + k];
+            unsigned int pair = (unsigned int)L->values[i * 520 + k] + (unsigned int)R->values[i * 520 + k];
+            big_norm += pair * pair;
+        }
+        for (unsigned int row = 0; row < 520; row++)
+            big_sum += (unsigned int)L->values[row * 520 + i] * row_sum;
+    }
+    int expected_big[] = {(int)big_trace, (int)big_sum, (int)big_norm};
+    const char *big_exprs[] = {"trace(L * R)", "sum(L * R)", "norm(L + R)"};
+    for (unsigned int i = 0; i < 3; i++) {
+        matrix_sf *result = evaluate_expr_sf('R', (char *)big_exprs[i], root);
+        expect_matrices_equal(result, 1, 1, &expected_big[i]);
+        free(result);
+    }
+    free_bst_sf(root);
+}
+
+Test(student_tests, reduce02, .description="Scripts use reductions; explain shows the fused kernels, validate the trace rule, and the cache tells them apart") {
+    use_default_tuning();
+    char script[] = TEST_OUTPUT_DIR "/reduce02.txt";
+    FILE *file = fopen(script, "w");
+    fprintf(file, "A = 2 3 [1 2 3 ; 4 5 6 ; ]\nB = 3 2 [1 0 ; 0 1 ; 1 1 ; ]\nT = trace(A * B)\nS = sum(A + A) * T + norm(B')\n");
+    fclose(file);
+    matrix_sf *result = execute_script_sf(script);
+    // trace(A * B) = 4 + 11, sum(A + A) = 42, norm(B) = 4
+    expect_matrices_equal(result, 1, 1, (int[]){42 * 15 + 4});
+    free(result);
+
+    FILE *out = tmpfile();
+    script_estimate_sf totals;
+    cr_expect_eq(explain_script_sf(script, out, 1, &totals), 1);
+    cr_expect_eq(totals.multiply_adds, 6 + 1);
+    char output[2048];
+    read_back(out, output, sizeof(output));
+    fclose(out);
+    cr_expect_not_null(strstr(output, "trace/fused"));
+    cr_expect_not_null(strstr(output, "sum/fused,mult/small,norm,add/in-place"));
+    cr_expect_eq(count_occurrences(output, " ok\n"), 4);
+
+    file = fopen(script, "w");
+    fprintf(file, "A = 2 3 [1 2 3 ; 4 5 6 ; ]\nB = trace(A + A)\n");
+    fclose(file);
+    char error[128];
+    cr_expect_eq(validate_script_sf(script, error, sizeof(error)), 0);
+    cr_expect_not_null(strstr(error, "can't take the trace of 2x3"));
+
+    char traced[] = TEST_OUTPUT_DIR "/reduce02_trace.txt", summed[] = TEST_OUTPUT_DIR "/reduce02_sum.txt";
+    file = fopen(traced, "w");
+    fprintf(file, "A = 2 2 [1 2 ; 3 4 ; ]\nB = trace(A)\n");
+    fclose(file);
+    file = fopen(summed, "w");
+    fprintf(file, "A = 2 2 [1 2 ; 3 4 ; ]\nB = sum(A)\n");
+    fclose(file);
+    cache_sf *cache = create_cache_sf(1 << 20, NULL);
+    result = execute_script_cached_sf(traced, cache);
+    expect_matrices_equal(result, 1, 1, (int[]){5});
+    free(result);
+    result = execute_script_cached_sf(summed, cache);
+    expect_matrices_equal(result, 1, 1, (int[]){10});
+    free(result);
+    free_cache_sf(cache);
+}
+
+/* Slice tests */
+static matrix_sf* copy_block(const matrix_sf *mat, unsigned int row_begin, unsigned int row_end, unsigned int col_begin,
+                             unsigned int col_end) {
+    unsigned int rows = row_end - row_begin, cols = col_end - col_begin;
+    matrix_sf *block = malloc(sizeof(matrix_sf) + (size_t)rows * cols * sizeof(int));
+    block->name = '?';
+    block->num_rows = rows;
+    block->num_cols = cols;
+    for (unsigned int row = 0; row < rows; row++)
+        for (unsigned int col = 0; col < cols; col++)
+            block->values[row * cols + col] = mat->values[(row_begin + row) * mat->num_cols + col_begin + col];
+    return block;
+}
+
+Test(student_tests, slice01, .description="Slices convert to postfix and add, multiply and transpose like copies of their blocks") {
+    char *postfix = infix2postfix_sf("A [1:3, :]' + B[ 2 , 0:4 ] * C");
+    cr_expect_str_eq(postfix, "A[1:3,:]'B[2,0:4]C*+");
+    free(postfix);
+    cr_expect_null(infix2postfix_sf("A[1:x, :]"));
+    cr_expect_null(infix2postfix_sf("(A + B)[0, 0]"));
+    cr_expect_null(infix2postfix_sf("A[0:2, 1"));
+
+    matrix_sf *A = make_pattern_matrix(9, 8, 1), *B = make_pattern_matrix(6, 5, 2);
+    A->name = 'A'; B->name = 'B';
+    bst_sf *root = insert_bst_sf(B, insert_bst_sf(A, NULL));
+    matrix_sf *A_block = copy_block(A, 2, 7, 1, 5), *A_rows = copy_block(A, 0, 4, 0, 8), *B_cols = copy_block(B, 1, 5, 1, 5);
+    matrix_sf *A_col = copy_block(A, 0, 9, 3, 4), *B_tail = copy_block(B, 1, 6, 0, 4);
+    matrix_sf *sum = add_mats_sf(A_block, B_tail), *At = transpose_mat_sf(A_rows), *product = mult_mats_sf(At, A_rows);
+    matrix_sf *block_product = mult_mats_sf(A_block, B_cols), *colt = transpose_mat_sf(A_col);
+
+    matrix_sf *result = evaluate_expr_sf('R', "A[2:7, 1:5] + B[1:, :4]", root);
+    expect_matrices_equal(result, 5, 4, sum->values);
+    free(result);
+    result = evaluate_expr_sf('R', "A[:4, :]' * A[0:4, 0:8]", root);
+    expect_matrices_equal(result, 8, 8, product->values);
+    free(result);
+    result = evaluate_expr_sf('R', "A[2:7, 1:5] * B[1:5, 1:]", root);
+    expect_matrices_equal(result, 5, 4, block_product->values);
+    free(result);
+    result = evaluate_expr_sf('R', "A[:, 3]'", root);
+    expect_matrices_equal(result, 1, 9, colt->values);
+    free(result);
+    result = evaluate_expr_sf('R', "A[4, 6]", root);
+    expect_matrices_equal(result, 1, 1, &A->values[4 * 8 + 6]);
+    free(result);
+    cr_expect_null(evaluate_expr_sf('R', "A[2:10, :]", root));
+    cr_expect_null(evaluate_expr_sf('R', "A[3:3, :]", root));
+    cr_expect_null(evaluate_expr_sf('R', "A[:, 1:5] + B", root));
+
+    matrix_sf *pieces[] = {A_block, A_rows, B_cols, A_col, B_tail, sum, At, product, block_product, colt};
+    for (unsigned int i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++)
+        free(pieces[i]);
+    free_bst_sf(root);
+}
+
+Test(student_tests, slice02, .description="Scripts use slices; explain shows the strided kernels and validate the slice bounds") {
+    use_default_tuning();
+    char script[] = TEST_OUTPUT_DIR "/slice02.txt";
+    FILE *file = fopen(script, "w");
+    fprintf(file, "A = 3 4 [1 2 3 4 ; 5 6 7 8 ; 9 10 11 12 ; ]\nB = A[1:, 2:] * A[0:2, :2]'\nC = sum(A[:, 1:3]) + B[1, 1]\n");
+    fclose(file);
+    // B = [7 8 ; 11 12] * [1 5 ; 2 6] = [23 83 ; 35 127], sum of A's middle columns 39
+    matrix_sf *result = execute_script_sf(script);
+    expect_matrices_equal(result, 1, 1, (int[]){39 + 127});
+    free(result);
+
+    FILE *out = tmpfile();
+    script_estimate_sf totals;
+    cr_expect_eq(explain_script_sf(script, out, 1, &totals), 1);
+    cr_expect_eq(totals.multiply_adds, 2 * 2 * 2);
+    char output[2048];
+    read_back(out, output, sizeof(output));
+    fclose(out);
+    cr_expect_not_null(strstr(output, "transpose/strided,mult/strided"));
+    cr_expect_not_null(strstr(output, "slice/copy,sum,add/strided"));
+    cr_expect_eq(count_occurrences(output, " ok\n"), 3);
+
+    file = fopen(script, "w");
+    fprintf(file, "A = 2 3 [1 2 3 ; 4 5 6 ; ]\nB = A[1:3, :]\n");
+    fclose(file);
+    char error[128];
+    cr_expect_eq(validate_script_sf(script, error, sizeof(error)), 0);
+    cr_expect_not_null(strstr(error, "A[...] is out of range for 2x3"));
+    cr_expect_null(execute_script_sf(script));
+}
+
+/* Batched API tests */
+Test(student_tests, batch01, .description="Batched add, multiply and transpose match the per-matrix kernels, including a ragged last block") {
+    size_t count = 203;
+    matrix_batch_sf *A = create_batch_sf(3, 5, count), *B = create_batch_sf(5, 4, count), *C = create_batch_sf(3, 5, count);
+    for (size_t i = 0; i < count; i++) {
+        matrix_sf *a = make_pattern_matrix(3, 5, (int)i), *b = make_pattern_matrix(5, 4, (int)i + 1000);
+        matrix_sf *c = make_pattern_matrix(3, 5, (int)i + 2000);
+        cr_expect_eq(set_batch_matrix_sf(A, i, a), 1);
+        cr_expect_eq(set_batch_matrix_sf(B, i, b), 1);
+        cr_expect_eq(set_batch_matrix_sf(C, i, c), 1);
+        free(a); free(b); free(c);
+    }
+    matrix_batch_sf *sum = add_batch_sf(A, C), *product = mult_batch_sf(A, B), *transposed = transpose_batch_sf(B);
+    cr_assert_not_null(sum);
+    cr_assert_not_null(product);
+    cr_assert_not_null(transposed);
+    cr_expect_eq(transposed->num_rows, 4);
+    cr_expect_eq(transposed->num_cols, 5);
+    for (size_t i = 0; i < count; i += 7) {
+        matrix_sf *a = get_batch_matrix_sf('A', A, i), *b = get_batch_matrix_sf('B', B, i), *c = get_batch_matrix_sf('C', C, i);
+        matrix_sf *expected_sum = add_mats_sf(a, c), *expected_product = mult_mats_sf(a, b), *expected_t = transpose_mat_sf(b);
+        matrix_sf *got_sum = get_batch_matrix_sf('S', sum, i), *got_product = get_batch_matrix_sf('P', product, i);
+        matrix_sf *got_t = get_batch_matrix_sf('T', transposed, i);
+        expect_matrices_equal(got_sum, 3, 5, expected_sum->values);
+        expect_matrices_equal(got_product, 3, 4, expected_product->values);
+        expect_matrices_equal(got_t, 4, 5, expected_t->values);
+        matrix_sf *pieces[] = {a, b, c, expected_sum, expected_product, expected_t, got_sum, got_product, got_t};
+        for (unsigned int j = 0; j < sizeof(pieces) / sizeof(pieces[0]); j++)
+            free(pieces[j]);
+    }
+    free(sum); free(product); free(transposed);
+    free(A); free(B); free(C);
+}
+
+Test(student_tests, batch02, .description="Batches reject mismatched shapes, counts and indices, and large batches split across threads give the same products") {
+    matrix_batch_sf *A = create_batch_sf(2, 3, 10), *B = create_batch_sf(2, 3, 11), *C = create_batch_sf(3, 3, 10);
+    matrix_sf *wrong = make_pattern_matrix(3, 2, 1);
+    cr_expect_eq(set_batch_matrix_sf(A, 0, wrong), 0);
+    cr_expect_eq(set_batch_matrix_sf(A, 10, wrong), 0);
+    cr_expect_null(get_batch_matrix_sf('X', A, 10));
+    cr_expect_null(add_batch_sf(A, B));
+    cr_expect_null(add_batch_sf(A, C));
+    cr_expect_null(mult_batch_sf(A, A));
+    cr_expect_null(mult_batch_sf(B, C));
+    free(wrong);
+    free(A); free(B); free(C);
+
+    // Enough 8x8 products to be worth several tasks
+    size_t count = 5000;
+    matrix_batch_sf *L = create_batch_sf(8, 8, count), *R = create_batch_sf(8, 8, count);
+    for (size_t i = 0; i < 8 * 8 * count; i++) {
+        L->values[i] = (int)(i % 17) - 8;
+        R->values[i] = (int)(i % 13) - 6;
+    }
+    matrix_batch_sf *product = mult_batch_sf(L, R);
+    cr_assert_not_null(product);
+    for (size_t i = 0; i < count; i += 499) {
+        matrix_sf *l = get_batch_matrix_sf('L', L, i), *r = get_batch_matrix_sf('R', R, i);
+        matrix_sf *expected = mult_mats_sf(l, r), *got = get_batch_matrix_sf('P', product, i);
+        expect_matrices_equal(got, 8, 8, expected->values);
+        free(l); free(r); free(expected); free(got);
+    }
+    free(product);
+    free(L); free(R);
+}
+
+/* Fork-join evaluation tests */
+Test(student_tests, fork01, .description="Expensive sibling subtrees evaluated on separate threads give the sequential results") {
+    use_default_tuning();
+    setenv("HW7_THREADS", "4", 1);
+    unsigned int n = 130;
+    const char names[] = "GEXRQL";
+    bst_sf *root = NULL;
+    matrix_sf *mats[6];
+    for (unsigned int i = 0; i < 6; i++) {
+        mats[i] = make_pattern_matrix(n, n, (int)i + 1);
+        for (unsigned int j = 0; j < n * n; j++)
+            mats[i]->values[j] %= 7;
+        mats[i]->name = names[i];
+        root = insert_bst_sf(mats[i], root);
+    }
+    matrix_sf *G = mats[0], *E = mats[1], *X = mats[2], *R = mats[3], *Q = mats[4], *L = mats[5];
+    // (G + E * X) * (R + Q * L) * (L + X * R), one kernel call at a time
+    matrix_sf *EX = mult_mats_sf(E, X), *QL = mult_mats_sf(Q, L), *XR = mult_mats_sf(X, R);
+    matrix_sf *first = add_mats_sf(G, EX), *second = add_mats_sf(R, QL), *third = add_mats_sf(L, XR);
+    matrix_sf *partial = mult_mats_sf(first, second), *expected = mult_mats_sf(partial, third);
+
+    matrix_sf *result = evaluate_expr_sf('Z', "(G+E*X)*(R+Q*L)*(L+X*R)", root);
+    expect_matrices_equal(result, n, n, expected->values);
+    free(result);
+    pool_sf *pool = create_pool_sf();
+    result = evaluate_expr_pool_sf('Z', "(G + E * X) * (R + Q * L) * (L + X * R)", root, pool);
+    expect_matrices_equal(result, n, n, expected->values);
+    // The sum accumulates into a forked product, which then has to become the pool's result
+    matrix_sf *forked_sum = add_mats_sf(EX, QL);
+    result = evaluate_expr_pool_sf('Z', "E * X + Q * L", root, pool);
+    expect_matrices_equal(result, n, n, forked_sum->values);
+    free(forked_sum);
+    free_pool_sf(pool);
+    // The same fork under a transpose and a reduction
+    matrix_sf *EXt = transpose_mat_sf(EX), *sum = add_mats_sf(EXt, QL);
+    int expected_sum = 0;
+    for (unsigned int j = 0; j < n * n; j++)
+        expected_sum += sum->values[j];
+    result = evaluate_expr_sf('Z', "sum((E * X)' + Q * L)", root);
+    expect_matrices_equal(result, 1, 1, &expected_sum);
+    free(result);
+
+    matrix_sf *pieces[] = {EX, QL, XR, first, second, third, partial, expected, EXt, sum};
+    for (unsigned int i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++)
+        free(pieces[i]);
+    free_bst_sf(root);
+}
+
+Test(student_tests, fork02, .description="Scripts fork subtrees over the symbol table, and a subtree that fails fails the whole expression") {
+    use_default_tuning();
+    setenv("HW7_THREADS", "4", 1);
+    unsigned int n = 110;
+    matrix_sf *A = make_pattern_matrix(n, n, 7), *B = make_pattern_matrix(n, n, 8), *C = make_pattern_matrix(n, n + 1, 9);
+    char script[] = TEST_OUTPUT_DIR "/fork02.txt";
+    FILE *file = fopen(script, "w");
+    write_matrix_statement(file, 'A', A);
+    write_matrix_statement(file, 'B', B);
+    fprintf(file, "S = (A * B + B) * (B * A + A)\n");
+    fclose(file);
+    matrix_sf *AB = mult_mats_sf(A, B), *BA = mult_mats_sf(B, A), *left = add_mats_sf(AB, B), *right = add_mats_sf(BA, A);
+    matrix_sf *expected = mult_mats_sf(left, right);
+    matrix_sf *result = execute_script_sf(script);
+    expect_matrices_equal(result, n, n, expected->values);
+    free(result);
+
+    A->name = 'A'; B->name = 'B'; C->name = 'C';
+    bst_sf *root = insert_bst_sf(C, insert_bst_sf(B, insert_bst_sf(A, NULL)));
+    cr_expect_null(evaluate_expr_sf('Z', "(A * B) * (B * C + A)", root));
+    cr_expect_null(evaluate_expr_sf('Z', "(A * B) + (B * A) * D", root));
+    matrix_sf *pieces[] = {AB, BA, left, right, expected};
+    for (unsigned int i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++)
+        free(pieces[i]);
+    free_bst_sf(root);
+}
+
+Test(student_tests, fork03, .description="Forked subtrees keep their triangular and diagonal structure for the operators above them") {
+    use_default_tuning();
+    setenv("HW7_THREADS", "4", 1);
+    unsigned int n = 130;
+    matrix_sf *U = make_pattern_matrix(n, n, 10), *D = make_pattern_matrix(n, n, 11);
+    for (unsigned int j = 0; j < n * n; j++) {
+        U->values[j] = j % n < j / n ? 0 : U->values[j] % 5;
+        D->values[j] = j % n != j / n ? 0 : D->values[j] % 5;
+    }
+    matrix_sf *Ut = transpose_mat_sf(U), *UU = mult_mats_sf(U, U), *UtUt = mult_mats_sf(Ut, Ut);
+    matrix_sf *DD = mult_mats_sf(D, D);
+    // Upper times lower, and a sum with a diagonal matrix, each over two forked products. A session classifies its
+    // matrices when they are set, so the operands arrive tagged.
+    matrix_sf *product = mult_mats_sf(UU, UtUt), *sum = add_mats_sf(UU, DD);
+    session_sf *session = create_session_sf();
+    cr_assert_not_null(session);
+    cr_assert_eq(set_session_matrix_sf(session, 'U', U), 1);
+    cr_assert_eq(set_session_matrix_sf(session, 'D', D), 1);
+    matrix_sf *result = evaluate_session_sf(session, 'Z', "(U * U) * (U' * U')");
+    expect_matrices_equal(result, n, n, product->values);
+    free(result);
+    result = evaluate_session_sf(session, 'Z', "(U * U) + (D * D)");
+    expect_matrices_equal(result, n, n, sum->values);
+    free(result);
+    matrix_sf *pieces[] = {Ut, UU, UtUt, DD, product, sum};
+    for (unsigned int i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++)
+        free(pieces[i]);
+    free_session_sf(session);
+}
+
+typedef struct {
+    session_sf *session;
+    const matrix_sf *expected;
+    int mismatches;
+} fork04_reader;
+
+static void* run_fork04_reader(void *arg) {
+    fork04_reader *reader = arg;
+    for (int round = 0; round < 4; round++) {
+        matrix_sf *result = evaluate_session_sf(reader->session, 'Z', "(A * B + B) * (B * A + A)");
+        if (result == NULL || memcmp(result->values, reader->expected->values, 96 * 96 * sizeof(int)) != 0)
+            reader->mismatches++;
+        free(result);
+    }
+    return NULL;
+}
+
+Test(student_tests, fork04, .description="Concurrent evaluations fork and split their kernels over the shared workers") {
+    setenv("HW7_THREADS", "4", 1);
+    tuning_sf original, tuning;
+    get_tuning_sf(&original);
+    default_tuning_sf(&tuning);
+    // Every product forks and then splits its rows, so tasks of one evaluation queue behind another's
+    tuning.fork_min_madds = tuning.parallel_mult_min_madds = tuning.parallel_add_min_values = 1024;
+    set_tuning_sf(&tuning);
+    unsigned int n = 96;
+    matrix_sf *A = make_pattern_matrix(n, n, 12), *B = make_pattern_matrix(n, n, 13);
+    matrix_sf *AB = mult_mats_sf(A, B), *BA = mult_mats_sf(B, A);
+    matrix_sf *left = add_mats_sf(AB, B), *right = add_mats_sf(BA, A), *expected = mult_mats_sf(left, right);
+    session_sf *session = create_session_sf();
+    cr_assert_eq(set_session_matrix_sf(session, 'A', A), 1);
+    cr_assert_eq(set_session_matrix_sf(session, 'B', B), 1);
+    pthread_t threads[4];
+    fork04_reader readers[4];
+    for (unsigned int i = 0; i < 4; i++) {
+        readers[i] = (fork04_reader){session, expected, 0};
+        pthread_create(&threads[i], NULL, run_fork04_reader, &readers[i]);
+    }
+    for (unsigned int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+        cr_expect_eq(readers[i].mismatches, 0);
+    }
+    set_tuning_sf(&original);
+    matrix_sf *pieces[] = {AB, BA, left, right, expected};
+    for (unsigned int i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++)
+        free(pieces[i]);
+    free_session_sf(session);
+}
+
+/* Script daemon tests */
+Test(student_tests, server01, .description="A session keeps its symbols across requests, and sessions don't see each other's") {
+    server_sf *server = start_server_sf(TEST_OUTPUT_DIR "/server01.sock", 2);
+    cr_assert_not_null(server);
+    cr_expect_null(start_server_sf(TEST_OUTPUT_DIR "/server01.sock", 1), "The socket is already being served.");
+    int session = connect_server_sf(TEST_OUTPUT_DIR "/server01.sock");
+    cr_assert(session >= 0);
+
+    char *answer = NULL;
+    size_t answer_size = 0;
+    FILE *results = open_memstream(&answer, &answer_size);
+    matrix_sf *result = run_remote_script_sf(session, "A = 2 3 [1 2 3; 4 5 6]\n\nB = A'\nF = A * A\nC = A * B", results);
+    fclose(results);
+    cr_expect_str_eq(answer, "2 3 1 2 3 4 5 6\n3 2 1 4 2 5 3 6\n! F: undefined name or mismatched shapes\n2 2 14 32 32 77\n.\n");
+    cr_assert_not_null(result);
+    cr_expect_eq(result->name, 'C');
+    expect_matrices_equal(result, 2, 2, (int[]){14, 32, 32, 77});
+    free(result);
+    free(answer);
+
+    result = run_remote_script_sf(session, "D = C + C'\n", NULL);
+    cr_assert_not_null(result);
+    cr_expect_eq(result->name, 'D');
+    expect_matrices_equal(result, 2, 2, (int[]){28, 64, 64, 154});
+    free(result);
+
+    int other_session = connect_server_sf(TEST_OUTPUT_DIR "/server01.sock");
+    cr_expect_null(run_remote_script_sf(other_session, "E = C\n", NULL));
+    close(other_session);
+    close(session);
+    stop_server_sf(server);
+    cr_expect_neq(access(TEST_OUTPUT_DIR "/server01.sock", F_OK), 0, "Stopping the server removes its socket.");
+}
+
+Test(student_tests, server03, .description="A request can redefine a name an earlier request defined, but not one it defined itself") {
+    server_sf *server = start_server_sf(TEST_OUTPUT_DIR "/server03.sock", 1);
+    cr_assert_not_null(server);
+    int session = connect_server_sf(TEST_OUTPUT_DIR "/server03.sock");
+    cr_assert(session >= 0);
+    matrix_sf *result = run_remote_script_sf(session, "A = 1 2 [1 2]\nB = A + A\n", NULL);
+    free(result);
+    // The old A is read on the right-hand side before the new one replaces it; the second A in a request is ignored
+    result = run_remote_script_sf(session, "A = A + B\nA = 1 1 [9]\nC = A\n", NULL);
+    cr_assert_not_null(result);
+    expect_matrices_equal(result, 1, 2, (int[]){3, 6});
+    free(result);
+    result = run_remote_script_sf(session, "B = 2 1 [4; 5]\nD = A * B\n", NULL);
+    cr_assert_not_null(result);
+    expect_matrices_equal(result, 1, 1, (int[]){42});
+    free(result);
+    close(session);
+    stop_server_sf(server);
+}
+
+typedef struct {
+    const char *socket_path;
+    int seed;
+    int mismatches;
+} server02_client;
+
+static void* run_server02_client(void *arg) {
+    server02_client *client = arg;
+    int session = connect_server_sf(client->socket_path);
+    char script[128];
+    for (int request = 0; request < 20; request++) {
+        int value = client->seed * 100 + request;
+        snprintf(script, sizeof(script), "A = 2 2 [%d 1; 0 1]\nB = A * A\n", value);
+        matrix_sf *result = run_remote_script_sf(session, script, NULL);
+        // Each request redefines A, so every answer is this request's
+        if (result == NULL || result->values[0] != value * value || result->values[1] != value + 1)
+            client->mismatches++;
+        free(result);
+    }
+    close(session);
+    return NULL;
+}
+
+Test(student_tests, server02, .description="More sessions than workers are all served, and stopping closes the sessions left open") {
+    server_sf *server = start_server_sf(TEST_OUTPUT_DIR "/server02.sock", 2);
+    cr_assert_not_null(server);
+    pthread_t threads[8];
+    server02_client clients[8];
+    for (int i = 0; i < 8; i++) {
+        clients[i] = (server02_client){TEST_OUTPUT_DIR "/server02.sock", i + 1, 0};
+        pthread_create(&threads[i], NULL, run_server02_client, &clients[i]);
+    }
+    for (int i = 0; i < 8; i++) {
+        pthread_join(threads[i], NULL);
+        cr_expect_eq(clients[i].mismatches, 0, "Session %d got a wrong answer.", i);
+    }
+
+    int left_open = connect_server_sf(TEST_OUTPUT_DIR "/server02.sock");
+    matrix_sf *result = run_remote_script_sf(left_open, "A = 1 1 [5]\n", NULL);
+    cr_assert_not_null(result);
+    expect_matrices_equal(result, 1, 1, (int[]){5});
+    free(result);
+    stop_server_sf(server);
+    cr_expect_null(run_remote_script_sf(left_open, "B = A\n", NULL));
+    close(left_open);
+}
+
+/* Concurrent session tests */
+Test(student_tests, session01, .description="Session names can be set, replaced and removed between evaluations") {
+    session_sf *session = create_session_sf();
+    cr_assert_not_null(session);
+    cr_expect(set_session_matrix_sf(session, 'A', copy_matrix(2, 2, (int[]){1, 2, 3, 4})));
+    cr_expect(set_session_matrix_sf(session, 'B', copy_matrix(2, 1, (int[]){1, 1})));
+    matrix_sf *result = evaluate_session_sf(session, 'Z', "A * B + B");
+    cr_assert_not_null(result);
+    cr_expect_eq(result->name, 'Z');
+    expect_matrices_equal(result, 2, 1, (int[]){4, 8});
+    free(result);
+    result = evaluate_session_sf(session, 'Z', "A");
+    expect_matrices_equal(result, 2, 2, (int[]){1, 2, 3, 4});
+    free(result);
+
+    cr_expect(set_session_matrix_sf(session, 'A', copy_matrix(1, 2, (int[]){5, 6})));
+    result = evaluate_session_sf(session, 'Z', "A * B");
+    expect_matrices_equal(result, 1, 1, (int[]){11});
+    free(result);
+    cr_expect_null(evaluate_session_sf(session, 'Z', "A + B"), "Mismatched shapes fail the evaluation.");
+    cr_expect(set_session_matrix_sf(session, 'B', NULL));
+    cr_expect_null(evaluate_session_sf(session, 'Z', "A * B"), "A removed name is undefined.");
+    free_session_sf(session);
+}
+
+typedef struct {
+    session_sf *session;
+    atomic_int *stop;
+    int wrong;
+    int evaluated;
+} session02_reader;
+
+static void* run_session02_reader(void *arg) {
+    session02_reader *reader = arg;
+    // Either C evaluates to the same product plus 1 or plus 2 everywhere; never a mix, and never freed memory
+    while (!atomic_load(reader->stop) || reader->evaluated == 0) {
+        matrix_sf *result = evaluate_session_sf(reader->session, 'Z', "A * B + C");
+        if (result == NULL) {
+            reader->wrong++;
+            continue;
+        }
+        int offset = result->values[0] - 12;
+        if (offset != 1 && offset != 2)
+            reader->wrong++;
+        for (unsigned int i = 0; i < 16; i++)
+            if (result->values[i] != 12 + offset)
+                reader->wrong++;
+        free(result);
+        reader->evaluated++;
+    }
+    return NULL;
+}
+
+Test(student_tests, session02, .description="Readers evaluate concurrently while a writer keeps replacing an operand") {
+    session_sf *session = create_session_sf();
+    cr_assert_not_null(session);
+    int ones[16] = {0}, threes[16] = {0};
+    for (unsigned int i = 0; i < 16; i++) {
+        ones[i] = 1;
+        threes[i] = 3;
+    }
+    set_session_matrix_sf(session, 'A', copy_matrix(4, 4, ones));
+    set_session_matrix_sf(session, 'B', copy_matrix(4, 4, threes));
+    set_session_matrix_sf(session, 'C', copy_matrix(4, 4, ones));
+
+    atomic_int stop = 0;
+    pthread_t threads[4];
+    session02_reader readers[4];
+    for (int i = 0; i < 4; i++) {
+        readers[i] = (session02_reader){session, &stop, 0, 0};
+        pthread_create(&threads[i], NULL, run_session02_reader, &readers[i]);
+    }
+    for (int round = 0; round < 200; round++) {
+        matrix_sf *C = copy_matrix(4, 4, ones);
+        for (unsigned int i = 0; i < 16; i++)
+            C->values[i] += round % 2;
+        cr_expect(set_session_matrix_sf(session, 'C', C));
+    }
+    atomic_store(&stop, 1);
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+        cr_expect_eq(readers[i].wrong, 0, "Reader %d saw a wrong result.", i);
+    }
+    free_session_sf(session);
+}
+
+/* Tuning profile tests */
+Test(student_tests, tune01, .description="A tuning profile round-trips, skips comments and unknown names, and missing entries keep their defaults") {
+    tuning_sf defaults, saved = {7, 24, 3, 5, 1ULL << 40, 11, 13, 17, 19}, loaded;
+    default_tuning_sf(&defaults);
+    char path[] = TEST_OUTPUT_DIR "/tune01.profile";
+    cr_assert_eq(save_tuning_sf(path, &saved), 1);
+    cr_assert_eq(load_tuning_sf(path, &loaded), 1);
+    cr_expect_eq(memcmp(&loaded, &saved, sizeof(tuning_sf)), 0);
+
+    FILE *file = fopen(path, "w");
+    cr_assert_not_null(file);
+    fprintf(file, "# partial profile\ntranspose_block 32\nvector_width 8\n\nfork_min_madds 99\nsmall_mult_max_dim\n");
+    fclose(file);
+    cr_assert_eq(load_tuning_sf(path, &loaded), 1);
+    cr_expect_eq(loaded.transpose_block, 32);
+    cr_expect_eq(loaded.fork_min_madds, 99);
+    cr_expect_eq(loaded.small_mult_max_dim, defaults.small_mult_max_dim);
+    cr_expect_eq(loaded.mult_block_cols, defaults.mult_block_cols);
+    cr_expect_eq(loaded.parallel_add_min_values, defaults.parallel_add_min_values);
+
+    cr_expect_eq(load_tuning_sf(TEST_OUTPUT_DIR "/tune01.missing", &loaded), 0);
+    cr_expect_eq(memcmp(&loaded, &defaults, sizeof(tuning_sf)), 0);
+}
+
+Test(student_tests, tune02, .description="Odd block sizes, no unrolled kernels and threads for every op give the same results as the defaults") {
+    setenv("HW7_THREADS", "4", 1);
+    tuning_sf original;
+    get_tuning_sf(&original);
+    matrix_sf *A = make_pattern_matrix(37, 53, 1), *B = make_pattern_matrix(53, 29, 2), *C = make_pattern_matrix(37, 53, 3);
+    matrix_sf *S = make_pattern_matrix(4, 4, 4);
+    matrix_sf *expected[] = {mult_mats_sf(A, B), add_mats_sf(A, C), transpose_mat_sf(A), mult_mats_sf(S, S),
+                             transpose_mat_sf(S)};
+
+    tuning_sf odd = {5, 3, 0, 0, 1, 1, 1, 1, 0};
+    set_tuning_sf(&odd);
+    matrix_sf *got[] = {mult_mats_sf(A, B), add_mats_sf(A, C), transpose_mat_sf(A), mult_mats_sf(S, S),
+                        transpose_mat_sf(S)};
+    for (unsigned int i = 0; i < sizeof(got) / sizeof(got[0]); i++) {
+        cr_assert_not_null(got[i]);
+        expect_matrices_equal(got[i], expected[i]->num_rows, expected[i]->num_cols, expected[i]->values);
+    }
+    // Both products of the sum fork under a grain of one multiply-add
+    A->name = 'A';
+    B->name = 'B';
+    C->name = 'C';
+    bst_sf *root = insert_bst_sf(C, insert_bst_sf(B, insert_bst_sf(A, NULL)));
+    matrix_sf *forked = evaluate_expr_sf('Z', "A*B+C*B", root);
+    set_tuning_sf(&original);
+    matrix_sf *sequential = evaluate_expr_sf('Z', "A*B+C*B", root);
+    cr_assert_not_null(forked);
+    cr_assert_not_null(sequential);
+    expect_matrices_equal(forked, 37, 29, sequential->values);
+
+    for (unsigned int i = 0; i < sizeof(got) / sizeof(got[0]); i++) {
+        free(got[i]);
+        free(expected[i]);
+    }
+    free(forked);
+    free(sequential);
+    free(S);
+    free_bst_sf(root);
+}
+
+static void* run_tune03_thread(void *arg) {
+    matrix_sf **operands = arg;
+    int mismatches = 0;
+    for (int round = 0; round < 50; round++) {
+        matrix_sf *product = mult_mats_sf(operands[0], operands[1]), *transposed = transpose_mat_sf(operands[0]);
+        if (product == NULL || transposed == NULL ||
+            memcmp(product->values, operands[2]->values, 37 * 29 * sizeof(int)) != 0 ||
+            memcmp(transposed->values, operands[3]->values, 37 * 53 * sizeof(int)) != 0)
+            mismatches++;
+        free(product);
+        free(transposed);
+    }
+    return (void *)(intptr_t)mismatches;
+}
+
+Test(student_tests, tune03, .description="set_tuning_sf can switch tunings while other threads run kernels") {
+    tuning_sf original, odd = {5, 3, 0, 0, 1, 1, 1, 1, 0};
+    get_tuning_sf(&original);
+    matrix_sf *A = make_pattern_matrix(37, 53, 1), *B = make_pattern_matrix(53, 29, 2);
+    matrix_sf *operands[] = {A, B, mult_mats_sf(A, B), transpose_mat_sf(A)};
+    pthread_t threads[4];
+    for (unsigned int i = 0; i < 4; i++)
+        pthread_create(&threads[i], NULL, run_tune03_thread, operands);
+    for (int round = 0; round < 200; round++)
+        set_tuning_sf(round % 2 == 0 ? &odd : &original);
+    for (unsigned int i = 0; i < 4; i++) {
+        void *mismatches;
+        pthread_join(threads[i], &mismatches);
+        cr_expect_eq((intptr_t)mismatches, 0);
+    }
+    set_tuning_sf(&original);
+    for (unsigned int i = 0; i < sizeof(operands) / sizeof(operands[0]); i++)
+        free(operands[i]);
+}
+
+/* Streaming store tests */
+Test(student_tests, stream01, .description="Sums and transposes written with streaming stores match the cached kernels, for any width and alignment") {
+    tuning_sf original, tuning;
+    get_tuning_sf(&original);
+    tuning = original;
+    // Widths that aren't a multiple of the vector width, and a transpose over more rows than one streaming band
+    const unsigned int shapes[][2] = {{1, 1}, {1, 7}, {7, 1}, {37, 53}, {300, 19}, {19, 300}};
+    for (unsigned int i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+        matrix_sf *A = make_pattern_matrix(shapes[i][0], shapes[i][1], (int)i);
+        matrix_sf *B = make_pattern_matrix(shapes[i][0], shapes[i][1], (int)i + 9);
+        tuning.stream_min_bytes = 0;
+        set_tuning_sf(&tuning);
+        matrix_sf *sum = add_mats_sf(A, B), *transposed = transpose_mat_sf(A);
+        tuning.stream_min_bytes = 1;
+        set_tuning_sf(&tuning);
+        matrix_sf *streamed_sum = add_mats_sf(A, B), *streamed_transposed = transpose_mat_sf(A);
+        cr_assert_not_null(streamed_sum);
+        cr_assert_not_null(streamed_transposed);
+        expect_matrices_equal(streamed_sum, shapes[i][0], shapes[i][1], sum->values);
+        expect_matrices_equal(streamed_transposed, shapes[i][1], shapes[i][0], transposed->values);
+        // Sums into an operand are never streamed, and still come out right
+        cr_assert_eq(add_into_sf(A, B), 1);
+        expect_matrices_equal(A, shapes[i][0], shapes[i][1], sum->values);
+        free(A); free(B); free(sum); free(transposed); free(streamed_sum); free(streamed_transposed);
+    }
+    set_tuning_sf(&original);
+}
+
+Test(student_tests, stream02, .description="Streaming stores split across threads write every row, and the threshold round-trips through a profile") {
+    setenv("HW7_THREADS", "4", 1);
+    tuning_sf original, tuning, loaded;
+    get_tuning_sf(&original);
+    tuning = original;
+    matrix_sf *A = make_pattern_matrix(301, 259, 3), *B = make_pattern_matrix(301, 259, 4);
+    tuning.stream_min_bytes = 0;
+    tuning.parallel_add_min_values = tuning.parallel_transpose_min_values = 0;
+    set_tuning_sf(&tuning);
+    matrix_sf *sum = add_mats_sf(A, B), *transposed = transpose_mat_sf(A);
+    // Odd row splits start every task's share of the result at a different alignment
+    tuning.stream_min_bytes = 1;
+    tuning.parallel_add_min_values = tuning.parallel_transpose_min_values = 1;
+    set_tuning_sf(&tuning);
+    matrix_sf *streamed_sum = add_mats_sf(A, B), *streamed_transposed = transpose_mat_sf(A);
+    set_tuning_sf(&original);
+    cr_assert_not_null(streamed_sum);
+    cr_assert_not_null(streamed_transposed);
+    expect_matrices_equal(streamed_sum, 301, 259, sum->values);
+    expect_matrices_equal(streamed_transposed, 259, 301, transposed->values);
+
+    char path[] = TEST_OUTPUT_DIR "/stream02.profile";
+    tuning.stream_min_bytes = 123456789;
+    cr_assert_eq(save_tuning_sf(path, &tuning), 1);
+    cr_assert_eq(load_tuning_sf(path, &loaded), 1);
+    cr_expect_eq(loaded.stream_min_bytes, 123456789);
+    free(A); free(B); free(sum); free(transposed); free(streamed_sum); free(streamed_transposed);
+}